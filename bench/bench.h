@@ -0,0 +1,199 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file bench.h
+/// \brief cvBlob benchmarks: timing, options and output.
+
+#ifndef _CVBLOB_BENCH_H_
+#define _CVBLOB_BENCH_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+    /// \brief Benchmark clock.
+    typedef std::chrono::steady_clock Clock;
+
+    /// \brief Command line options shared by the benchmarks.
+    struct Options {
+        bool quick;         ///< Smaller sizes and shorter runs, for smoke testing.
+        double minSeconds;  ///< Minimum time spent on each measurement.
+        int minRuns;        ///< Minimum number of runs of each measurement.
+        std::string filter; ///< Only run the cases whose name contains this string.
+        bool check;         ///< Run the correctness checks instead of the measurements.
+    };
+
+    /// \brief Parses the command line: --quick, --min-time <seconds>, --min-runs <n>, --filter <substring>, and
+    /// --check for the benchmarks that have checks.
+    /// \param argc Number of arguments.
+    /// \param argv Arguments.
+    /// \param checks Whether the benchmark has correctness checks.
+    /// \return The options. Exits on an unknown argument.
+    inline Options ParseOptions(int argc, char **argv, bool checks = false) {
+        Options options;
+        options.quick = false;
+        options.minSeconds = .2;
+        options.minRuns = 5;
+        options.check = false;
+
+        for (int i = 1; i < argc; i++) {
+            if (!std::strcmp(argv[i], "--quick")) {
+                options.quick = true;
+                options.minSeconds = .01;
+                options.minRuns = 1;
+            }
+            else if (!std::strcmp(argv[i], "--min-time") && i + 1 < argc)
+                options.minSeconds = std::atof(argv[++i]);
+            else if (!std::strcmp(argv[i], "--min-runs") && i + 1 < argc)
+                options.minRuns = std::max(1, std::atoi(argv[++i]));
+            else if (!std::strcmp(argv[i], "--filter") && i + 1 < argc)
+                options.filter = argv[++i];
+            else if (checks && !std::strcmp(argv[i], "--check"))
+                options.check = true;
+            else {
+                std::fprintf(stderr, "Usage: %s [--quick] [--min-time <seconds>] [--min-runs <n>] [--filter <substring>]%s\n",
+                             argv[0], checks ? " [--check]" : "");
+                std::exit(2);
+            }
+        }
+        return options;
+    }
+
+    /// \brief Whether a case is selected by the filter option.
+    /// \param options The options.
+    /// \param name Case name.
+    /// \return True if the case must run.
+    inline bool Selected(const Options &options, const std::string &name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    /// \brief Times a function, running it until both the minimum number of runs and the minimum time are reached.
+    /// \param options The options.
+    /// \param f Function to time.
+    /// \return Median time of a run, in seconds.
+    template <typename F>
+    double Measure(const Options &options, F f) {
+        std::vector<double> times;
+        Clock::time_point start = Clock::now();
+        while ((int)times.size() < options.minRuns ||
+               std::chrono::duration<double>(Clock::now() - start).count() < options.minSeconds) {
+            Clock::time_point t0 = Clock::now();
+            f();
+            times.push_back(std::chrono::duration<double>(Clock::now() - t0).count());
+        }
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        return times[times.size() / 2];
+    }
+
+    /// \brief Times a fast function, in batches long enough for the clock resolution.
+    /// \param options The options.
+    /// \param f Function to time.
+    /// \return Median time of one call, in seconds.
+    template <typename F>
+    double MeasurePerCall(const Options &options, F f) {
+        size_t batch = 1;
+        for (;;) {
+            Clock::time_point t0 = Clock::now();
+            for (size_t i = 0; i < batch; i++)
+                f();
+            if (std::chrono::duration<double>(Clock::now() - t0).count() >= 1e-4 || batch >= ((size_t)1 << 24))
+                break;
+            batch *= 2;
+        }
+
+        return Measure(options, [&] {
+            for (size_t i = 0; i < batch; i++)
+                f();
+        }) / batch;
+    }
+
+    /// \brief Result record, printed as a JSON object on one line.
+    class Record {
+    public:
+        /// \brief Constructor.
+        /// \param benchmark Benchmark name, stored under "bench".
+        explicit Record(const std::string &benchmark) {
+            add("bench", benchmark);
+        }
+
+        /// \brief Adds a string field.
+        Record &add(const std::string &key, const std::string &value) {
+            std::string escaped;
+            for (char c : value) {
+                if (c == '"' || c == '\\')
+                    escaped += '\\';
+                escaped += c;
+            }
+            return field(key, "\"" + escaped + "\"");
+        }
+
+        /// \brief Adds a string field.
+        Record &add(const std::string &key, const char *value) {
+            return add(key, std::string(value));
+        }
+
+        /// \brief Adds a boolean field.
+        Record &add(const std::string &key, bool value) {
+            return field(key, value ? "true" : "false");
+        }
+
+        /// \brief Adds a number field, null if it is not finite.
+        template <typename T>
+        Record &add(const std::string &key, T value) {
+            std::ostringstream out;
+            out.precision(9);
+            if (std::isfinite((double)value))
+                out << value;
+            else
+                out << "null";
+            return field(key, out.str());
+        }
+
+        /// \brief Prints the record on stdout.
+        void Print() const {
+            std::printf("{%s}\n", fields.c_str());
+            std::fflush(stdout);
+        }
+
+    protected:
+        /// \brief Appends a field with its value already formatted.
+        Record &field(const std::string &key, const std::string &value) {
+            if (!fields.empty())
+                fields += ", ";
+            fields += "\"" + key + "\": " + value;
+            return *this;
+        }
+
+        std::string fields; ///< Formatted fields.
+    };
+
+} // Namespace
+
+#endif // _CVBLOB_BENCH_H_
@@ -0,0 +1,107 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "bench_alloc.h"
+
+namespace {
+    // Each block starts with its size, padded to keep the returned pointer aligned
+    const size_t kHeader = alignof(std::max_align_t);
+
+    std::atomic<size_t> allocations(0);
+    std::atomic<size_t> frees(0);
+    std::atomic<size_t> liveBytes(0);
+    std::atomic<size_t> peakBytes(0);
+
+    void *allocate(size_t size) {
+        char *block = (char *)std::malloc(size + kHeader);
+        if (!block)
+            return nullptr;
+        *(size_t *)block = size;
+
+        allocations++;
+        size_t live = liveBytes += size;
+        size_t peak = peakBytes.load();
+        while (live > peak && !peakBytes.compare_exchange_weak(peak, live)) {}
+        return block + kHeader;
+    }
+
+    void deallocate(void *p) {
+        if (!p)
+            return;
+        char *block = (char *)p - kHeader;
+        frees++;
+        liveBytes -= *(size_t *)block;
+        std::free(block);
+    }
+}  // namespace
+
+bench::AllocationStats bench::get_AllocationStats() {
+    AllocationStats stats;
+    stats.allocations = allocations.load();
+    stats.frees = frees.load();
+    stats.liveBytes = liveBytes.load();
+    stats.peakBytes = peakBytes.load();
+    return stats;
+}
+
+void bench::ResetPeak() {
+    peakBytes = liveBytes.load();
+}
+
+void *operator new(size_t size) {
+    void *p = allocate(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept {
+    deallocate(p);
+}
+
+void operator delete[](void *p) noexcept {
+    deallocate(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    deallocate(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    deallocate(p);
+}
@@ -0,0 +1,52 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file bench_alloc.h
+/// \brief Allocation counters of the benchmarks.
+/// Linking bench_alloc.cpp into a benchmark replaces the global operator new and delete with counting ones.
+
+#ifndef _CVBLOB_BENCH_ALLOC_H_
+#define _CVBLOB_BENCH_ALLOC_H_
+
+#include <cstddef>
+
+namespace bench {
+
+    /// \brief Allocation counters, since the start of the program.
+    /// Only allocations through operator new are seen: OpenCV matrices use their own allocator.
+    struct AllocationStats {
+        size_t allocations; ///< Number of allocations.
+        size_t frees;       ///< Number of deallocations.
+        size_t liveBytes;   ///< Bytes currently allocated.
+        size_t peakBytes;   ///< Maximum of liveBytes since the last ResetPeak.
+    };
+
+    /// \brief Gets the allocation counters.
+    /// \return The counters.
+    AllocationStats get_AllocationStats();
+
+    /// \brief Restarts the peak measurement from the bytes currently allocated.
+    void ResetPeak();
+
+} // Namespace
+
+#endif // _CVBLOB_BENCH_ALLOC_H_
@@ -0,0 +1,297 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file bench_geometry.cpp
+/// \brief Geometry and rendering microbenchmarks: contour and blob operations done after the labelling.
+/// Contour fixtures are circles, spirals and fractal coastlines, up to a million chain codes; blob fixtures are
+/// disks, rings and a frame of many disks. Prints one JSON record per fixture and operation, with the time and
+/// the allocations of one call.
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "cvb_blob_list.h"
+#include "bench.h"
+#include "bench_alloc.h"
+
+using namespace cvb;
+
+namespace {
+    const double kPi = std::atan(1) * 4;
+
+    /// \brief Keeps the results alive, so that the timed calls are not optimized out.
+    volatile double sink = 0.;
+
+    /// \brief Contour fixture.
+    struct ContourFixture {
+        std::string name;
+        ChainCodes chainCodes;
+        cv::Point start;
+    };
+
+    /// \brief Chain codes following a closed path, one pixel step at a time.
+    void traceChainCodes(const std::vector<cv::Point2d> &vertices, ContourFixture &fixture) {
+        static const ChainCode codes[3][3] = {
+            { ChainCode_up_left,   ChainCode_left, ChainCode_down_left  },
+            { ChainCode_up,        ChainCode_up,   ChainCode_down       },
+            { ChainCode_up_right,  ChainCode_right, ChainCode_down_right }
+        };
+
+        fixture.chainCodes.clear();
+        cv::Point p((int)std::floor(vertices.front().x + .5), (int)std::floor(vertices.front().y + .5));
+        fixture.start = p;
+        for (size_t i = 1; i <= vertices.size(); i++) {
+            const cv::Point2d &v = vertices[i % vertices.size()];
+            cv::Point q((int)std::floor(v.x + .5), (int)std::floor(v.y + .5));
+            while (p != q) {
+                int dx = (q.x > p.x) - (q.x < p.x), dy = (q.y > p.y) - (q.y < p.y);
+                fixture.chainCodes.push_back(codes[dx + 1][dy + 1]);
+                p += cv::Point(dx, dy);
+            }
+        }
+    }
+
+    ContourFixture circle(size_t chainCodes) {
+        // About 4 sqrt(2) steps per pixel of radius
+        double radius = chainCodes / 5.66;
+        size_t n = (size_t)std::ceil(2. * kPi * radius) + 3;
+        std::vector<cv::Point2d> vertices;
+        for (size_t i = 0; i < n; i++) {
+            double a = 2. * kPi * i / n;
+            vertices.push_back(cv::Point2d(radius * (1. + std::cos(a)), radius * (1. + std::sin(a))));
+        }
+        ContourFixture fixture;
+        fixture.name = "circle";
+        traceChainCodes(vertices, fixture);
+        return fixture;
+    }
+
+    ContourFixture spiral(size_t chainCodes) {
+        // Out along one arm and back along a parallel one, 3 pixels apart, arms 8 pixels apart
+        const double b = 8. / (2. * kPi), width = 3.;
+        double turns = std::sqrt(chainCodes / b) / (1.2 * 2. * kPi);
+        double maxAngle = 2. * kPi * std::max(1., turns);
+        std::vector<cv::Point2d> vertices;
+        double radius = b * maxAngle + width;
+        for (double a = 0.; a < maxAngle; a += 1. / std::max(1., b * a))
+            vertices.push_back(cv::Point2d(radius + b * a * std::cos(a), radius + b * a * std::sin(a)));
+        for (double a = maxAngle; a > 0.; a -= 1. / (b * a + width))
+            vertices.push_back(cv::Point2d(radius + (b * a + width) * std::cos(a), radius + (b * a + width) * std::sin(a)));
+        ContourFixture fixture;
+        fixture.name = "spiral";
+        traceChainCodes(vertices, fixture);
+        return fixture;
+    }
+
+    ContourFixture coastline(size_t chainCodes) {
+        // Midpoint displacement of a square, down to edges of about 2 pixels
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> unit(-1., 1.);
+        double side = chainCodes / 6.;
+        std::vector<cv::Point2d> vertices = {
+            cv::Point2d(0., 0.), cv::Point2d(side, 0.), cv::Point2d(side, side), cv::Point2d(0., side)
+        };
+        double edge = side;
+        while (edge > 2. && vertices.size() < 2 * chainCodes) {
+            std::vector<cv::Point2d> refined;
+            for (size_t i = 0; i < vertices.size(); i++) {
+                const cv::Point2d &a = vertices[i], &b = vertices[(i + 1) % vertices.size()];
+                cv::Point2d d = b - a;
+                cv::Point2d normal(-d.y, d.x);
+                refined.push_back(a);
+                refined.push_back((a + b) * .5 + normal * (.2 * unit(rng)));
+            }
+            vertices.swap(refined);
+            edge /= 2.;
+        }
+        ContourFixture fixture;
+        fixture.name = "coastline";
+        traceChainCodes(vertices, fixture);
+        return fixture;
+    }
+
+    /// \brief Blob fixture: a binary image with its labels.
+    struct BlobFixture {
+        std::string name;
+        cv::Mat img;       ///< Color image (type = CV_8UC3).
+        BlobList blobs;    ///< Labelled blobs.
+        cv::Mat imgLabel;  ///< Label image.
+    };
+
+    /// \brief Disk of a blob fixture.
+    struct Disk {
+        int x, y, radius;
+    };
+
+    void makeBlobFixture(BlobFixture &fixture, const cv::Size &size, const std::vector<Disk> &disks, int hole) {
+        cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+        fixture.img.create(size, CV_8UC3);
+        for (int y = 0; y < size.height; y++) {
+            unsigned char *row = mask.ptr(y);
+            unsigned char *color = fixture.img.ptr(y);
+            for (int x = 0; x < size.width; x++) {
+                for (auto &disk : disks) {
+                    int dx = x - disk.x, dy = y - disk.y;
+                    int d2 = dx * dx + dy * dy;
+                    if (d2 <= disk.radius * disk.radius && d2 >= hole * hole)
+                        row[x] = 255;
+                }
+                color[3 * x] = (unsigned char)x;
+                color[3 * x + 1] = (unsigned char)y;
+                color[3 * x + 2] = (unsigned char)(x + y);
+            }
+        }
+        fixture.blobs.LabelImage(mask, std::numeric_limits<Label>::max());
+        fixture.imgLabel = fixture.blobs.get_ImageLabel();
+    }
+
+    /// \brief Times one operation and counts its allocations, then prints the record.
+    void run(const bench::Options &options, const std::string &fixture, size_t size, const std::string &operation,
+             const std::function<void()> &f) {
+        if (!bench::Selected(options, fixture + "/" + operation))
+            return;
+
+        double seconds = bench::MeasurePerCall(options, f);
+
+        bench::AllocationStats before = bench::get_AllocationStats();
+        f();
+        bench::AllocationStats after = bench::get_AllocationStats();
+
+        bench::Record("geometry").add("fixture", fixture).add("size", size).add("operation", operation)
+            .add("ns_per_op", seconds * 1e9).add("allocations_per_op", after.allocations - before.allocations).Print();
+    }
+}  // namespace
+
+int main(int argc, char **argv) {
+    bench::Options options = bench::ParseOptions(argc, argv);
+
+    std::vector<size_t> lengths = {100, 10000, 1000000};
+    if (options.quick)
+        lengths.resize(2);
+
+    // Contours: the size is the number of chain codes
+    for (size_t length : lengths) {
+        std::vector<ContourFixture> fixtures = {circle(length), spiral(length), coastline(length)};
+        for (auto &fixture : fixtures) {
+            size_t n = fixture.chainCodes.size();
+            Contour contour(fixture.start, fixture.chainCodes);
+            SimplifyWorkspace workspace;
+            ContourPolygon polygon;
+
+            run(options, fixture.name, n, "add_ChainCode", [&] {
+                Contour built(fixture.start);
+                for (ChainCode code : fixture.chainCodes)
+                    built.add_ChainCode(code);
+                sink = sink + built.get_ContourPolygon().size();
+            });
+            run(options, fixture.name, n, "get_Perimeter", [&] {
+                sink = sink + contour.get_Perimeter();
+            });
+            run(options, fixture.name, n, "get_Area", [&] {
+                sink = sink + contour.get_Area();
+            });
+            run(options, fixture.name, n, "get_SimplifiedPolygon", [&] {
+                sink = sink + contour.get_SimplifiedPolygon(1.).size();
+            });
+            run(options, fixture.name, n, "get_SimplifiedPolygon_workspace", [&] {
+                contour.get_SimplifiedPolygon(polygon, workspace, 1.);
+                sink = sink + polygon.size();
+            });
+            run(options, fixture.name, n, "get_ConvexHull", [&] {
+                sink = sink + contour.get_ConvexHull().size();
+            });
+            run(options, fixture.name, n, "get_HullDescriptors", [&] {
+                sink = sink + contour.get_HullDescriptors().maxFeret;
+            });
+        }
+    }
+
+    // Blobs: the size is the area of the blobs
+    std::vector<int> radii = {8, 64, 256};
+    if (options.quick)
+        radii.resize(2);
+
+    std::vector<std::unique_ptr<BlobFixture> > blobFixtures;
+    for (int radius : radii) {
+        cv::Size size(2 * radius + 8, 2 * radius + 8);
+        std::vector<Disk> disk(1, Disk{radius + 4, radius + 4, radius});
+        blobFixtures.push_back(std::unique_ptr<BlobFixture>(new BlobFixture()));
+        blobFixtures.back()->name = "disk";
+        makeBlobFixture(*blobFixtures.back(), size, disk, 0);
+        blobFixtures.push_back(std::unique_ptr<BlobFixture>(new BlobFixture()));
+        blobFixtures.back()->name = "ring";
+        makeBlobFixture(*blobFixtures.back(), size, disk, radius / 2);
+    }
+    {
+        // A frame of 200 disks of radius 12
+        std::mt19937 rng(11);
+        std::vector<Disk> disks;
+        for (int k = 0; k < 200; k++)
+            disks.push_back(Disk{20 + 40 * (k % 20) + (int)(rng() % 8), 20 + 40 * (k / 20) + (int)(rng() % 8), 12});
+        blobFixtures.push_back(std::unique_ptr<BlobFixture>(new BlobFixture()));
+        blobFixtures.back()->name = "frame";
+        makeBlobFixture(*blobFixtures.back(), cv::Size(840, 420), disks, 0);
+    }
+
+    for (auto &fixture : blobFixtures) {
+        std::list<SharedBlob> blobs = fixture->blobs.get_BlobsList();
+        if (blobs.empty())
+            continue;
+        const Blob &blob = *blobs.front();
+        size_t area = 0;
+        for (auto &a_blob : blobs)
+            area += a_blob->get_Area();
+        cv::Mat imgDest = cv::Mat::zeros(fixture->img.size(), CV_8UC3);
+
+        if (fixture->name == "frame") {
+            run(options, fixture->name, area, "RenderBlobs", [&] {
+                fixture->blobs.RenderBlobs(fixture->img, imgDest);
+            });
+            run(options, fixture->name, area, "RenderBlobs_color", [&] {
+                fixture->blobs.RenderBlobs(fixture->img, imgDest, CV_BLOB_RENDER_COLOR, .5);
+            });
+            continue;
+        }
+
+        run(options, fixture->name, area, "get_MeanColor_labels", [&] {
+            sink = sink + blob.get_MeanColor(fixture->imgLabel, fixture->img)[0];
+        });
+        run(options, fixture->name, area, "get_MeanColor_contours", [&] {
+            sink = sink + blob.get_MeanColor(fixture->img)[0];
+        });
+        run(options, fixture->name, area, "RenderBlob", [&] {
+            blob.RenderBlob(fixture->imgLabel, fixture->img, imgDest);
+        });
+        run(options, fixture->name, area, "RenderBlob_color", [&] {
+            blob.RenderBlob(fixture->imgLabel, fixture->img, imgDest, CV_BLOB_RENDER_COLOR, cv::Scalar(255, 0, 0), .5);
+        });
+    }
+
+    return 0;
+}
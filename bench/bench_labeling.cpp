@@ -0,0 +1,286 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file bench_labeling.cpp
+/// \brief Labelling benchmark: SimpleLabel and LabelImage against cv::connectedComponentsWithStats.
+/// Prints one JSON record per mask family, resolution and engine, with a cross-check of the blobs of each engine
+/// against OpenCV with the same connectivity (area, bounding box and first order moments). Exits with 1 on a mismatch.
+/// Masks with more blobs than labels stop the cvBlob engines early: their throughput is over the rows labelled, and
+/// only their complete blobs are checked, against the components lying entirely in those rows.
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "cvb_blob_list.h"
+#include "bench.h"
+
+using namespace cvb;
+
+namespace {
+    const Label kMaxLabel = std::numeric_limits<Label>::max();
+    const double kPi = std::atan(1) * 4;
+
+    /// \brief Blob signature: bounding box, area and first order moments.
+    typedef std::tuple<int, int, int, int, long long, long long, long long> BlobSignature;
+
+    /// \brief Generates a mask of a given size.
+    typedef std::function<cv::Mat(const cv::Size &)> MaskGenerator;
+
+    /// \brief Mask family.
+    struct Family {
+        std::string name;
+        MaskGenerator generate;
+    };
+
+    cv::Mat noise(const cv::Size &size, unsigned int permille) {
+        std::mt19937 rng(size.width * 31 + size.height + permille);
+        cv::Mat img(size, CV_8UC1);
+        for (int y = 0; y < size.height; y++) {
+            unsigned char *row = img.ptr(y);
+            for (int x = 0; x < size.width; x++)
+                row[x] = rng() % 1000 < permille ? 255 : 0;
+        }
+        return img;
+    }
+
+    cv::Mat spiral(const cv::Size &size) {
+        // One arm, 4 pixels wide, 8 pixels apart
+        const double pitch = 12.;
+        cv::Mat img = cv::Mat::zeros(size, CV_8UC1);
+        double cx = size.width / 2., cy = size.height / 2.;
+        for (int y = 0; y < size.height; y++) {
+            unsigned char *row = img.ptr(y);
+            for (int x = 0; x < size.width; x++) {
+                double dx = x - cx, dy = y - cy;
+                double phase = std::sqrt(dx * dx + dy * dy) - pitch * std::atan2(dy, dx) / (2. * kPi);
+                row[x] = std::fmod(phase + 4. * pitch, pitch) < 4. ? 255 : 0;
+            }
+        }
+        return img;
+    }
+
+    cv::Mat checkerboard(const cv::Size &size, int cell) {
+        cv::Mat img(size, CV_8UC1);
+        for (int y = 0; y < size.height; y++) {
+            unsigned char *row = img.ptr(y);
+            for (int x = 0; x < size.width; x++)
+                row[x] = ((x / cell + y / cell) & 1) ? 255 : 0;
+        }
+        return img;
+    }
+
+    cv::Mat largeBlob(const cv::Size &size) {
+        // An ellipse over most of the image, with a few holes
+        cv::Mat img = cv::Mat::zeros(size, CV_8UC1);
+        double cx = size.width / 2., cy = size.height / 2., ax = .45 * size.width, ay = .45 * size.height;
+        for (int y = 0; y < size.height; y++) {
+            unsigned char *row = img.ptr(y);
+            for (int x = 0; x < size.width; x++) {
+                double u = (x - cx) / ax, v = (y - cy) / ay;
+                bool hole = ((x / 16) % 4 == 1) && ((y / 16) % 4 == 1) && (x % 16) > 4 && (y % 16) > 4;
+                row[x] = (u * u + v * v <= 1. && !hole) ? 255 : 0;
+            }
+        }
+        return img;
+    }
+
+    cv::Mat tinyBlobs(const cv::Size &size) {
+        // 2x2 squares on a 5 pixels grid
+        cv::Mat img(size, CV_8UC1);
+        for (int y = 0; y < size.height; y++) {
+            unsigned char *row = img.ptr(y);
+            for (int x = 0; x < size.width; x++)
+                row[x] = (x % 5 < 2 && y % 5 < 2) ? 255 : 0;
+        }
+        return img;
+    }
+
+    cv::Mat realFrame(const cv::Mat &source, const cv::Size &size) {
+        if (source.empty())
+            return cv::Mat();
+        cv::Mat resized;
+        cv::resize(source, resized, size, 0, 0, cv::INTER_NEAREST);
+        return resized;
+    }
+
+    /// \brief Loads the sample picture of the tests, thresholded as in test/test.cpp.
+    cv::Mat loadRealFrame() {
+#ifdef CVBLOB_TEST_DATA_DIR
+        cv::Mat img = cv::imread(std::string(CVBLOB_TEST_DATA_DIR) + "/test.png", 1);
+        if (!img.empty()) {
+            cv::Mat grey;
+            cv::cvtColor(img, grey, cv::COLOR_BGR2GRAY);
+            cv::threshold(grey, grey, 100, 255, cv::THRESH_BINARY);
+            return grey;
+        }
+#endif
+        std::fprintf(stderr, "test/test.png not found: skipping the real frames\n");
+        return cv::Mat();
+    }
+
+    /// \brief Signatures of the complete blobs.
+    std::multiset<BlobSignature> signatures(const BlobList &blobs) {
+        std::multiset<BlobSignature> result;
+        for (auto &blob : blobs.get_BlobsList()) {
+            if (blob->get_Incomplete())
+                continue;
+            cv::Rect box = blob->get_BoundingBox();
+            long long area = blob->get_Area();
+            cv::Point2d c = blob->get_Centroid();
+            result.insert(BlobSignature(box.x, box.y, box.width, box.height, area,
+                                        std::llround(c.x * area), std::llround(c.y * area)));
+        }
+        return result;
+    }
+
+    /// \brief Signatures of the components lying entirely above a row.
+    std::multiset<BlobSignature> signatures(const cv::Mat &stats, const cv::Mat &centroids, int rows) {
+        std::multiset<BlobSignature> result;
+        for (int i = 1; i < stats.rows; i++) {
+            if (stats.at<int>(i, cv::CC_STAT_TOP) + stats.at<int>(i, cv::CC_STAT_HEIGHT) > rows)
+                continue;
+            long long area = stats.at<int>(i, cv::CC_STAT_AREA);
+            result.insert(BlobSignature(stats.at<int>(i, cv::CC_STAT_LEFT), stats.at<int>(i, cv::CC_STAT_TOP),
+                                        stats.at<int>(i, cv::CC_STAT_WIDTH), stats.at<int>(i, cv::CC_STAT_HEIGHT), area,
+                                        std::llround(centroids.at<double>(i, 0) * area),
+                                        std::llround(centroids.at<double>(i, 1) * area)));
+        }
+        return result;
+    }
+}  // namespace
+
+int main(int argc, char **argv) {
+    bench::Options options = bench::ParseOptions(argc, argv);
+
+    // Hardware counters of the last call, where the library collects statistics and the system allows them
+    if (LabelingStatsEnabled() && !set_PerfCounters(true))
+        std::fprintf(stderr, "hardware counters not available: timings only\n");
+
+    std::vector<cv::Size> sizes;
+    sizes.push_back(cv::Size(320, 240));
+    sizes.push_back(cv::Size(640, 480));
+    if (!options.quick) {
+        sizes.push_back(cv::Size(1280, 720));
+        sizes.push_back(cv::Size(1920, 1080));
+    }
+
+    cv::Mat source = loadRealFrame();
+
+    std::vector<Family> families;
+    for (unsigned int permille : {50u, 200u, 500u})
+        families.push_back({"noise_" + std::to_string(permille / 10), [permille](const cv::Size &s) { return noise(s, permille); }});
+    families.push_back({"spiral", spiral});
+    families.push_back({"checkerboard_1", [](const cv::Size &s) { return checkerboard(s, 1); }});
+    families.push_back({"checkerboard_8", [](const cv::Size &s) { return checkerboard(s, 8); }});
+    families.push_back({"large_blob", largeBlob});
+    families.push_back({"tiny_blobs", tinyBlobs});
+    families.push_back({"real", [&source](const cv::Size &s) { return realFrame(source, s); }});
+
+    bool mismatch = false;
+    for (auto &family : families) {
+        if (!bench::Selected(options, family.name))
+            continue;
+
+        for (auto &size : sizes) {
+            cv::Mat img = family.generate(size);
+            if (img.empty())
+                continue;
+            double foreground = (double)cv::countNonZero(img) / img.total();
+
+            // References, one per connectivity
+            cv::Mat labels, stats[2], centroids[2];
+            int components[2];
+            components[0] = cv::connectedComponentsWithStats(img, labels, stats[0], centroids[0], 4) - 1;
+            components[1] = cv::connectedComponentsWithStats(img, labels, stats[1], centroids[1], 8) - 1;
+
+            // Memory and hardware counters of the last call, for the cvBlob engines when the library collects statistics
+            // Throughput over the rows labelled, all of them unless out of labels
+            auto report = [&](const std::string &engine, int connectivity, double seconds, int rows, size_t blobs,
+                              const std::string &check, const LabelingStats *labeling) {
+                bench::Record record("labeling");
+                record.add("family", family.name).add("width", size.width).add("height", size.height)
+                    .add("foreground", foreground).add("engine", engine).add("connectivity", connectivity)
+                    .add("labelled_rows", rows).add("seconds", seconds)
+                    .add("mpixels_per_second", (double)size.width * rows / seconds / 1e6)
+                    .add("blobs", blobs).add("check", check);
+                if (labeling && LabelingStatsEnabled())
+                    record.add("allocations", labeling->allocations).add("allocated_bytes", labeling->allocatedBytes)
+                        .add("peak_bytes", labeling->peakBytes).add("label_image_bytes", labeling->labelImageBytes)
+                        .add("blob_bytes", labeling->blobBytes).add("contour_bytes", labeling->contourBytes);
+                if (labeling && labeling->perfCalls) {
+                    const std::pair<const char *, const PerfCounters *> stages[] = {
+                        {"scan", &labeling->scanCounters}, {"trace", &labeling->traceCounters}, {"finalize", &labeling->finalizeCounters}
+                    };
+                    for (auto &stage : stages) {
+                        std::string prefix = std::string(stage.first) + "_";
+                        record.add(prefix + "cycles", stage.second->cycles).add(prefix + "instructions", stage.second->instructions)
+                            .add(prefix + "branch_misses", stage.second->branchMisses).add(prefix + "llc_misses", stage.second->cacheMisses);
+                    }
+                }
+                record.Print();
+            };
+
+            BlobList blobs;
+            for (int engine = 0; engine < 2; engine++) {
+                // SimpleLabel follows runs vertically only, LabelImage also diagonally
+                int k = engine;
+                double seconds = bench::Measure(options, [&] {
+                    if (engine == 0)
+                        blobs.SimpleLabel(img, kMaxLabel);
+                    else
+                        blobs.LabelImage(img, kMaxLabel);
+                });
+
+                // Out of labels, the components lying entirely in the labelled rows are complete, but for the
+                // last one with SimpleLabel: its runs may go on in the next row
+                int rows = blobs.get_LabelledRows();
+                int completeRows = engine == 0 && blobs.get_Truncated() ? rows - 1 : rows;
+                std::string check;
+                if (signatures(blobs) != signatures(stats[k], centroids[k], completeRows)) {
+                    check = "mismatch";
+                    mismatch = true;
+                }
+                else
+                    check = blobs.get_Truncated() ? "truncated" : "ok";
+                report(engine == 0 ? "SimpleLabel" : "LabelImage", k ? 8 : 4, seconds, rows, blobs.get_BlobsList().size(),
+                       check, &blobs.get_LabelingStats());
+            }
+
+            double seconds = bench::Measure(options, [&] {
+                cv::connectedComponentsWithStats(img, labels, stats[1], centroids[1], 8);
+            });
+            report("connectedComponentsWithStats", 8, seconds, size.height, components[1], "reference", nullptr);
+        }
+    }
+
+    return mismatch ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+/// \file bench_pipeline.cpp
+/// \brief Video pipeline benchmark: a serial loop, as in test_tracking.cpp, against Pipeline, on synthetic scenes.
+/// Both capture pre-rendered color frames, threshold a channel, label, filter, track and render. Prints one JSON
+/// record per scene and mode, with the throughput and the p50/p99 latencies of each stage and of a whole frame.
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "cvb_pipeline.h"
+#include "bench.h"
+#include "scene.h"
+
+using namespace cvb;
+
+namespace {
+    const char *const stageKeys[PipelineStage_count] = { "capture", "threshold", "label", "track", "render" };
+
+    /// \brief Adds latency statistics to a record, in microseconds.
+    void addLatency(bench::Record &record, const std::string &key, const LatencyStats &stats) {
+        record.add(key + "_p50_us", stats.p50 * 1e6);
+        record.add(key + "_p99_us", stats.p99 * 1e6);
+    }
+}  // namespace
+
+int main(int argc, char **argv) {
+    bench::Options options = bench::ParseOptions(argc, argv);
+
+    std::vector<double> pixelsPerObject = {2500., 20000.};
+    if (options.quick)
+        pixelsPerObject.resize(1);
+    const size_t frameCount = options.quick ? 30 : 300;
+
+    for (double density : pixelsPerObject) {
+        bench::SceneSettings sceneSettings;
+        sceneSettings.pixelsPerObject = density;
+        sceneSettings.objectSize = 12;
+        bench::Scene scene(sceneSettings);
+
+        // Frames are rendered beforehand: the capture stage only copies them
+        std::vector<cv::Mat> video(frameCount);
+        cv::Mat mask;
+        for (auto &frame : video) {
+            scene.RenderMask(mask);
+            std::vector<cv::Mat> channels(3, mask);
+            cv::merge(channels, frame);
+            scene.Step();
+        }
+        std::string size = std::to_string(scene.get_Size().width) + "x" + std::to_string(scene.get_Size().height);
+
+        PipelineSettings settings;
+        settings.minArea = 10;
+        settings.thDistance = sceneSettings.objectSize / 2.;
+        settings.thInactive = sceneSettings.occlusionFrames + 2;
+
+        for (int pipelined = 0; pipelined < 2; pipelined++) {
+            std::string name = std::string(pipelined ? "pipeline_" : "serial_") + size;
+            if (!bench::Selected(options, name))
+                continue;
+
+            LatencyStats stages[PipelineStage_count];
+            LatencyStats total;
+            double fps = 0.;
+            if (pipelined) {
+                Pipeline pipeline(settings);
+                size_t next = 0;
+                pipeline.Run([&](cv::Mat &image) {
+                    if (next == video.size())
+                        return false;
+                    video[next++].copyTo(image);
+                    return true;
+                });
+                for (int stage = 0; stage < PipelineStage_count; stage++)
+                    stages[stage] = pipeline.get_Latency((PipelineStage)stage);
+                total = pipeline.get_EndToEndLatency();
+                fps = pipeline.get_FramesPerSecond();
+            }
+            else {
+                // One thread, the stages one after the other, with the same recycled buffers as a pipeline frame
+                LatencyHistogram histograms[PipelineStage_count], frameHistogram;
+                PipelineFrame frame;
+                TrackList tracks;
+                bench::Clock::time_point start = bench::Clock::now();
+                for (size_t i = 0; i < video.size(); i++) {
+                    bench::Clock::time_point t[PipelineStage_count + 1];
+                    t[0] = bench::Clock::now();
+                    video[i].copyTo(frame.image);
+                    t[1] = bench::Clock::now();
+                    cv::extractChannel(frame.image, frame.binary, settings.channel);
+                    cv::threshold(frame.binary, frame.binary, settings.threshold, 255., cv::THRESH_BINARY);
+                    t[2] = bench::Clock::now();
+                    frame.blobs.LabelImage(frame.binary, settings.maxLabel);
+                    frame.blobs.FilterByArea(settings.minArea, settings.maxArea);
+                    t[3] = bench::Clock::now();
+                    tracks.UpdateTracks(frame.blobs, settings.thDistance, settings.thInactive, settings.thActive);
+                    t[4] = bench::Clock::now();
+                    frame.image.copyTo(frame.rendered);
+                    frame.blobs.RenderBlobs(frame.rendered, frame.rendered, settings.blobRenderMode);
+                    tracks.RenderTracks(frame.rendered, frame.rendered, settings.trackRenderMode);
+                    t[5] = bench::Clock::now();
+                    for (int stage = 0; stage < PipelineStage_count; stage++)
+                        histograms[stage].add_Sample(std::chrono::duration_cast<std::chrono::nanoseconds>(t[stage + 1] - t[stage]).count());
+                    frameHistogram.add_Sample(std::chrono::duration_cast<std::chrono::nanoseconds>(t[5] - t[0]).count());
+                }
+                fps = video.size() / std::chrono::duration<double>(bench::Clock::now() - start).count();
+                for (int stage = 0; stage < PipelineStage_count; stage++)
+                    stages[stage] = histograms[stage].get_Stats();
+                total = frameHistogram.get_Stats();
+            }
+
+            bench::Record record("pipeline");
+            record.add("mode", pipelined ? "pipeline" : "serial")
+                  .add("size", size)
+                  .add("frames", video.size())
+                  .add("cores", std::thread::hardware_concurrency())
+                  .add("fps", fps);
+            for (int stage = 0; stage < PipelineStage_count; stage++)
+                addLatency(record, stageKeys[stage], stages[stage]);
+            addLatency(record, "frame", total);
+            record.Print();
+        }
+    }
+
+    return 0;
+}
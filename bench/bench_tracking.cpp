@@ -0,0 +1,334 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file bench_tracking.cpp
+/// \brief Tracking scalability benchmark: TrackList::UpdateTracks on synthetic scenes of 10 to 100000 objects.
+/// Blobs come straight from the scene generator, except for small scenes also run through rendered masks and
+/// LabelImage. Prints one JSON record per scene size, association mode and source, with the update time per frame,
+/// the allocations and memory of the tracker, and the number of identity switches.
+/// With --check, round trips tracker snapshots and trajectory stores instead, and exits with 1 on a failure.
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "cvb_track.h"
+#include "bench.h"
+#include "bench_alloc.h"
+#include "scene.h"
+
+using namespace cvb;
+
+namespace {
+    /// \brief Key of a bounding box, for matching tracks with the blobs they were updated with.
+    unsigned long long boxKey(const cv::Rect &box) {
+        return ((unsigned long long)(box.x & 0xffff) << 48) | ((unsigned long long)(box.y & 0xffff) << 32) |
+               ((unsigned long long)(box.width & 0xffff) << 16) | (unsigned long long)(box.height & 0xffff);
+    }
+
+    double percentile(std::vector<double> values, double p) {
+        if (values.empty())
+            return 0.;
+        size_t k = std::min(values.size() - 1, (size_t)(p * values.size()));
+        std::nth_element(values.begin(), values.begin() + k, values.end());
+        return values[k];
+    }
+
+    /// \brief Whether two trackers have the same tracks, motion included.
+    bool sameTracks(const TrackList &a, const TrackList &b) {
+        const TracksMap &ta = a.get_Tracks();
+        const TracksMap &tb = b.get_Tracks();
+        if (ta.size() != tb.size())
+            return false;
+        for (auto i = ta.begin(), j = tb.begin(); i != ta.end(); ++i, ++j) {
+            const Track &x = *i->second;
+            const Track &y = *j->second;
+            if (i->first != j->first || x.get_ID() != y.get_ID() || x.get_Label() != y.get_Label() ||
+                x.get_BoundingBox() != y.get_BoundingBox() || x.get_Centroid() != y.get_Centroid() ||
+                x.get_Velocity() != y.get_Velocity() || x.get_PredictionDeviation() != y.get_PredictionDeviation() ||
+                x.get_PredictedCentroid() != y.get_PredictedCentroid() || x.get_Measured() != y.get_Measured() ||
+                x.get_Innovation() != y.get_Innovation() || x.get_Lifetime() != y.get_Lifetime() ||
+                x.get_Active() != y.get_Active() || x.get_Inactive() != y.get_Inactive())
+                return false;
+        }
+        return true;
+    }
+
+    /// \brief Whether two trajectory stores hold the same trajectories for the given tracks, and the same finished ones.
+    bool sameTrajectories(const TrajectoryStore &a, const TrajectoryStore &b, const TracksMap &tracks) {
+        if (a.get_Capacity() != b.get_Capacity() || a.get_Size() != b.get_Size() || a.get_Finished() != b.get_Finished())
+            return false;
+        std::vector<TrajectoryPoint> pa, pb;
+        for (auto &a_track : tracks) {
+            a.get_Points(a_track.first, pa);
+            b.get_Points(a_track.first, pb);
+            if (pa.size() != pb.size())
+                return false;
+            for (size_t k = 0; k < pa.size(); k++)
+                if (pa[k].frame != pb[k].frame || pa[k].x != pb[k].x || pa[k].y != pb[k].y)
+                    return false;
+        }
+        return true;
+    }
+
+    /// \brief Prints the result of a check.
+    /// \return Whether the check passed.
+    bool report(const std::string &name, bool ok) {
+        bench::Record("tracking_check").add("case", name).add("ok", ok).Print();
+        return ok;
+    }
+
+    /// \brief Checks TrackList::Snapshot and Restore, and TrajectoryStore::Write, Read and the encoded trajectories:
+    /// round trips of a tracker populated on a synthetic scene, then truncated and corrupted snapshots.
+    /// \return True if all the checks passed.
+    bool runChecks(const bench::Options &options) {
+        bench::SceneSettings settings;
+        settings.objects = options.quick ? 20 : 200;
+        bench::Scene scene(settings);
+        double thDistance = settings.objectSize / 2.;
+        unsigned int thInactive = settings.occlusionFrames + 2;
+        // Short trajectories, so that their ring buffers wrap
+        const size_t capacity = 16;
+
+        bench::SceneBlobs sceneBlobs;
+        std::vector<long long> truth;
+        TrackList tl;
+        tl.set_Trajectories(true, capacity);
+        for (int f = 0; f < 60; f++) {
+            scene.Step();
+            scene.EmitBlobs(sceneBlobs, truth);
+            tl.UpdateTracks(sceneBlobs, thDistance, thInactive);
+        }
+        bool ok = report("populated", !tl.get_Tracks().empty() && tl.get_Trajectories().get_Size() > 0 &&
+                                          !tl.get_Trajectories().get_Finished().empty());
+
+        // Tracker round trip, then the same updates on both trackers
+        std::vector<unsigned char> snapshot;
+        tl.Snapshot(snapshot);
+        TrackList restored;
+        restored.set_Trajectories(true);
+        bool restoredOk = restored.Restore(snapshot.data(), snapshot.size()) && sameTracks(tl, restored) &&
+                          sameTrajectories(tl.get_Trajectories(), restored.get_Trajectories(), tl.get_Tracks());
+        for (int f = 0; f < 20 && restoredOk; f++) {
+            scene.Step();
+            scene.EmitBlobs(sceneBlobs, truth);
+            tl.UpdateTracks(sceneBlobs, thDistance, thInactive);
+            restored.UpdateTracks(sceneBlobs, thDistance, thInactive);
+            restoredOk = sameTracks(tl, restored) &&
+                         sameTrajectories(tl.get_Trajectories(), restored.get_Trajectories(), tl.get_Tracks());
+        }
+        ok &= report("tracker_round_trip", restoredOk);
+
+        // Trajectory store round trip, and decoding of the finished trajectories
+        const TrajectoryStore &store = tl.get_Trajectories();
+        std::vector<unsigned char> written;
+        store.Write(written);
+        TrajectoryStore read;
+        const unsigned char *position = written.data();
+        ok &= report("store_round_trip", read.Read(position, written.data() + written.size()) &&
+                                             position == written.data() + written.size() &&
+                                             sameTrajectories(store, read, tl.get_Tracks()));
+
+        const std::vector<unsigned char> &finished = store.get_Finished();
+        std::vector<Trajectory> decoded;
+        bool decodedOk = DecodeTrajectories(finished.data(), finished.size(), decoded) == finished.size() && !decoded.empty();
+        for (auto &a_trajectory : decoded) {
+            decodedOk &= !a_trajectory.points.empty() && a_trajectory.points.size() <= capacity &&
+                         !tl.get_Tracks().count(a_trajectory.id);
+            for (size_t k = 1; k < a_trajectory.points.size(); k++)
+                decodedOk &= a_trajectory.points[k].frame > a_trajectory.points[k - 1].frame;
+        }
+        ok &= report("decoded_trajectories", decodedOk);
+
+        // Malformed snapshots are rejected and leave the tracker unchanged
+        tl.Snapshot(snapshot);
+        std::vector<unsigned char> before, after;
+        restored.Snapshot(before);
+        std::vector<size_t> lengths;
+        size_t stride = std::max<size_t>(1, snapshot.size() / 4096);
+        for (size_t length = 0; length < snapshot.size(); length += length < 512 ? 1 : stride)
+            lengths.push_back(length);
+        for (size_t length = snapshot.size() - std::min<size_t>(snapshot.size(), 512); length < snapshot.size(); length++)
+            lengths.push_back(length);
+        bool truncatedOk = true;
+        for (size_t length : lengths) {
+            truncatedOk &= !restored.Restore(snapshot.data(), length);
+            restored.Snapshot(after);
+            truncatedOk &= after == before;
+        }
+        ok &= report("tracker_truncated", truncatedOk);
+
+        // Magic, version, last id under the track ids, track count, trailing byte
+        std::vector<std::vector<unsigned char> > corrupted(5, snapshot);
+        corrupted[0][0] ^= 0xff;
+        corrupted[1][4] ^= 0xff;
+        std::fill(corrupted[2].begin() + 8, corrupted[2].begin() + 12, (unsigned char)0);
+        std::fill(corrupted[3].begin() + 16, corrupted[3].begin() + 24, (unsigned char)0xff);
+        corrupted[4].push_back(0);
+        bool corruptedOk = true;
+        for (auto &a_snapshot : corrupted) {
+            corruptedOk &= !restored.Restore(a_snapshot.data(), a_snapshot.size());
+            restored.Snapshot(after);
+            corruptedOk &= after == before;
+        }
+        ok &= report("tracker_corrupted", corruptedOk);
+
+        // Malformed stores are rejected and cleared
+        bool storeOk = true;
+        for (size_t length = 0; length < written.size(); length += length < 512 ? 1 : stride) {
+            TrajectoryStore partial;
+            position = written.data();
+            storeOk &= !partial.Read(position, written.data() + length) && partial.get_Size() == 0 &&
+                       partial.get_Finished().empty();
+        }
+        std::vector<unsigned char> oversized(written);
+        // Capacity
+        std::fill(oversized.begin(), oversized.begin() + 8, (unsigned char)0xff);
+        position = oversized.data();
+        storeOk &= !read.Read(position, oversized.data() + oversized.size()) && read.get_Size() == 0 &&
+                   read.get_Finished().empty();
+        ok &= report("store_malformed", storeOk);
+
+        return ok;
+    }
+}  // namespace
+
+int main(int argc, char **argv) {
+    bench::Options options = bench::ParseOptions(argc, argv, true);
+    if (options.check)
+        return runChecks(options) ? 0 : 1;
+
+    std::vector<size_t> counts = {10, 100, 1000, 10000, 100000};
+    if (options.quick)
+        counts.resize(3);
+    const int frames = options.quick ? 20 : 100;
+
+    for (size_t count : counts) {
+        for (int mode = 0; mode < 2; mode++) {
+            for (int masks = 0; masks < 2; masks++) {
+                // Labels are 8 bits: rendered masks only for scenes with few blobs
+                if (masks && count > 100)
+                    continue;
+
+                std::string name = std::string(mode ? "optimal" : "greedy") + (masks ? "_masks" : "_blobs");
+                if (!bench::Selected(options, name))
+                    continue;
+
+                bench::SceneSettings settings;
+                settings.objects = count;
+                bench::Scene scene(settings);
+                double thDistance = settings.objectSize / 2.;
+                unsigned int thInactive = settings.occlusionFrames + 2;
+
+                bench::SceneBlobs sceneBlobs;
+                BlobList labelled;
+                std::vector<long long> truth;
+                cv::Mat mask;
+
+                std::vector<double> seconds;
+                size_t allocations = 0, peakBytes = 0, trackerBytes = 0, tracks = 0;
+                size_t switches = 0, matched = 0, visible = 0;
+                {
+                    bench::AllocationStats start = bench::get_AllocationStats();
+                    TrackList tl;
+                    tl.set_AssociationMode(mode ? AssociationMode_optimal : AssociationMode_greedy);
+
+                    // Last track of each object seen alone in a blob
+                    std::unordered_map<long long, TrackID> lastTrack;
+                    std::unordered_map<unsigned long long, long long> objectByBox;
+
+                    for (int f = 0; f < frames; f++) {
+                        scene.Step();
+                        scene.EmitBlobs(sceneBlobs, truth);
+                        const BlobList *blobs = &sceneBlobs;
+                        if (masks) {
+                            scene.RenderMask(mask);
+                            labelled.LabelImage(mask, std::numeric_limits<Label>::max());
+                            blobs = &labelled;
+                        }
+
+                        bench::AllocationStats before = bench::get_AllocationStats();
+                        bench::ResetPeak();
+                        bench::Clock::time_point t0 = bench::Clock::now();
+                        tl.UpdateTracks(*blobs, thDistance, thInactive);
+                        seconds.push_back(std::chrono::duration<double>(bench::Clock::now() - t0).count());
+                        bench::AllocationStats after = bench::get_AllocationStats();
+                        allocations += after.allocations - before.allocations;
+                        peakBytes = std::max(peakBytes, after.peakBytes - before.liveBytes);
+
+                        // Identity switches, on the objects alone in their blob
+                        objectByBox.clear();
+                        auto blobList = sceneBlobs.get_BlobsList();
+                        size_t k = 0;
+                        for (auto &blob : blobList) {
+                            if (truth[k] >= 0)
+                                objectByBox[boxKey(blob->get_BoundingBox())] = truth[k];
+                            k++;
+                        }
+                        visible += objectByBox.size();
+                        for (auto &a_track : tl.get_Tracks()) {
+                            const Track &track = *a_track.second;
+                            if (!track.get_Measured())
+                                continue;
+                            auto object = objectByBox.find(boxKey(track.get_BoundingBox()));
+                            if (object == objectByBox.end())
+                                continue;
+                            matched++;
+                            auto last = lastTrack.find(object->second);
+                            if (last == lastTrack.end())
+                                lastTrack[object->second] = track.get_ID();
+                            else if (last->second != track.get_ID()) {
+                                switches++;
+                                last->second = track.get_ID();
+                            }
+                        }
+                    }
+                    tracks = tl.get_Tracks().size();
+
+                    sceneBlobs.clear();
+                    labelled = BlobList();
+                    objectByBox = std::unordered_map<unsigned long long, long long>();
+                    lastTrack = std::unordered_map<long long, TrackID>();
+                    bench::AllocationStats end = bench::get_AllocationStats();
+                    trackerBytes = end.liveBytes - start.liveBytes;
+                }
+
+                double total = 0.;
+                for (double s : seconds)
+                    total += s;
+
+                bench::Record("tracking").add("objects", count).add("mode", mode ? "optimal" : "greedy")
+                    .add("source", masks ? "masks" : "blobs").add("frames", frames)
+                    .add("objects_final", scene.get_ObjectCount()).add("tracks", tracks)
+                    .add("update_seconds_mean", total / frames).add("update_seconds_median", percentile(seconds, .5))
+                    .add("update_seconds_p95", percentile(seconds, .95)).add("update_seconds_max", percentile(seconds, 1.))
+                    .add("allocations_per_frame", (double)allocations / frames).add("peak_bytes", peakBytes)
+                    .add("tracker_bytes", trackerBytes).add("matched", matched).add("visible", visible)
+                    .add("id_switches", switches).add("id_switches_per_1000", matched ? 1000. * switches / matched : 0.).Print();
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include "scene.h"
+
+using namespace cvb;
+using namespace bench;
+
+namespace {
+    const double kPi = std::atan(1) * 4;
+
+    size_t findRoot(std::vector<size_t> &parents, size_t i) {
+        while (parents[i] != i) {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    }
+}  // namespace
+
+void SceneBlobs::clear() {
+    blobs.clear();
+}
+
+void SceneBlobs::add_Blob(const SharedBlob &blob) {
+    blobs.push_back(blob);
+}
+
+SceneSettings::SceneSettings() : objects(100), pixelsPerObject(2500.), objectSize(6), speed(2.), crossings(.2),
+    occlusionRate(.01), occlusionFrames(5), birthRate(.002), deathRate(.002), seed(42) {}
+
+Scene::Scene(const SceneSettings &settings) : settings(settings), next_id(0), rng(settings.seed) {
+    int side = (int)std::ceil(std::sqrt(std::max((size_t)1, settings.objects) * settings.pixelsPerObject));
+    side = std::max(side, 4 * settings.objectSize);
+    size = cv::Size(side, side);
+
+    while (objects.size() < settings.objects)
+        Spawn();
+}
+
+void Scene::Spawn() {
+    std::uniform_real_distribution<double> unit(0., 1.);
+    double angle = 2. * kPi * unit(rng);
+    cv::Point2d direction(std::cos(angle), std::sin(angle));
+    double maxX = size.width - settings.objectSize, maxY = size.height - settings.objectSize;
+
+    Object object;
+    object.hidden = 0;
+
+    // A pair is two objects: pairs are drawn so that the fraction of paired objects is the crossings setting
+    if (unit(rng) < settings.crossings / (2. - settings.crossings)) {
+        // Two objects heading for the same point, from opposite sides
+        double frames = 5. + 25. * unit(rng);
+        cv::Point2d offset = direction * (settings.speed * frames);
+        double spanX = maxX - 2. * std::abs(offset.x), spanY = maxY - 2. * std::abs(offset.y);
+        if (spanX > 0. && spanY > 0.) {
+            cv::Point2d meeting(std::abs(offset.x) + spanX * unit(rng), std::abs(offset.y) + spanY * unit(rng));
+
+            object.id = next_id++;
+            object.position = meeting - offset;
+            object.velocity = direction * settings.speed;
+            objects.push_back(object);
+
+            object.id = next_id++;
+            object.position = meeting + offset;
+            object.velocity = -direction * settings.speed;
+            objects.push_back(object);
+            return;
+        }
+    }
+
+    object.id = next_id++;
+    object.position = cv::Point2d(maxX * unit(rng), maxY * unit(rng));
+    object.velocity = direction * settings.speed;
+    objects.push_back(object);
+}
+
+void Scene::Step() {
+    std::uniform_real_distribution<double> unit(0., 1.);
+    double maxX = size.width - settings.objectSize, maxY = size.height - settings.objectSize;
+
+    size_t n = 0;
+    for (auto &object : objects) {
+        if (unit(rng) < settings.deathRate)
+            continue;
+
+        object.position += object.velocity;
+        if (object.position.x < 0. || object.position.x > maxX) {
+            object.velocity.x = -object.velocity.x;
+            object.position.x = std::max(0., std::min(maxX, object.position.x));
+        }
+        if (object.position.y < 0. || object.position.y > maxY) {
+            object.velocity.y = -object.velocity.y;
+            object.position.y = std::max(0., std::min(maxY, object.position.y));
+        }
+
+        if (object.hidden)
+            object.hidden--;
+        else if (unit(rng) < settings.occlusionRate)
+            object.hidden = settings.occlusionFrames;
+
+        objects[n++] = object;
+    }
+    objects.resize(n);
+
+    std::poisson_distribution<int> births(settings.birthRate * settings.objects);
+    for (int k = births(rng); k > 0; k--)
+        Spawn();
+}
+
+cv::Rect Scene::get_Box(const Object &object) const {
+    return cv::Rect((int)std::floor(object.position.x + .5), (int)std::floor(object.position.y + .5),
+                    settings.objectSize, settings.objectSize);
+}
+
+void Scene::EmitBlobs(SceneBlobs &blobs, std::vector<long long> &truth) {
+    blobs.clear();
+    truth.clear();
+
+    // Overlapping visible objects are grouped, on a grid of cells larger than the objects
+    int cellSize = 2 * settings.objectSize;
+    int columns = size.width / cellSize + 1, rows = size.height / cellSize + 1;
+    cells.resize((size_t)columns * rows);
+    for (auto &cell : cells)
+        cell.clear();
+
+    parents.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        parents[i] = i;
+        if (objects[i].hidden)
+            continue;
+
+        cv::Rect box = get_Box(objects[i]);
+        int cx = box.x / cellSize, cy = box.y / cellSize;
+        for (int y = std::max(0, cy - 1); y <= std::min(rows - 1, cy + 1); y++) {
+            for (int x = std::max(0, cx - 1); x <= std::min(columns - 1, cx + 1); x++) {
+                for (size_t j : cells[(size_t)y * columns + x]) {
+                    // Touching squares are connected too
+                    cv::Rect other = get_Box(objects[j]);
+                    cv::Rect grown(other.x - 1, other.y - 1, other.width + 2, other.height + 2);
+                    if ((box & grown).area() > 0)
+                        parents[findRoot(parents, i)] = findRoot(parents, j);
+                }
+            }
+        }
+        cells[(size_t)cy * columns + cx].push_back(i);
+    }
+
+    std::map<size_t, std::vector<size_t> > groups;
+    for (size_t i = 0; i < objects.size(); i++)
+        if (!objects[i].hidden)
+            groups[findRoot(parents, i)].push_back(i);
+
+    Label label = 0;
+    std::vector<std::pair<int, int> > spans;
+    for (auto &group : groups) {
+        cv::Rect bounds = get_Box(objects[group.second.front()]);
+        for (size_t i : group.second)
+            bounds |= get_Box(objects[i]);
+
+        // Union of the rows of the squares
+        SharedBlob blob;
+        label = (Label)(label % std::numeric_limits<Label>::max() + 1);
+        for (int y = bounds.y; y < bounds.y + bounds.height; y++) {
+            spans.clear();
+            for (size_t i : group.second) {
+                cv::Rect box = get_Box(objects[i]);
+                if (y >= box.y && y < box.y + box.height)
+                    spans.push_back(std::make_pair(box.x, box.x + box.width - 1));
+            }
+            std::sort(spans.begin(), spans.end());
+            for (size_t k = 0; k < spans.size(); ) {
+                int x0 = spans[k].first, x1 = spans[k].second;
+                for (k++; k < spans.size() && spans[k].first <= x1 + 1; k++)
+                    x1 = std::max(x1, spans[k].second);
+                if (!blob)
+                    blob = SharedBlob(new Blob(x0, x1, y, label));
+                else
+                    blob->add_Moment(x0, x1, y);
+            }
+        }
+        blob->ComputeMoments();
+        blobs.add_Blob(blob);
+        truth.push_back(group.second.size() == 1 ? objects[group.second.front()].id : -1);
+    }
+}
+
+void Scene::RenderMask(cv::Mat &mask) const {
+    mask = cv::Mat::zeros(size, CV_8UC1);
+    for (auto &object : objects) {
+        if (object.hidden)
+            continue;
+        cv::Rect box = get_Box(object);
+        mask(box).setTo(cv::Scalar(255));
+    }
+}
+
+cv::Size Scene::get_Size() const {
+    return size;
+}
+
+size_t Scene::get_ObjectCount() const {
+    return objects.size();
+}
@@ -0,0 +1,123 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file scene.h
+/// \brief Synthetic moving-object scenes for the benchmarks.
+
+#ifndef _CVBLOB_BENCH_SCENE_H_
+#define _CVBLOB_BENCH_SCENE_H_
+
+#include <random>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "cvb_blob_list.h"
+
+namespace bench {
+
+    /// \brief Blob list filled directly, without labelling an image.
+    class SceneBlobs : public cvb::BlobList {
+    public:
+        /// \brief Removes all the blobs.
+        void clear();
+
+        /// \brief Adds a blob.
+        /// \param blob The blob, with its moments computed.
+        void add_Blob(const cvb::SharedBlob &blob);
+    };
+
+    /// \brief Parameters of a scene.
+    /// The scene is a square sized for the number of objects, keeping the same density whatever this number.
+    struct SceneSettings {
+        SceneSettings(); ///< Default settings.
+
+        size_t objects;               ///< Initial number of objects.
+        double pixelsPerObject;       ///< Scene area per initial object.
+        int objectSize;               ///< Side of the square objects, in pixels.
+        double speed;                 ///< Speed of the objects, in pixels per frame.
+        double crossings;             ///< Fraction of the objects created in pairs, on paths crossing within 30 frames.
+        double occlusionRate;         ///< Probability for a visible object to become hidden, per frame.
+        unsigned int occlusionFrames; ///< Number of frames an occlusion lasts.
+        double birthRate;             ///< Mean number of new objects per frame, as a fraction of the initial number.
+        double deathRate;             ///< Probability for an object to leave the scene, per frame.
+        unsigned int seed;            ///< Random seed: scenes are deterministic.
+    };
+
+    /// \brief Scene of square objects moving in straight lines and bouncing on the borders.
+    /// Frames are either rendered as masks or given directly as blobs. Visible objects overlapping each other make
+    /// one blob, as they would in a mask; the ground truth tells which object each blob comes from.
+    class Scene {
+    public:
+        /// \brief Constructor, creating the initial objects.
+        /// \param settings Parameters.
+        explicit Scene(const SceneSettings &settings);
+
+        /// \brief Moves to the next frame: motion, occlusions, births and deaths.
+        void Step();
+
+        /// \brief Gets the visible objects as blobs.
+        /// \param blobs Output blobs.
+        /// \param truth Output ground truth: for each blob, in the order of the blobs list, the identification number
+        /// of its object, or -1 if it is made of several objects.
+        void EmitBlobs(SceneBlobs &blobs, std::vector<long long> &truth);
+
+        /// \brief Draws the visible objects.
+        /// \param mask Output mask (type = CV_8UC1), of the scene size.
+        void RenderMask(cv::Mat &mask) const;
+
+        /// \brief Gets the scene size.
+        /// \return The size, in pixels.
+        cv::Size get_Size() const;
+
+        /// \brief Gets the number of objects in the scene, visible or not.
+        /// \return The number of objects.
+        size_t get_ObjectCount() const;
+
+    protected:
+        /// \brief Moving object.
+        struct Object {
+            long long id;          ///< Identification number.
+            cv::Point2d position;  ///< Top-left corner.
+            cv::Point2d velocity;  ///< Velocity, in pixels per frame.
+            unsigned int hidden;   ///< Frames left hidden.
+        };
+
+        /// \brief Adds one object, or a pair on crossing paths.
+        void Spawn();
+
+        /// \brief Gets the pixels of an object.
+        cv::Rect get_Box(const Object &object) const;
+
+        SceneSettings settings;       ///< Parameters.
+        cv::Size size;                ///< Scene size.
+        std::vector<Object> objects;  ///< Objects in the scene.
+        long long next_id;            ///< Next identification number.
+        std::mt19937 rng;             ///< Random generator.
+
+        std::vector<size_t> parents;  ///< Union-find of the overlapping objects (EmitBlobs workspace).
+        std::vector<std::vector<size_t> > cells; ///< Objects by grid cell (EmitBlobs workspace).
+    };
+
+} // Namespace
+
+#endif // _CVBLOB_BENCH_SCENE_H_
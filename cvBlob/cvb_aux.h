@@ -33,6 +33,9 @@
 #ifndef _CVBLOB_AUX_H_
 #define _CVBLOB_AUX_H_
 
+#include <cstring>
+#include <vector>
+
 #include <opencv2/core/core.hpp>
 
 #include "cvb_defines.h"
@@ -67,6 +70,28 @@ namespace cvb {
     /// \return Distance between ab and c.
     CVBLOB_EXPORT double DistanceLinePoint(const cv::Point &a, const cv::Point &b, const cv::Point &c, bool isSegment=true);
 
+    /// \brief Appends the bytes of a value to a buffer, in native byte order.
+    /// \param data Buffer.
+    /// \param value Value, of a trivially copyable type.
+    template <typename T> inline void AppendBytes(std::vector<unsigned char> &data, const T &value) {
+        size_t size = data.size();
+        data.resize(size + sizeof(T));
+        std::memcpy(&data[size], &value, sizeof(T));
+    }
+
+    /// \brief Reads a value written by AppendBytes.
+    /// \param data Read position, moved past the value.
+    /// \param end End of the buffer.
+    /// \param value Output value.
+    /// \return False, without moving the read position, if the buffer is too short.
+    template <typename T> inline bool ReadBytes(const unsigned char *&data, const unsigned char *end, T &value) {
+        if ((size_t)(end - data) < sizeof(T))
+            return false;
+        std::memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        return true;
+    }
+
 } // Namespace
 
 #endif // _CVBLOB_AUX_H_
\ No newline at end of file
@@ -29,6 +29,19 @@
 
 using namespace cvb;
 
+namespace {
+    /// \brief Sum of x^2 for x from 0 to n.
+    inline double sumSquares(double n) {
+        return n * (n + 1.) * (2. * n + 1.) / 6.;
+    }
+
+    /// \brief Sum of x^3 for x from 0 to n.
+    inline double sumCubes(double n) {
+        double s = n * (n + 1.) / 2.;
+        return s * s;
+    }
+}  // namespace
+
 Blob::Blob(cv::Point point, Label label) {
     this->label = label;
     this->m00 = 1;
@@ -41,7 +54,12 @@ Blob::Blob(cv::Point point, Label label) {
     this->m11 = point.x * point.y;
     this->m20 = point.x * point.x;
     this->m02 = point.y * point.y;
+    this->m30 = (double)point.x * point.x * point.x;
+    this->m21 = (double)point.x * point.x * point.y;
+    this->m12 = (double)point.x * point.y * point.y;
+    this->m03 = (double)point.y * point.y * point.y;
     this->contour = Contour(point);
+    this->incomplete = false;
 }
 
 Blob::Blob(unsigned int min_x, unsigned int max_x, unsigned int y, Label label) {
@@ -60,16 +78,17 @@ Blob::Blob(unsigned int min_x, unsigned int max_x, unsigned int y, Label label)
     this->m11 = y * x_sum;
     this->m02 = y * y * n;
 
-    double sum_min_sq; // sum of squares from 1 to (min_x - 1)
-    if (min_x == 0)
-        sum_min_sq = 0;
-    else
-        sum_min_sq = (min_x - 1.) * (min_x) * (2. * (min_x - 1.) + 1.) / 6.;
-    double sum_max_sq = max_x * (max_x + 1.) * (2. * max_x + 1.) / 6.; // sum of squares from 1 to max_x
-    this->m20 = sum_max_sq - sum_min_sq; // sum of squares from min_x to max_x
+    double x2_sum = sumSquares(max_x) - sumSquares(min_x - 1.); // Sum of squares from min_x to max_x
+    this->m20 = x2_sum;
+
+    this->m30 = sumCubes(max_x) - sumCubes(min_x - 1.);
+    this->m21 = y * x2_sum;
+    this->m12 = (double)y * y * x_sum;
+    this->m03 = (double)y * y * y * n;
+    this->incomplete = false;
 }
 
-Contour Blob::get_Contour() const {
+const Contour &Blob::get_Contour() const {
     return this->contour;
 }
 
@@ -97,6 +116,14 @@ cv::Rect Blob::get_BoundingBox() const {
     return cv::Rect(minx, miny, maxx - minx + 1, maxy - miny + 1);
 }
 
+bool Blob::get_Incomplete() const {
+    return incomplete;
+}
+
+void Blob::set_Incomplete(bool incomplete) {
+    this->incomplete = incomplete;
+}
+
 void Blob::add_ChainCode(ChainCode chainCode) {
     this->contour.add_ChainCode(chainCode);
 }
@@ -113,6 +140,13 @@ void Blob::add_Moment(unsigned int x, unsigned int y) {
     m11 += x * y;
     m20 += x * x;
     m02 += y * y;
+
+    double dx = x;
+    double dy = y;
+    m30 += dx * dx * dx;
+    m21 += dx * dx * dy;
+    m12 += dx * dy * dy;
+    m03 += dy * dy * dy;
 }
 
 void Blob::add_Moment(unsigned int min_x, unsigned int max_x, unsigned int y) {
@@ -130,19 +164,51 @@ void Blob::add_Moment(unsigned int min_x, unsigned int max_x, unsigned int y) {
     m11 += y * x_sum;
     m02 += y * y * n;
 
-    double sum_min_sq; // sum of squares from 1 to (min_x - 1)
-    if (min_x == 0)
-        sum_min_sq = 0;
-    else
-        sum_min_sq = (min_x - 1.) * (min_x) * (2. * (min_x - 1.) + 1.) / 6.;
-    double sum_max_sq = max_x * (max_x + 1.) * (2. * max_x + 1.) / 6.; // sum of squares from 1 to max_x
-    this->m20 = sum_max_sq - sum_min_sq; // sum of squares from min_x to max_x
+    double x2_sum = sumSquares(max_x) - sumSquares(min_x - 1.); // Sum of squares from min_x to max_x
+    m20 += x2_sum;
+
+    m30 += sumCubes(max_x) - sumCubes(min_x - 1.);
+    m21 += y * x2_sum;
+    m12 += (double)y * y * x_sum;
+    m03 += (double)y * y * y * n;
 }
 
 void Blob::add_InternalContour(SharedContour contour) {
     this->internalContours.push_back(contour);
 }
 
+void Blob::Upscale(unsigned int factor, const cv::Size &size) {
+    if (factor <= 1)
+        return;
+
+    // A pixel (x, y) stands for the pixels (n x + a + i, n y + a + j), i and j from -a to a: their mean is the
+    // block center, their variance v on each axis, and their odd central moments and covariance are null
+    double n = factor, a = (n - 1.) / 2., v = (n * n - 1.) / 12., N = n * n;
+    double s00 = m00, s10 = m10, s01 = m01, s11 = m11, s20 = m20, s02 = m02;
+    double s30 = m30, s21 = m21, s12 = m12, s03 = m03;
+
+    m00 = (unsigned int)(N * s00);
+    m10 = N * (n * s10 + a * s00);
+    m01 = N * (n * s01 + a * s00);
+    m11 = N * (n * n * s11 + a * n * (s10 + s01) + a * a * s00);
+    m20 = N * (n * n * s20 + 2. * a * n * s10 + (a * a + v) * s00);
+    m02 = N * (n * n * s02 + 2. * a * n * s01 + (a * a + v) * s00);
+    m30 = N * (n * n * n * s30 + 3. * a * n * n * s20 + 3. * a * a * n * s10 + a * a * a * s00 + 3. * v * (n * s10 + a * s00));
+    m03 = N * (n * n * n * s03 + 3. * a * n * n * s02 + 3. * a * a * n * s01 + a * a * a * s00 + 3. * v * (n * s01 + a * s00));
+    m21 = N * (n * n * n * s21 + a * n * n * s20 + 2. * a * n * n * s11 + 2. * a * a * n * s10 + a * a * n * s01 + a * a * a * s00 +
+               v * (n * s01 + a * s00));
+    m12 = N * (n * n * n * s12 + a * n * n * s02 + 2. * a * n * n * s11 + 2. * a * a * n * s01 + a * a * n * s10 + a * a * a * s00 +
+               v * (n * s10 + a * s00));
+
+    minx *= factor;
+    miny *= factor;
+    maxx = std::min(maxx * factor + factor - 1, (unsigned int)std::max(0, size.width - 1));
+    maxy = std::min(maxy * factor + factor - 1, (unsigned int)std::max(0, size.height - 1));
+
+    contour = Contour(contour.get_StartingPoint() * (int)factor);
+    internalContours.clear();
+}
+
 void Blob::ComputeMoments() {
     centroid = cv::Point2d(m10 / m00, m01 / m00);
 
@@ -160,37 +226,83 @@ void Blob::ComputeMoments() {
 
     double nn = n20 - n02;
     p2 = nn * nn + 4. * (n11 * n11);
+
+    // Third order
+    double xc = centroid.x;
+    double yc = centroid.y;
+
+    u30 = m30 - 3. * xc * m20 + 2. * xc * xc * m10;
+    u21 = m21 - 2. * xc * m11 - yc * m20 + 2. * xc * xc * m01;
+    u12 = m12 - 2. * yc * m11 - xc * m02 + 2. * yc * yc * m10;
+    u03 = m03 - 3. * yc * m02 + 2. * yc * yc * m01;
+
+    double m00_25 = m00_2 * std::sqrt((double)m00);
+
+    n30 = u30 / m00_25;
+    n21 = u21 / m00_25;
+    n12 = u12 / m00_25;
+    n03 = u03 / m00_25;
+
+    double t0 = n30 + n12;
+    double t1 = n21 + n03;
+    double q0 = t0 * t0;
+    double q1 = t1 * t1;
+    double s0 = n30 - 3. * n12;
+    double s1 = 3. * n21 - n03;
+
+    hu[0] = p1;
+    hu[1] = p2;
+    hu[2] = s0 * s0 + s1 * s1;
+    hu[3] = q0 + q1;
+    hu[4] = s0 * t0 * (q0 - 3. * q1) + s1 * t1 * (3. * q0 - q1);
+    hu[5] = nn * (q0 - q1) + 4. * n11 * t0 * t1;
+    hu[6] = s1 * t0 * (q0 - 3. * q1) - s0 * t1 * (3. * q0 - q1);
 }
 
+HuMoments Blob::get_HuMoments() const {
+    return hu;
+}
 
-cv::Scalar Blob::get_MeanColor(const cv::Mat &imgLabel, const cv::Mat &img) const {
-    CV_Assert(imgLabel.type() == CVB_LABEL && imgLabel.isContinuous());
-    CV_Assert(img.type() == CV_8UC3);
+ShapeDescriptor Blob::get_ShapeDescriptor(size_t harmonics) const {
+    ShapeDescriptor descriptor;
+    descriptor.reserve(hu.size() + harmonics);
+
+    // Same scaling as cv::matchShapes
+    for (auto &a_hu : hu) {
+        double magnitude = std::fabs(a_hu);
+        if (magnitude > 1e-300)
+            descriptor.push_back((a_hu > 0. ? 1. : -1.) * std::log10(magnitude));
+        else
+            descriptor.push_back(0.);
+    }
+
+    std::vector<double> fourier = contour.get_FourierDescriptors(harmonics);
+    descriptor.insert(descriptor.end(), fourier.begin(), fourier.end());
+
+    return descriptor;
+}
 
-    // Ensure image is continuous
-    cv::Mat imgBlob;
-    img(get_BoundingBox()).copyTo(imgBlob);
 
-    size_t stepLbl = imgLabel.step1();;
-    size_t stepImg = imgBlob.step1();;
-    unsigned int imgLabel_width = imgLabel.cols;
-    unsigned int imgLabel_height = imgLabel.rows;
-    unsigned int imgChan = imgBlob.channels();
+cv::Scalar Blob::get_MeanColor(const cv::Mat &imgLabel, const cv::Mat &img) const {
+    CV_Assert(imgLabel.type() == CVB_LABEL && imgLabel.isContinuous());
+    CV_Assert(img.type() == CV_8UC3 && img.size() == imgLabel.size());
 
-    Label *labels = (Label *)imgLabel.ptr();
-    unsigned char *imgData = (unsigned char *)imgBlob.ptr();
+    // Only the bounding box rows and columns hold pixels of the blob
+    cv::Rect box = get_BoundingBox() & cv::Rect(0, 0, imgLabel.cols, imgLabel.rows);
 
     double mb = 0;
     double mg = 0;
     double mr = 0;
     double pixels = (double)get_Area();
 
-    for (unsigned int r = 0; r < (unsigned int)imgLabel_height; r++, labels += stepLbl, imgData += stepImg) {
-        for (unsigned int c = 0; c < imgLabel_width; c++) {
+    for (int r = box.y; r < box.y + box.height; r++) {
+        const Label *labels = imgLabel.ptr<Label>(r);
+        const unsigned char *imgData = img.ptr<unsigned char>(r);
+        for (int c = box.x; c < box.x + box.width; c++) {
             if (labels[c] == label) {
-                mb += ((double)imgData[imgChan*c+0]) / pixels; // B
-                mg += ((double)imgData[imgChan*c+1]) / pixels; // G
-                mr += ((double)imgData[imgChan*c+2]) / pixels; // R
+                mb += ((double)imgData[3*c+0]) / pixels; // B
+                mg += ((double)imgData[3*c+1]) / pixels; // G
+                mr += ((double)imgData[3*c+2]) / pixels; // R
             }
         }
     }
@@ -213,6 +325,48 @@ cv::Scalar Blob::get_MeanColor(const cv::Mat &imgLabel, const cv::Mat &img) cons
 }
 
 
+cv::Scalar Blob::get_MeanColor(const cv::Mat &img) const {
+    CV_Assert(img.type() == CV_8UC3);
+
+    double mb = 0;
+    double mg = 0;
+    double mr = 0;
+    double pixels = 0;
+
+    for (auto &a_run : get_Runs()) {
+        CV_Assert(a_run.y >= 0 && a_run.y < img.rows && a_run.x0 >= 0 && a_run.x1 < img.cols);
+
+        const unsigned char *imgData = img.ptr<unsigned char>(a_run.y);
+        for (int c = a_run.x0; c <= a_run.x1; c++) {
+            mb += imgData[3 * c + 0]; // B
+            mg += imgData[3 * c + 1]; // G
+            mr += imgData[3 * c + 2]; // R
+        }
+        pixels += a_run.x1 - a_run.x0 + 1;
+    }
+
+    if (pixels == 0)
+        return cv::Scalar();
+
+    return cv::Scalar(mr / pixels, mg / pixels, mb / pixels);
+}
+
+Runs Blob::get_Runs() const {
+    Runs runs;
+
+    // Labelled without its contour (LabelingOptions::contours), only a single pixel blob can be rasterized
+    if (contour.get_ChainCodes().empty() && get_Area() > 1)
+        return runs;
+
+    RasterizeContours(contour, internalContours, runs);
+
+    return runs;
+}
+
+void Blob::FillMask(cv::Mat &mask, const cv::Point &offset, unsigned char value) const {
+    FillRuns(get_Runs(), mask, offset, value);
+}
+
 void Blob::RenderBlob(const cv::Mat &imgLabel, const cv::Mat &imgSource, cv::Mat &imgDest, unsigned short mode, const cv::Scalar &color, double alpha) const {
     CV_Assert(imgLabel.type() == CVB_LABEL && imgLabel.isContinuous());
     CV_Assert(imgSource.type() == CV_8UC3);
@@ -311,6 +465,10 @@ void Blob::Merge(Blob &a_blob) {
     m11 += a_blob.m11;
     m20 += a_blob.m20;
     m02 += a_blob.m02;
+    m30 += a_blob.m30;
+    m21 += a_blob.m21;
+    m12 += a_blob.m12;
+    m03 += a_blob.m03;
 }
 
 std::ostream &operator<< (std::ostream &output, const Blob &b) {
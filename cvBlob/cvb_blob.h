@@ -33,9 +33,11 @@
 #ifndef _CVBLOB_BLOB_H_
 #define _CVBLOB_BLOB_H_
 
+#include <array>
 #include <iostream>
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 #include <opencv2/core/core.hpp>
 
@@ -55,6 +57,13 @@ namespace cvb {
     typedef uint8_t Label;
 #define CVB_LABEL CV_8UC1
 
+    /// \brief The seven Hu invariant moments.
+    typedef std::array<double, 7> HuMoments;
+
+    /// \brief Shape descriptor: scaled Hu moments followed by Fourier descriptors.
+    /// \see Blob::get_ShapeDescriptor
+    typedef std::vector<double> ShapeDescriptor;
+
     /// \brief Class that contains information about one blob.
     class CVBLOB_EXPORT Blob {
     public:
@@ -74,7 +83,7 @@ namespace cvb {
 
         /// \brief  Gets the contour.
         /// \returns   The contour.
-        Contour get_Contour() const;
+        const Contour &get_Contour() const;
 
         /// \brief Gets a copy of the internal contours.
         /// \return The internal contours.
@@ -96,6 +105,16 @@ namespace cvb {
         /// \return The blob bounding box.
         cv::Rect get_BoundingBox() const;
 
+        /// \brief Tells whether the blob crosses rows left unlabelled, when a labelling stopped early.
+        /// The moments of an incomplete blob only count the pixels labelled so far.
+        /// \return True if the blob is incomplete.
+        /// \see BlobList::LabelBands
+        bool get_Incomplete() const;
+
+        /// \brief Flags the blob as incomplete, or complete.
+        /// \param incomplete Whether the blob is incomplete.
+        void set_Incomplete(bool incomplete);
+
         /// \brief Adds a chain code to the blob contour.
         /// \param chainCode The chain code to be added.
         void add_ChainCode(ChainCode chainCode);
@@ -115,16 +134,57 @@ namespace cvb {
         /// \param contour The contour to be added.
         void add_InternalContour(SharedContour contour);
 
+        /// \brief Converts a blob labelled on a downsampled mask to the coordinates of the full resolution mask.
+        /// Each pixel of the downsampled mask stands for a factor x factor block: the moments are those of the blocks,
+        /// and the bounding box is clipped to the mask. The contours, in downsampled coordinates, are cleared.
+        /// To be called before ComputeMoments.
+        /// \param factor Downsampling factor.
+        /// \param size Size of the full resolution mask.
+        void Upscale(unsigned int factor, const cv::Size &size);
+
         /// \brief Computes the central, normalized central and hu moments,
         /// along with the centroid.
         void ComputeMoments();
 
+        /// \brief Gets the seven Hu invariant moments.
+        /// Valid after ComputeMoments.
+        /// \return The Hu moments.
+        HuMoments get_HuMoments() const;
+
+        /// \brief Calculates a translation, rotation and scale invariant shape descriptor.
+        /// The Hu moments, scaled as in cv::matchShapes (sign(h) * log10|h|), followed by the Fourier descriptors
+        /// of the contour. Valid after ComputeMoments.
+        /// \param harmonics Number of Fourier descriptors.
+        /// \return The shape descriptor, of size 7 + harmonics.
+        /// \see Contour::get_FourierDescriptors
+        /// \see ShapeIndex
+        ShapeDescriptor get_ShapeDescriptor(size_t harmonics = 8) const;
+
         /// \brief Calculates mean color of a blob in an image.
+        /// Only the bounding box of the blob is scanned.
         /// \param imgLabel Image of labels.
-        /// \param img Original image.
+        /// \param img Original image (type = CV_8UC3), of the same size.
         /// \return Average color.
         cv::Scalar get_MeanColor(const cv::Mat &imgLabel, const cv::Mat &img) const;
 
+        /// \brief Calculates mean color of a blob in an image, without the image of labels.
+        /// The blob pixels are rasterized from its contours.
+        /// \param img Original image (type = CV_8UC3).
+        /// \return Average color, or zero if the blob has no pixels (see get_Runs).
+        /// \see get_Runs
+        cv::Scalar get_MeanColor(const cv::Mat &img) const;
+
+        /// \brief Rasterizes the blob from its contour and internal contours.
+        /// \return The blob pixels, as runs, or no runs if the blob was labelled without its contour.
+        /// \see RasterizeContours
+        Runs get_Runs() const;
+
+        /// \brief Sets the blob pixels in a mask, rasterized from its contours.
+        /// \param mask Mask (type = CV_8UC1), can be a ROI of a larger image.
+        /// \param offset Image coordinates of the top-left pixel of the mask.
+        /// \param value Value to set.
+        void FillMask(cv::Mat &mask, const cv::Point &offset = cv::Point(0, 0), unsigned char value = 255) const;
+
         /// \brief Draws or prints information about a blob.
         /// \param imgLabel Label image (type = CV_16UC3 and continuous).
         /// \param imgSource Input image (type = CV_8UC3).
@@ -167,21 +227,35 @@ namespace cvb {
         double m11; ///< Moment 11.
         double m02; ///< Moment 02.
         double m20; ///< Moment 20.
+        double m30; ///< Moment 30.
+        double m21; ///< Moment 21.
+        double m12; ///< Moment 12.
+        double m03; ///< Moment 03.
 
         double u11; ///< Central moment 11.
         double u20; ///< Central moment 20.
         double u02; ///< Central moment 02.
+        double u30; ///< Central moment 30.
+        double u21; ///< Central moment 21.
+        double u12; ///< Central moment 12.
+        double u03; ///< Central moment 03.
 
         double n11; ///< Normalized central moment 11.
         double n20; ///< Normalized central moment 20.
         double n02; ///< Normalized central moment 02.
+        double n30; ///< Normalized central moment 30.
+        double n21; ///< Normalized central moment 21.
+        double n12; ///< Normalized central moment 12.
+        double n03; ///< Normalized central moment 03.
 
         double p1; ///< Hu moment 1.
         double p2; ///< Hu moment 2.
+        HuMoments hu; ///< Hu moments 1 to 7.
 
         cv::Point2d centroid;          ///< Centroid.
         Contour contour;               ///< Contour.
         ContoursList internalContours; ///< Internal contours.
+        bool incomplete;               ///< Whether the blob crosses rows left unlabelled.
     };
 
     typedef std::shared_ptr<Blob> SharedBlob; ///< Shared Blob type
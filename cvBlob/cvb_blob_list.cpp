@@ -20,18 +20,162 @@
 // along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
 //
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <sstream>
 
+#include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "cvb_blob_list.h"
+#include "cvb_trace.h"
 
 using namespace cvb;
 
+// Labelling statistics instrumentation, compiled out unless CVBLOB_ENABLE_STATS is defined
+#ifdef CVBLOB_ENABLE_STATS
+# define CVB_STATS(...) __VA_ARGS__
+#else
+# define CVB_STATS(...)
+#endif
+
 namespace {
     const Label MaxLabel = std::numeric_limits<Label>::max();
+
+    // Minimum step, in pixels, by which a region side crossed by a blob is pushed out
+    const int kRegionGrowth = 8;
+
+    /// \brief Monotonic time for the labelling statistics.
+    /// \return Nanoseconds since an arbitrary origin.
+    inline unsigned long long nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// \brief Adds the hardware counters elapsed since a reading.
+    /// \param start Earlier reading.
+    /// \param counters Counters, updated.
+    /// \param excluded Counts of nested stages since the reading, left out.
+    /// \return False if the counters could not be read.
+    inline bool addCounters(const PerfCounters &start, PerfCounters &counters, const PerfCounters &excluded = PerfCounters()) {
+        PerfCounters now;
+        if (!get_PerfCounters(now))
+            return false;
+        counters += (now - start) - excluded;
+        return true;
+    }
+
+    /// \brief Zeroes the label image for a new labelling.
+    /// The buffer of the previous labelling is reused when it has the right size and nobody else holds it
+    /// (e.g. through get_ImageLabel), so that labelling a video does not allocate a label image per frame.
+    /// \param imgLabel Label image, updated.
+    /// \param size Size of the image to label.
+    /// \param zero Whether to zero the image, or leave it for the caller to overwrite.
+    inline void resetLabelImage(cv::Mat &imgLabel, const cv::Size &size, bool zero = true) {
+        if (imgLabel.size() == size && imgLabel.type() == CVB_LABEL && imgLabel.u && imgLabel.u->refcount == 1) {
+            if (zero)
+                imgLabel.setTo(cv::Scalar(0));
+        }
+        else
+            imgLabel = cv::Mat::zeros(size, CVB_LABEL);
+    }
+
+    /// \brief Downsamples a mask, keeping the top-left pixel of each block.
+    /// \param img Input mask (type = CV_8UC1).
+    /// \param factor Block side.
+    /// \param small Output mask, rounded up to cover the whole image.
+    void downsampleMask(const cv::Mat &img, unsigned int factor, cv::Mat &small) {
+        small.create((img.rows + factor - 1) / factor, (img.cols + factor - 1) / factor, CV_8UC1);
+        for (int y = 0; y < small.rows; y++) {
+            const unsigned char *in = img.ptr(y * factor);
+            unsigned char *out = small.ptr(y);
+            for (int x = 0; x < small.cols; x++)
+                out[x] = in[x * factor];
+        }
+    }
+
+    /// \brief Upsamples the labels of a downsampled mask, each label filling its block.
+    /// \param small Labels of the downsampled mask.
+    /// \param factor Block side.
+    /// \param imgLabel Output label image, already of the full resolution size.
+    void upsampleLabels(const cv::Mat &small, unsigned int factor, cv::Mat &imgLabel) {
+        for (int y = 0; y < imgLabel.rows; y++) {
+            const Label *in = (const Label *)small.ptr(y / factor);
+            Label *out = (Label *)imgLabel.ptr(y);
+            for (int x = 0; x < imgLabel.cols; x++)
+                out[x] = in[x / factor];
+        }
+    }
+
+    /// \brief Computes the moments of the blobs and builds the blobs list.
+    /// \param blob_map Blobs, by label. A blob can be mapped by more than one label. Cleared on return, unless kept.
+    /// \param blobs Output list, in label order, each blob once.
+    /// \param stats Statistics, updated.
+    /// \param minArea Complete blobs smaller than this are left out, and counted as filtered.
+    /// \param incompleteRow Blobs reaching this row or a lower one are flagged as incomplete, the others as complete.
+    /// \param keep Whether to keep the blob map, for a labelling to be resumed. The list then gets copies of the incomplete blobs.
+    void populateList(BlobsMap &blob_map, std::list<SharedBlob> &blobs, LabelingStats &stats, unsigned int minArea = 0,
+                      unsigned int incompleteRow = std::numeric_limits<unsigned int>::max(), bool keep = false) {
+        (void)stats;
+
+        CVB_STATS(PerfCounters perfStart;)
+        CVB_STATS(bool perf = get_PerfCounters(perfStart);)
+        CVB_STATS(unsigned long long t0 = nowNs();)
+        for (auto &a_blob : blob_map) {
+            Blob &blob = *a_blob.second;
+            // Skip the labels of blobs merged into another one (SimpleLabel)
+            if (blob.label != a_blob.first)
+                continue;
+            cv::Rect box = blob.get_BoundingBox();
+            blob.set_Incomplete((unsigned int)(box.y + box.height) > incompleteRow);
+            if (!blob.get_Incomplete() && blob.get_Area() < minArea) {
+                CVB_STATS(stats.blobsFiltered++;)
+                continue;
+            }
+            if (keep && blob.get_Incomplete())
+                // The labelling goes on with the kept blob, so the list gets a copy of it as it is now
+                blobs.push_back(std::allocate_shared<Blob>(ContainerAllocator<Blob, Memory_blobs>(), blob));
+            else
+                blobs.push_back(a_blob.second);
+        }
+        if (!keep)
+            blob_map.clear();
+        CVB_STATS(unsigned long long t1 = nowNs();)
+
+        for (auto &blob : blobs)
+            blob->ComputeMoments();
+        CVB_STATS(stats.listNs += t1 - t0;)
+        CVB_STATS(stats.momentsNs += nowNs() - t1;)
+        CVB_STATS(if (perf && addCounters(perfStart, stats.finalizeCounters)) stats.perfCalls = 1;)
+    }
+
+    /// \brief Fills the memory part of the statistics of a labelling, once its blob map is freed.
+    /// \param start Allocation counters of the thread when the labelling started.
+    /// \param imgLabel Label image.
+    /// \param stats Statistics, updated.
+    inline void countMemory(const MemoryStats &start, const cv::Mat &imgLabel, LabelingStats &stats) {
+        const MemoryStats &now = get_MemoryStats();
+        stats.allocations = now.allocations - start.allocations;
+        stats.allocatedBytes = now.allocatedBytes - start.allocatedBytes;
+        stats.peakBytes = std::max(0LL, now.peakBytes - start.totalLiveBytes);
+        stats.labelImageBytes = imgLabel.total() * imgLabel.elemSize();
+        stats.blobBytes = std::max(0LL, now.liveBytes[Memory_blobs] - start.liveBytes[Memory_blobs]);
+        // Polygons are plain vectors, added up while tracing
+        stats.contourBytes += std::max(0LL, now.liveBytes[Memory_contours] - start.liveBytes[Memory_contours]);
+    }
+
+    /// \brief Counts blobs removed by a filter, in the statistics of the last labelling and in the totals.
+    /// \param filtered Number of blobs removed.
+    /// \param stats Statistics of the last labelling, updated.
+    inline void countFiltered(size_t filtered, LabelingStats &stats) {
+        LabelingStats removed;
+        removed.blobsFiltered = filtered;
+        stats += removed;
+        add_LabelingTotals(removed);
+    }
 }
 
 const std::tuple<cv::Point, unsigned char, ChainCode> movesE[4][3] =
@@ -50,20 +194,290 @@ const std::tuple<cv::Point, unsigned char, ChainCode> movesI[4][3] =
     { std::make_tuple(cv::Point( 1,  1), 2, ChainCode_down_right), std::make_tuple(cv::Point( 1,  0), 3, ChainCode_right), std::make_tuple(cv::Point( 1, -1), 3, ChainCode_up_right)   }
 };
 
-BlobList::BlobList() {
+namespace {
+    /// \brief Contour tracing labelling of an image, or of a region of a larger one.
+    /// The region is taken as a whole image: its blobs must not cross its sides, unless those are the image ones.
+    /// \param img Input binary image or region.
+    /// \param imgOut Output label image or region, zeroed, of the same size.
+    /// \param offset Image coordinates of the top-left pixel of the region.
+    /// \param label Last label used, updated.
+    /// \param max_label Maximum number of labels.
+    /// \param blob_map Output blobs, in image coordinates.
+    /// \param stats Statistics, updated.
+    /// \param contours Whether to record the blob contours.
+    /// \param internalContours Whether to record the internal contours.
+    /// \param firstRow First row to scan, the rows above being labelled by earlier calls.
+    /// \param endRow Row after the last one to scan.
+    /// \param stopRow Output row where the labels ran out, if they did.
+    /// \return False if the labels ran out.
+    bool labelContours(const cv::Mat &img, cv::Mat &imgOut, const cv::Point &offset, Label &label, Label max_label, BlobsMap &blob_map,
+                       LabelingStats &stats, bool contours = true, bool internalContours = true, unsigned int firstRow = 0,
+                       unsigned int endRow = std::numeric_limits<unsigned int>::max(), unsigned int *stopRow = nullptr) {
+        (void)stats;
+        unsigned int imgIn_width = img.cols;
+        unsigned int imgIn_height = img.rows;
+        endRow = std::min(endRow, imgIn_height);
+
+        CVB_STATS(unsigned long long start = nowNs(), traced = stats.contourNs + stats.holeNs;)
+        CVB_STATS(PerfCounters perfStart, perfTraced = stats.traceCounters;)
+        CVB_STATS(bool perf = get_PerfCounters(perfStart);)
+        CVB_STATS(stats.pixelsVisited += (unsigned long long)img.cols * (endRow - std::min(firstRow, endRow));)
+
+        Label lastLabel = 0;
+        SharedBlob lastBlob;
+
+        unsigned char *imgInBuff = (unsigned char*) img.ptr();
+        size_t stepIn = img.step1();
+        auto imageIn = [&imgInBuff, &stepIn] (int x, int y) -> unsigned char& {
+            return imgInBuff[x + y * stepIn];
+        };
+
+        Label *imgOutBuff = (Label *) imgOut.ptr();
+        size_t stepOut = imgOut.step1();
+        auto imageOut = [&imgOutBuff, &stepOut] (int x, int y) -> Label& {
+            return imgOutBuff[x + y * stepOut];
+        };
+
+        for (unsigned int y = firstRow; y < endRow; y++) {
+            for (unsigned int x = 0; x < imgIn_width; x++) {
+                // Ignore if input is 0
+                if (!imageIn(x, y))
+                    continue;
+                CVB_STATS(if (x == 0 || !imageIn(x - 1, y)) stats.runs++;)
+
+                Label current = imageOut(x, y);
+
+                if (!current && (y == 0 || !imageIn(x, y - 1))) {
+                    // Not labelled and previous element wasn't 0
+                    // Label contour.
+                    label++;
+
+                    if (label >= max_label) {
+                        if (stopRow)
+                            *stopRow = y;
+                        CVB_STATS(stats.truncated++;)
+                        CVB_STATS(stats.scanNs += nowNs() - start - (stats.contourNs + stats.holeNs - traced);)
+                        CVB_STATS(if (perf) addCounters(perfStart, stats.scanCounters, stats.traceCounters - perfTraced);)
+                        return false;
+                    }
+                    imageOut(x, y) = label;
+
+                    // XXX This is not necessary at all. I only do this for consistency.
+                    if (y > 0)
+                        imageOut(x, y - 1) = MaxLabel;
+
+                    // Create new blob.
+                    SharedBlob blob = std::allocate_shared<Blob>(ContainerAllocator<Blob, Memory_blobs>(),
+                                                                 cv::Point(x + offset.x, y + offset.y), label);
+                    blob_map.insert(LabelBlob(label, blob));
+                    lastLabel = label;
+                    lastBlob = blob;
+                    CVB_STATS(stats.blobsCreated++;)
+                    CVB_STATS(PerfCounters traceStart;)
+                    CVB_STATS(bool tracePerf = perf && get_PerfCounters(traceStart);)
+                    CVB_STATS(unsigned long long t0 = nowNs();)
+
+                    // Now, to find the contour.
+                    unsigned char direction = 1;
+                    unsigned int xx = x;
+                    unsigned int yy = y;
+                    bool contourEnd = false;
+
+                    while (!contourEnd) {
+                        bool found = false;
+
+                        for (unsigned char i = 0; i < 3; i++) {
+                            // Move to the direction
+                            int nx = xx + std::get<0>(movesE[direction][i]).x;
+                            int ny = yy + std::get<0>(movesE[direction][i]).y;
+
+                            // Boundaries check
+                            if (nx < 0 || ny < 0 )
+                                continue;
+                            if (static_cast<unsigned>(nx) >= imgIn_width ||
+                                static_cast<unsigned>(ny) >= imgIn_height)
+                              continue;
+
+                            if (!imageIn(nx, ny)) {
+                                imageOut(nx, ny) = MaxLabel;
+                                continue;
+                            }
+
+                            // Found the next part of the blob contour
+                            found = true;
+                            if (contours)
+                                blob->add_ChainCode(std::get<2>(movesE[direction][i]));
+                            CVB_STATS(stats.contourSteps++;)
+                            xx = nx;
+                            yy = ny;
+                            if (imageOut(xx, yy) != label) {
+                                imageOut(xx, yy) = label;
+                                blob->add_Moment(xx + offset.x, yy + offset.y);
+                            }
+                            direction = std::get<1>(movesE[direction][i]);
+                            break;
+                        }
+
+
+                        if (!found)
+                            // New direction
+                            direction = (direction + 1) % 4;
+                        // Check if we went full circle
+                        contourEnd = ((xx == x) && (yy == y) && (direction == 1));
+                    } // while (!ContourEnd)
+                    CVB_STATS(stats.contourNs += nowNs() - t0;)
+                    CVB_STATS(if (tracePerf) addCounters(traceStart, stats.traceCounters);)
+                    CVB_STATS(stats.contourBytes += blob->get_Contour().get_ContourPolygon().capacity() * sizeof(cv::Point);)
+
+                    // The starting point may also be the top of a hole, see below.
+                    current = label;
+                } // if ((!current) && ((y == 0) || (!imageIn(x, y-1))))
+
+
+                if ((y + 1 < imgIn_height) && (!imageIn(x, y + 1)) && (!imageOut(x, y + 1))) {
+                    // We're in a "hole" inside the blob, whether this pixel is already labelled or not
+                    // Label internal contour
+                    Label l;
+                    SharedBlob blob;
+
+                    l = current ? current : imageOut(x - 1, y);
+
+                    if (l == lastLabel)
+                        blob = lastBlob;
+                    else {
+                        blob = blob_map.find(l)->second;
+                        lastLabel = l;
+                        lastBlob = blob;
+                    }
+
+                    if (!current) {
+                        imageOut(x, y) = l;
+                        blob->add_Moment(x + offset.x, y + offset.y);
+                    }
+
+
+                    // XXX This is not necessary (I believe). I only do this for consistency.
+                    imageOut(x, y + 1) = MaxLabel;
+
+                    CVB_STATS(PerfCounters traceStart;)
+                    CVB_STATS(bool tracePerf = perf && get_PerfCounters(traceStart);)
+                    CVB_STATS(unsigned long long t0 = nowNs();)
+                    // Without internal contours, the hole is still traced for its labels
+                    SharedContour contour;
+                    if (internalContours)
+                        contour = std::allocate_shared<Contour>(ContainerAllocator<Contour, Memory_contours>(),
+                                                                cv::Point(x + offset.x, y + offset.y));
+
+                    unsigned char direction = 3;
+                    unsigned int xx = x;
+                    unsigned int yy = y;
+                    bool contourEnd = false;
+
+                    while (!contourEnd) {
+                        bool found = false;
+
+                        for (unsigned char i = 0; i < 3; i++) {
+                            // Move to the direction
+                            int nx = xx + std::get<0>(movesI[direction][i]).x;
+                            int ny = yy + std::get<0>(movesI[direction][i]).y;
+
+                            // Boundaries check
+                            if (nx < 0 || ny < 0)
+                              continue;
+                            if (static_cast<unsigned>(nx) >= imgIn_width ||
+                                static_cast<unsigned>(ny) >= imgIn_height)
+                              continue;
+
+                            if (!imageIn(nx, ny)) {
+                                imageOut(nx, ny) = MaxLabel;
+                                continue;
+                            }
+
+                            // Found the next part of the internal contour
+                            found = true;
+                            if (contour)
+                                contour->add_ChainCode(std::get<2>(movesI[direction][i]));
+                            CVB_STATS(stats.holeSteps++;)
+                            xx = nx;
+                            yy = ny;
+                            if (!imageOut(xx, yy)) {
+                                imageOut(xx, yy) = l;
+                                blob->add_Moment(xx + offset.x, yy + offset.y);
+                            }
+                            direction = std::get<1>(movesI[direction][i]);
+                            // Check if we went full circle
+                            contourEnd = (xx == x) && (yy == y);
+                            break;
+                        }
+
+                        if (!found)
+                            // New direction
+                            direction = (direction + 1) % 4;
+                    } // while (!contourEnd)
+
+                    // Finally, add the internal contour
+                    if (contour)
+                        blob->add_InternalContour(contour);
+                    CVB_STATS(stats.holeNs += nowNs() - t0;)
+                    CVB_STATS(if (tracePerf) addCounters(traceStart, stats.traceCounters);)
+                    CVB_STATS(if (contour) stats.contourBytes += contour->get_ContourPolygon().capacity() * sizeof(cv::Point);)
+                    continue;
+                } // if ((y + 1 < imgIn_height) && (!imageIn(x, y + 1)) && (!imageOut(x, y + 1)))
+
+                if (current)
+                    continue;
+
+                //else, element is not labelled
+                // Internal pixel
+                Label l = imageOut(x - 1, y);
+
+                imageOut(x, y) = l;
+
+                SharedBlob blob;
+                if (l == lastLabel)
+                    blob = lastBlob;
+                else {
+                    blob = blob_map.find(l)->second;
+                    lastLabel = l;
+                    lastBlob = blob;
+                }
+                blob->add_Moment(x + offset.x, y + offset.y);
+            }
+        }
+
+        CVB_STATS(stats.scanNs += nowNs() - start - (stats.contourNs + stats.holeNs - traced);)
+        CVB_STATS(if (perf) addCounters(perfStart, stats.scanCounters, stats.traceCounters - perfTraced);)
+        return true;
+    }
+}  // namespace
+
+LabelingOptions::LabelingOptions() : contours(true), internalContours(true), minArea(0), downsample(1) {}
+
+LabelingBudget::LabelingBudget() : seconds(0.), pixels(0), bandRows(16) {}
+
+BlobList::BlobList() : labelled_rows(0), truncated(false), pending_label(0), pending_max_label(0) {
 }
 
 void BlobList::SimpleLabel(const cv::Mat &img, Label max_label) {
+    TraceSpan span("SimpleLabel", "labeling");
     CV_Assert(img.type() == CV_8UC1);
 
     // Reset
-    blobs.clear();
-    imgLabel = cv::Mat::zeros(img.size(), CVB_LABEL);
+    resetLabeling(img.rows);
+    CVB_STATS(MemoryStats memory = get_MemoryStats();)
+    CVB_STATS(ResetMemoryPeak();)
+    resetLabelImage(imgLabel, img.size());
 
     // Do nothing if image is empty
     if (img.rows == 0)
         return;
 
+    CVB_STATS(stats.calls = 1;)
+    CVB_STATS(stats.pixelsVisited = (unsigned long long)img.cols * img.rows;)
+    CVB_STATS(PerfCounters perfStart;)
+    CVB_STATS(bool perf = get_PerfCounters(perfStart);)
+    CVB_STATS(unsigned long long start = nowNs();)
+
     // Ensure matrix is continuous
     cv::Mat imgInCont;
     if (img.isContinuous())
@@ -107,25 +521,37 @@ void BlobList::SimpleLabel(const cv::Mat &img, Label max_label) {
                 end_x++;
             }
             x = end_x;
+            CVB_STATS(stats.runs++;)
 
             if (prev_blobs.empty()) {
                 // New blob
                 label++;
-                if (label >= max_label)
+                if (label >= max_label) {
+                    // The blobs of the previous row may go on in this one
+                    truncated = true;
+                    labelled_rows = y;
+                    CVB_STATS(stats.truncated++;)
                     goto SimpleBlobEnd;
+                }
                 l = label;
-                blob = SharedBlob(new Blob(begin_x, end_x - 1, y, label));
+                blob = std::allocate_shared<Blob>(ContainerAllocator<Blob, Memory_blobs>(), begin_x, end_x - 1, y, label);
                 blob_map.insert(blob_map.end(), LabelBlob(label, blob));
+                CVB_STATS(stats.blobsCreated++;)
             } else {
                 SharedBlob blob = prev_blobs.begin()->second;
 
                 if (prev_blobs.size() > 1)  {
                     // Merge blobs
                     for (auto &a_blob : prev_blobs) {
-                        if (blob == a_blob.second)
+                        SharedBlob other = blob_map.at(a_blob.first);
+                        if (blob == other)
                             continue;
-                        blob->Merge(*a_blob.second.get());
-                        blob_map.at(a_blob.second->label) = blob;
+                        blob->Merge(*other.get());
+                        CVB_STATS(stats.merges++;)
+                        // Every label of the merged blob, including those of earlier merges, now maps to this one
+                        for (auto &entry : blob_map)
+                            if (entry.second == other)
+                                entry.second = blob;
                     }
                 }
                 l = blob->label;
@@ -140,239 +566,244 @@ void BlobList::SimpleLabel(const cv::Mat &img, Label max_label) {
     }
 
 SimpleBlobEnd:
-    // Remove duplicates
-    BlobsMap new_map;
-    for (auto &a_blob : blob_map) {
-        if (new_map.find(a_blob.second->label) != new_map.end())
-            continue;
-        new_map.insert(LabelBlob(a_blob.second->label, a_blob.second));
-    }
+    CVB_STATS(stats.scanNs = nowNs() - start;)
+    CVB_STATS(if (perf) addCounters(perfStart, stats.scanCounters);)
 
     // Generate final list
-    for (auto &a_blob : new_map) {
-        blobs.push_back(a_blob.second);
-        a_blob.second->ComputeMoments();
-    }
+    populateList(blob_map, blobs, stats, 0, truncated ? std::max(1u, labelled_rows) - 1 : std::numeric_limits<unsigned int>::max());
+    CVB_STATS(countMemory(memory, imgLabel, stats);)
+    CVB_STATS(add_LabelingTotals(stats);)
 }
 
 void BlobList::LabelImage (const cv::Mat &img, Label max_label) {
-    CV_Assert(img.type() == CV_8UC1);
+    LabelImage(img, max_label, LabelingOptions());
+}
 
+void BlobList::LabelImage(const cv::Mat &img, Label max_label, const LabelingOptions &options) {
+    TraceSpan span("LabelImage", "labeling", "downsample", options.downsample);
+    CV_Assert(img.type() == CV_8UC1);
 
     // Reset
-    blobs.clear();
-    imgLabel = cv::Mat::zeros(img.size(), CVB_LABEL);
-    // Ensure matrix is continuous
-    cv::Mat imgInCont;
-    if (img.isContinuous())
-        imgInCont = img;
-    else
-        img.copyTo(imgInCont);
+    resetLabeling(img.rows);
+    CVB_STATS(MemoryStats memory = get_MemoryStats();)
+    CVB_STATS(ResetMemoryPeak();)
+    CVB_STATS(stats.calls = 1;)
+    unsigned int factor = std::max(1u, options.downsample);
+    resetLabelImage(imgLabel, img.size(), factor == 1);
 
     Label label = 0;
-
-    unsigned int imgIn_width = imgInCont.cols;
-    unsigned int imgIn_height = imgInCont.rows;
-
-    Label lastLabel = 0;
-    SharedBlob lastBlob;
     BlobsMap blob_map;
+    unsigned int stopRow = 0;
+    if (factor > 1 && !img.empty()) {
+        // Contours would be in downsampled coordinates: they are left out
+        downsampleMask(img, factor, mask_workspace);
+        resetLabelImage(label_workspace, mask_workspace.size());
+        truncated = !labelContours(mask_workspace, label_workspace, cv::Point(0, 0), label, max_label, blob_map, stats,
+                                   false, false, 0, std::numeric_limits<unsigned int>::max(), &stopRow);
+        stopRow *= factor;
+        for (auto &a_blob : blob_map)
+            a_blob.second->Upscale(factor, img.size());
+        upsampleLabels(label_workspace, factor, imgLabel);
+    }
+    else {
+        // Ensure matrix is continuous
+        cv::Mat imgInCont;
+        if (img.isContinuous())
+            imgInCont = img;
+        else
+            img.copyTo(imgInCont);
+
+        truncated = !labelContours(imgInCont, imgLabel, cv::Point(0, 0), label, max_label, blob_map, stats, options.contours,
+                                   options.internalContours, 0, std::numeric_limits<unsigned int>::max(), &stopRow);
+    }
+    if (truncated)
+        labelled_rows = std::min(stopRow, (unsigned int)img.rows);
 
-    unsigned char *imgInBuff = (unsigned char*) imgInCont.ptr();
-    size_t stepIn = imgInCont.step1();
-    auto imageIn = [&imgInBuff, &stepIn] (int x, int y) -> unsigned char& {
-        return imgInBuff[x + y * stepIn];
-    };
-
-    Label *imgOutBuff = (Label *) imgLabel.ptr();
-    size_t stepOut = imgLabel.step1();
-    auto imageOut = [&imgOutBuff, &stepOut] (int x, int y) -> Label& {
-        return imgOutBuff[x + y * stepOut];
-    };
-
-    for (unsigned int y = 0; y < imgIn_height; y++) {
-        for (unsigned int x = 0; x < imgIn_width; x++) {
-            // Ignore if input is 0
-            if (!imageIn(x, y))
-                continue;
-
-            bool labelled = imageOut(x, y) != 0;
-            if (labelled)
-                continue;
-
-            if (y == 0 || !imageIn(x, y - 1)) {
-                // Not labelled and previous element wasn't 0
-                // Label contour.
-                labelled = true;
-                label++;
-
-                if (label >= max_label)
-                    goto LabelEnd;
-                imageOut(x, y) = label;
-
-                // XXX This is not necessary at all. I only do this for consistency.
-                if (y > 0)
-                    imageOut(x, y - 1) = MaxLabel;
-
-                // Create new blob.
-                SharedBlob blob(new Blob(cv::Point(x, y), label));
-                blob_map.insert(LabelBlob(label, blob));
-                lastLabel = label;
-                lastBlob = blob;
-
-                // Now, to find the contour.
-                unsigned char direction = 1;
-                unsigned int xx = x;
-                unsigned int yy = y;
-                bool contourEnd = false;
+    // Populate list
+    populateList(blob_map, blobs, stats, options.minArea, labelled_rows);
+    CVB_STATS(countMemory(memory, imgLabel, stats);)
+    CVB_STATS(add_LabelingTotals(stats);)
+}
 
-                while (!contourEnd) {
-                    bool found = false;
+bool BlobList::LabelBands(const cv::Mat &img, Label max_label, const LabelingBudget &budget, const LabelingOptions &options) {
+    TraceSpan span("LabelBands", "labeling", "bandRows", budget.bandRows);
+    CV_Assert(img.type() == CV_8UC1);
+    CV_Assert(options.downsample <= 1);
 
-                    for (unsigned char i = 0; i < 3; i++) {
-                        // Move to the direction
-                        int nx = xx + std::get<0>(movesE[direction][i]).x;
-                        int ny = yy + std::get<0>(movesE[direction][i]).y;
+    // Reset
+    resetLabeling(img.rows);
+    resetLabelImage(imgLabel, img.size());
 
-                        // Boundaries check
-                        if (nx < 0 || ny < 0 )
-                            continue;
-                        if (static_cast<unsigned>(nx) >= imgIn_width ||
-                            static_cast<unsigned>(ny) >= imgIn_height)
-                          continue;
+    // Ensure matrix is continuous
+    if (img.isContinuous())
+        pending_img = img;
+    else
+        img.copyTo(pending_img);
+    pending_label = 0;
+    pending_max_label = max_label;
+    pending_options = options;
+    labelled_rows = 0;
 
-                        if (!imageIn(nx, ny)) {
-                            imageOut(nx, ny) = MaxLabel;
-                            continue;
-                        }
+    return labelPendingBands(budget);
+}
 
-                        // Found the next part of the blob contour
-                        found = true;
-                        blob->add_ChainCode(std::get<2>(movesE[direction][i]));
-                        xx = nx;
-                        yy = ny;
-                        if (imageOut(xx, yy) != label) {
-                            imageOut(xx, yy) = label;
-                            blob->add_Moment(xx, yy);
-                        }
-                        direction = std::get<1>(movesE[direction][i]);
-                        break;
-                    }
+bool BlobList::ResumeLabeling(const LabelingBudget &budget) {
+    TraceSpan span("ResumeLabeling", "labeling", "row", labelled_rows);
+    if (pending_img.empty())
+        return true;
 
+    blobs.clear();
+    stats = LabelingStats();
+    return labelPendingBands(budget);
+}
 
-                    if (!found)
-                        // New direction
-                        direction = (direction + 1) % 4;
-                    // Check if we went full circle
-                    contourEnd = ((xx == x) && (yy == y) && (direction == 1));
-                } // while (!ContourEnd)
-                continue;
-            } // if ((!labelled) && ((y == 0) || (!imageIn(x, y-1))))
+bool BlobList::labelPendingBands(const LabelingBudget &budget) {
+    CVB_STATS(MemoryStats memory = get_MemoryStats();)
+    CVB_STATS(ResetMemoryPeak();)
+    CVB_STATS(stats.calls = 1;)
+
+    unsigned int rows = pending_img.rows;
+    unsigned int bandRows = std::max(1u, budget.bandRows);
+    unsigned long long pixels = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (labelled_rows < rows) {
+        unsigned int firstRow = labelled_rows;
+        unsigned int endRow = std::min(rows, firstRow + bandRows);
+        unsigned int stopRow = endRow;
+        if (!labelContours(pending_img, imgLabel, cv::Point(0, 0), pending_label, pending_max_label, pending_blobs, stats,
+                           pending_options.contours, pending_options.internalContours, labelled_rows, endRow, &stopRow)) {
+            // Out of labels: there is nothing left to resume
+            truncated = true;
+            labelled_rows = stopRow;
+            break;
+        }
+        labelled_rows = endRow;
+
+        pixels += (unsigned long long)pending_img.cols * (endRow - firstRow);
+        if (budget.pixels && pixels >= budget.pixels)
+            break;
+        if (budget.seconds > 0. &&
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= budget.seconds)
+            break;
+    }
+    bool done = truncated || labelled_rows >= rows;
+
+    // Populate list, keeping the blobs of an unfinished labelling
+    populateList(pending_blobs, blobs, stats, pending_options.minArea, labelled_rows, !done);
+    if (done)
+        pending_img.release();
+    CVB_STATS(countMemory(memory, imgLabel, stats);)
+    CVB_STATS(add_LabelingTotals(stats);)
+    return labelled_rows >= rows;
+}
 
+void BlobList::resetLabeling(unsigned int rows) {
+    blobs.clear();
+    stats = LabelingStats();
+    labelled_rows = rows;
+    truncated = false;
+    pending_img.release();
+    pending_blobs.clear();
+}
 
-            if ((y + 1 < imgIn_height) && (!imageIn(x, y + 1)) && (!imageOut(x, y + 1))) {
-                // We're in a "hole" inside the blob
-                labelled = true;
+unsigned int BlobList::get_LabelledRows() const {
+    return labelled_rows;
+}
 
-                // Label internal contour
-                Label l;
-                SharedBlob blob;
+bool BlobList::get_Truncated() const {
+    return truncated;
+}
 
-                l = imageOut(x - 1, y);
-                imageOut(x, y) = l;
+void cvb::GrowRegions(const cv::Mat &img, std::vector<cv::Rect> &regions) {
+    CV_Assert(img.type() == CV_8UC1);
 
-                if (l == lastLabel)
-                    blob = lastBlob;
-                else {
-                    blob = blob_map.find(l)->second;
-                    lastLabel = l;
-                    lastBlob = blob;
+    cv::Rect frame(0, 0, img.cols, img.rows);
+    size_t n = 0;
+    for (auto &region : regions) {
+        cv::Rect clipped = region & frame;
+        if (clipped.area() > 0)
+            regions[n++] = clipped;
+    }
+    regions.resize(n);
+
+    // Grow the regions until no foreground pixel lies on their sides, so that no blob crosses them,
+    // merging those which overlap so that no pixel is labelled twice
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (size_t i = 0; i < regions.size(); i++) {
+            for (size_t j = i + 1; j < regions.size(); ) {
+                if ((regions[i] & regions[j]).area() > 0) {
+                    regions[i] |= regions[j];
+                    regions[j] = regions.back();
+                    regions.pop_back();
+                    j = i + 1;
                 }
+                else
+                    j++;
+            }
+        }
 
-                if (!imageOut(x, y))
-                    blob->add_Moment(x, y);
-
-
-                // XXX This is not necessary (I believe). I only do this for consistency.
-                imageOut(x, y + 1) = MaxLabel;
-
-                SharedContour contour(new Contour(cv::Point(x, y), ChainCodes()));
-
-                unsigned char direction = 3;
-                unsigned int xx = x;
-                unsigned int yy = y;
-                bool contourEnd = false;
-
-                while (!contourEnd) {
-                    bool found = false;
-
-                    for (unsigned char i = 0; i < 3; i++) {
-                        // Move to the direction
-                        int nx = xx + std::get<0>(movesI[direction][i]).x;
-                        int ny = yy + std::get<0>(movesI[direction][i]).y;
-
-                        // Boundaries check
-                        if (nx < 0 || ny < 0)
-                          continue;
-                        if (static_cast<unsigned>(nx) >= imgIn_width ||
-                            static_cast<unsigned>(ny) >= imgIn_height)
-                          continue;
-
-                        if (!imageIn(nx, ny)) {
-                            imageOut(nx, ny) = MaxLabel;
-                            continue;
-                        }
-
-                        // Found the next part of the internal contour
-                        found = true;
-                        contour->add_ChainCode(std::get<2>(movesI[direction][i]));
-                        xx = nx;
-                        yy = ny;
-                        if (!imageOut(xx, yy)) {
-                            imageOut(xx, yy) = l;
-                            blob->add_Moment(xx, yy);
-                        }
-                        direction = std::get<1>(movesI[direction][i]);
-                        // Check if we went full circle
-                        contourEnd = (xx == x) && (yy == y);
-                        break;
-                    }
+        for (auto &region : regions) {
+            int growX = std::max(kRegionGrowth, region.width / 2);
+            int growY = std::max(kRegionGrowth, region.height / 2);
+            int x0 = region.x, y0 = region.y;
+            int x1 = region.x + region.width, y1 = region.y + region.height;
+
+            if (y0 > 0 && cv::countNonZero(img(cv::Rect(region.x, y0, region.width, 1))))
+                y0 = std::max(0, y0 - growY);
+            if (y1 < img.rows && cv::countNonZero(img(cv::Rect(region.x, y1 - 1, region.width, 1))))
+                y1 = std::min(img.rows, y1 + growY);
+            if (x0 > 0 && cv::countNonZero(img(cv::Rect(x0, region.y, 1, region.height))))
+                x0 = std::max(0, x0 - growX);
+            if (x1 < img.cols && cv::countNonZero(img(cv::Rect(x1 - 1, region.y, 1, region.height))))
+                x1 = std::min(img.cols, x1 + growX);
+
+            if (x0 != region.x || y0 != region.y || x1 != region.x + region.width || y1 != region.y + region.height) {
+                region = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+                changed = true;
+            }
+        }
+    }
+}
 
-                    if (!found)
-                        // New direction
-                        direction = (direction + 1) % 4;
-                } // while (!contourEnd)
+void BlobList::LabelRegions(const cv::Mat &img, std::vector<cv::Rect> &regions, Label max_label) {
+    TraceSpan span("LabelRegions", "labeling", "regions", (long long)regions.size());
+    CV_Assert(img.type() == CV_8UC1);
 
-                // Finally, add the internal contour
-                blob->add_InternalContour(contour);
-                continue;
-            } // if ((y + 1 < imgIn_height) && (!imageIn(x, y + 1)) && (!imageOut(x, y + 1)))
+    // Reset
+    resetLabeling(img.rows);
+    CVB_STATS(MemoryStats memory = get_MemoryStats();)
+    CVB_STATS(ResetMemoryPeak();)
+    CVB_STATS(stats.calls = 1;)
+    resetLabelImage(imgLabel, img.size());
 
-            //else, element is not labelled
-            // Internal pixel
-            Label l = imageOut(x - 1, y);
+    CVB_STATS(PerfCounters perfStart;)
+    CVB_STATS(bool perf = get_PerfCounters(perfStart);)
+    CVB_STATS(unsigned long long start = nowNs();)
+    GrowRegions(img, regions);
 
-            imageOut(x, y) = l;
+    CVB_STATS(stats.scanNs = nowNs() - start;)
+    CVB_STATS(if (perf) addCounters(perfStart, stats.scanCounters);)
 
-            SharedBlob blob;
-            if (l == lastLabel)
-                blob = lastBlob;
-            else {
-                blob = blob_map.find(l)->second;
-                lastLabel = l;
-                lastBlob = blob;
-            }
-            blob->add_Moment(x, y);
+    // Label each region in place, numbering the blobs across all of them
+    Label label = 0;
+    BlobsMap blob_map;
+    for (auto &region : regions) {
+        cv::Mat imgOut = imgLabel(region);
+        if (!labelContours(img(region), imgOut, region.tl(), label, max_label, blob_map, stats)) {
+            // Regions are not in row order: no row is known to be complete
+            truncated = true;
+            labelled_rows = 0;
+            break;
         }
     }
 
-LabelEnd:
     // Populate list
-    for (auto &a_blob : blob_map) {
-        blobs.push_back(a_blob.second);
-        a_blob.second->ComputeMoments();
-    }
-
+    populateList(blob_map, blobs, stats, 0, labelled_rows);
+    CVB_STATS(countMemory(memory, imgLabel, stats);)
+    CVB_STATS(add_LabelingTotals(stats);)
 }
 
 void BlobList::FilterLabels(cv::Mat &imgOut) const {
@@ -416,6 +847,10 @@ std::list<SharedBlob> BlobList::get_BlobsList() const {
     return this->blobs;
 }
 
+const LabelingStats &BlobList::get_LabelingStats() const {
+    return stats;
+}
+
 cv::Mat BlobList::get_ImageLabel() const {
     return this->imgLabel;
 }
@@ -446,6 +881,8 @@ SharedBlob BlobList::get_LargestBlob() const {
 }
 
 void BlobList::FilterByArea(unsigned int minArea, unsigned int maxArea) {
+    TraceSpan span("FilterByArea", "filtering");
+    CVB_STATS(size_t before = blobs.size();)
     auto it = blobs.begin();
     while(it != blobs.end()) {
         auto &blob = *it;
@@ -457,20 +894,24 @@ void BlobList::FilterByArea(unsigned int minArea, unsigned int maxArea) {
         } else
             ++it;
     }
+    CVB_STATS(countFiltered(before - blobs.size(), stats);)
 }
 
 void BlobList::FilterByLabel(Label label) {
+    TraceSpan span("FilterByLabel", "filtering");
+    CVB_STATS(size_t before = blobs.size();)
     auto it = blobs.begin();
     while(it != blobs.end()) {
         auto &blob = *it;
 
         if (blob->label != label) {
-            auto &tmp = it;
+            auto tmp = it;
             ++it;
             blobs.erase(tmp);
         } else
             ++it;
     }
+    CVB_STATS(countFiltered(before - blobs.size(), stats);)
 }
 
 /*void cvCentralMoments(CvBlob *blob, const cv::Mat &img) {
@@ -549,6 +990,7 @@ inline void HSV2RGB (double H, double S, double V, double &R, double &G, double
 }
 
 void BlobList::RenderBlobs(const cv::Mat &imgSource, cv::Mat &imgDest, unsigned short mode, double alpha) const {
+    TraceSpan span("RenderBlobs", "rendering");
     typedef std::map<Label, cv::Scalar> Palete;
 
     CV_Assert(imgSource.type() == CV_8UC3);
@@ -574,4 +1016,115 @@ void BlobList::RenderBlobs(const cv::Mat &imgSource, cv::Mat &imgDest, unsigned
         a_blob->RenderBlob(imgLabel, imgSource, imgDest, mode, pal[a_blob->label], alpha);
 }
 
+namespace {
+    /// \brief First pass of the batch simplification: flags the kept vertices of each polygon.
+    class SimplifyFlagsBody : public cv::ParallelLoopBody {
+    public:
+        SimplifyFlagsBody(const std::vector<const ContourPolygon *> &polygons, const std::vector<size_t> &firsts, std::vector<unsigned char> &keep, std::vector<size_t> &counts, double delta)
+            : polygons(polygons), firsts(firsts), keep(keep), counts(counts), delta(delta) {}
+
+        void operator()(const cv::Range &range) const {
+            std::vector<std::pair<int, int> > stack;
+            for (int i = range.start; i < range.end; i++) {
+                const ContourPolygon &polygon = *polygons[i];
+                counts[i] = SimplifyPolygonFlags(polygon.data(), polygon.size(), keep.data() + firsts[i], stack, delta);
+            }
+        }
+
+    private:
+        const std::vector<const ContourPolygon *> &polygons;
+        const std::vector<size_t> &firsts;
+        std::vector<unsigned char> &keep;
+        std::vector<size_t> &counts;
+        double delta;
+    };
 
+    /// \brief Second pass of the batch simplification: copies the kept vertices to the output buffer.
+    class SimplifyCopyBody : public cv::ParallelLoopBody {
+    public:
+        SimplifyCopyBody(const std::vector<const ContourPolygon *> &polygons, const std::vector<size_t> &firsts, const std::vector<unsigned char> &keep, const std::vector<size_t> &offsets, ContourPolygon &points)
+            : polygons(polygons), firsts(firsts), keep(keep), offsets(offsets), points(points) {}
+
+        void operator()(const cv::Range &range) const {
+            for (int i = range.start; i < range.end; i++) {
+                const ContourPolygon &polygon = *polygons[i];
+                const unsigned char *flags = keep.data() + firsts[i];
+                cv::Point *out = points.data() + offsets[i];
+
+                for (size_t j = 0; j < polygon.size(); j++) {
+                    if (flags[j])
+                        *out++ = polygon[j];
+                }
+            }
+        }
+
+    private:
+        const std::vector<const ContourPolygon *> &polygons;
+        const std::vector<size_t> &firsts;
+        const std::vector<unsigned char> &keep;
+        const std::vector<size_t> &offsets;
+        ContourPolygon &points;
+    };
+}  // namespace
+
+void BlobList::SimplifyPolygons(ContourPolygon &points, std::vector<size_t> &offsets, const double delta) const {
+    size_t nBlobs = blobs.size();
+
+    // Index the polygons, so that they can be processed in parallel
+    std::vector<const ContourPolygon *> polygons;
+    std::vector<size_t> firsts;
+    polygons.reserve(nBlobs);
+    firsts.reserve(nBlobs);
+
+    size_t nVertices = 0;
+    for (auto &a_blob : blobs) {
+        const ContourPolygon &polygon = a_blob->get_Contour().get_ContourPolygon();
+        polygons.push_back(&polygon);
+        firsts.push_back(nVertices);
+        nVertices += polygon.size();
+    }
+
+    std::vector<unsigned char> keep(nVertices);
+    std::vector<size_t> counts(nBlobs);
+    cv::parallel_for_(cv::Range(0, (int)nBlobs), SimplifyFlagsBody(polygons, firsts, keep, counts, delta));
+
+    offsets.resize(nBlobs + 1);
+    offsets[0] = 0;
+    for (size_t i = 0; i < nBlobs; i++)
+        offsets[i + 1] = offsets[i] + counts[i];
+
+    points.resize(offsets[nBlobs]);
+    cv::parallel_for_(cv::Range(0, (int)nBlobs), SimplifyCopyBody(polygons, firsts, keep, offsets, points));
+}
+
+namespace {
+    /// \brief Calculates the hull descriptors of a range of contours.
+    class HullDescriptorsBody : public cv::ParallelLoopBody {
+    public:
+        HullDescriptorsBody(const std::vector<const Contour *> &contours, std::vector<HullDescriptors> &descriptors)
+            : contours(contours), descriptors(descriptors) {}
+
+        void operator()(const cv::Range &range) const {
+            ContourPolygon hull;
+            for (int i = range.start; i < range.end; i++) {
+                const ContourPolygon &polygon = contours[i]->get_ContourPolygon();
+                ConvexHull(polygon.data(), polygon.size(), hull);
+                descriptors[i] = cvb::ComputeHullDescriptors(hull.data(), hull.size());
+            }
+        }
+
+    private:
+        const std::vector<const Contour *> &contours;
+        std::vector<HullDescriptors> &descriptors;
+    };
+}  // namespace
+
+void BlobList::ComputeHullDescriptors(std::vector<HullDescriptors> &descriptors) const {
+    std::vector<const Contour *> contours;
+    contours.reserve(blobs.size());
+    for (auto &a_blob : blobs)
+        contours.push_back(&a_blob->get_Contour());
+
+    descriptors.resize(contours.size());
+    cv::parallel_for_(cv::Range(0, (int)contours.size()), HullDescriptorsBody(contours, descriptors));
+}
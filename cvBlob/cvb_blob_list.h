@@ -40,6 +40,8 @@
 
 #include "cvb_blob.h"
 #include "cvb_defines.h"
+#include "cvb_memory.h"
+#include "cvb_stats.h"
 
 namespace cvb {
 
@@ -47,13 +49,34 @@ namespace cvb {
     /// A map is used to access each blob from its label number.
     /// \see Label
     /// \see CvBlob
-    typedef std::map<Label, SharedBlob> BlobsMap;
+    typedef std::map<Label, SharedBlob, std::less<Label>, ContainerAllocator<std::pair<const Label, SharedBlob>, Memory_blobs> > BlobsMap;
 
     /// \brief Pair (label, blob).
     /// \see Label
     /// \see CvBlob
     typedef std::pair<Label, SharedBlob> LabelBlob;
 
+    /// \brief What BlobList::LabelImage computes, to trade fidelity for time.
+    /// \see FidelityGovernor
+    struct CVBLOB_EXPORT LabelingOptions {
+        LabelingOptions(); ///< Full fidelity.
+
+        bool contours;           ///< Whether blob contours are recorded.
+        bool internalContours;   ///< Whether internal contours (holes) are recorded.
+        unsigned int minArea;    ///< Blobs smaller than this are dropped while labelling, before their moments are computed.
+        unsigned int downsample; ///< Downsampling factor of the mask in both directions (1 for none).
+    };
+
+    /// \brief Limits of a labelling in row bands, checked after each band.
+    /// \see BlobList::LabelBands
+    struct CVBLOB_EXPORT LabelingBudget {
+        LabelingBudget(); ///< No limit, bands of 16 rows.
+
+        double seconds;            ///< Time budget of a call, in seconds (0 for none).
+        unsigned long long pixels; ///< Pixels scanned by a call, a row counting for the image width (0 for none).
+        unsigned int bandRows;     ///< Rows per band.
+    };
+
     /// \brief Class defining a list of blobs, along with labelling
     class CVBLOB_EXPORT BlobList {
     public:
@@ -69,6 +92,58 @@ namespace cvb {
         /// \param img Input binary image (type = CV_8UC1).
         void LabelImage (const cv::Mat &img, Label max_label);
 
+        /// \brief Label the connected parts of a binary image, with some of the work left out.
+        /// Holes are traced either way, as the labelling needs it: without contours, only the chain codes are not
+        /// recorded. A downsampled mask keeps one pixel out of factor x factor; its blobs are then given in image
+        /// coordinates, each pixel standing for a block (Blob::Upscale), without contours, and so is the label image.
+        /// \param img Input binary image (type = CV_8UC1).
+        /// \param max_label Maximum number of labels.
+        /// \param options What to compute.
+        void LabelImage(const cv::Mat &img, Label max_label, const LabelingOptions &options);
+
+        /// \brief Label the connected parts of a binary image in row bands, from the top, within a budget.
+        /// Same labelling as LabelImage. When the budget runs out, the blobs list holds a consistent partial result:
+        /// the blobs lying entirely in the rows labelled are complete, and those going below are flagged as
+        /// incomplete (Blob::get_Incomplete), with the moments of their pixels labelled so far. Incomplete blobs are
+        /// copies, left as they are by ResumeLabeling. The rows below are only labelled along the contours traced.
+        /// ResumeLabeling goes on from there.
+        /// \param img Input binary image (type = CV_8UC1). It is not copied, and must not change until labelled.
+        /// \param max_label Maximum number of labels.
+        /// \param budget Limits of this call. At least one band is labelled.
+        /// \param options What to compute. The minimum area only applies to complete blobs, and downsampling is not supported.
+        /// \return True if the whole image is labelled.
+        /// \see get_LabelledRows
+        bool LabelBands(const cv::Mat &img, Label max_label, const LabelingBudget &budget,
+                        const LabelingOptions &options = LabelingOptions());
+
+        /// \brief Goes on with the labelling started by LabelBands, within a new budget.
+        /// The blobs list is rebuilt with all the blobs found so far, complete or not.
+        /// \param budget Limits of this call. At least one band is labelled.
+        /// \return True if the whole image is labelled, or if there is nothing to resume.
+        bool ResumeLabeling(const LabelingBudget &budget);
+
+        /// \brief Gets the number of rows labelled, from the top, by the last labelling.
+        /// All the rows unless the labelling stopped early: out of budget, or out of labels (LabelImage,
+        /// SimpleLabel, LabelBands and ResumeLabeling tell then where; LabelRegions gives 0).
+        /// \return The number of rows.
+        unsigned int get_LabelledRows() const;
+
+        /// \brief Tells whether the last labelling ran out of labels.
+        /// The blobs found until then are kept, those crossing the rows left unlabelled being flagged as incomplete.
+        /// \return True if some blobs were not labelled.
+        bool get_Truncated() const;
+
+        /// \brief Label the connected parts of a binary image, only inside some regions.
+        /// Same labelling as LabelImage, skipping the background outside of the regions: with few blobs in a large
+        /// image, most of the time goes there. Regions are grown until no blob crosses their sides and merged when
+        /// they overlap, so each blob found is whole, and in image coordinates. Blobs lying entirely outside of the
+        /// regions are not found, and their pixels are left unlabelled.
+        /// \param img Input binary image (type = CV_8UC1).
+        /// \param regions Regions to label, grown by GrowRegions. On return, the regions actually labelled.
+        /// \param max_label Maximum number of labels, over all the regions.
+        /// \see FocusScheduler
+        void LabelRegions(const cv::Mat &img, std::vector<cv::Rect> &regions, Label max_label);
+
         /// \brief Draw a binary image with the blobs.
         /// \param imgOut Output binary image (type = CV8UC1 and continuous).
         void FilterLabels(cv::Mat &imgOut) const;
@@ -77,6 +152,12 @@ namespace cvb {
         /// \return The blobs list.
         std::list<SharedBlob> get_BlobsList() const;
 
+        /// \brief Gets the statistics of the last labelling, and of the filters applied since.
+        /// All zero unless the library is built with CVBLOB_ENABLE_STATS.
+        /// \return The statistics.
+        /// \see LabelingStats
+        const LabelingStats &get_LabelingStats() const;
+
         /// \brief Gets the labelled picture.
         /// \return The labelled picture.
         cv::Mat get_ImageLabel() const;
@@ -115,11 +196,51 @@ namespace cvb {
         /// \see CV_BLOB_RENDER_TO_STD
         void RenderBlobs(const cv::Mat &imgSource, cv::Mat &imgDest, unsigned short mode = 0x000f, double alpha = 1.) const;
 
+        /// \brief Simplifies the contours of all the blobs, in parallel.
+        /// The simplified polygons are stored one after the other in a single buffer, in the order of the blobs list.
+        /// \param points Output buffer with the vertices of all the simplified polygons.
+        /// \param offsets Output offsets: polygon i spans points[offsets[i]] to points[offsets[i + 1]] (excluded).
+        /// \param delta Minimun distance.
+        /// \see Contour::get_SimplifiedPolygon
+        void SimplifyPolygons(ContourPolygon &points, std::vector<size_t> &offsets, const double delta = 1.) const;
+
+        /// \brief Calculates the hull descriptors of all the blobs, in parallel.
+        /// \param descriptors Output descriptors, in the order of the blobs list.
+        /// \see Contour::get_HullDescriptors
+        void ComputeHullDescriptors(std::vector<HullDescriptors> &descriptors) const;
+
     protected:
         cv::Mat imgLabel;            ///< Labelled image
+        cv::Mat mask_workspace;      ///< Downsampled mask
+        cv::Mat label_workspace;     ///< Labels of the downsampled mask
         std::list<SharedBlob> blobs; ///< Blobs list
+        LabelingStats stats;         ///< Statistics of the last labelling
+        unsigned int labelled_rows;  ///< Rows labelled by the last labelling
+        bool truncated;              ///< Whether the last labelling ran out of labels
+
+        cv::Mat pending_img;             ///< Image of a labelling in bands not finished yet
+        BlobsMap pending_blobs;          ///< Blobs found so far by a labelling in bands
+        Label pending_label;             ///< Last label used by a labelling in bands
+        Label pending_max_label;         ///< Maximum number of labels of a labelling in bands
+        LabelingOptions pending_options; ///< Options of a labelling in bands
+
+        /// \brief Labels bands of the pending image until it is done or the budget runs out, and builds the blobs list.
+        /// \param budget Limits of this call.
+        /// \return True if the whole image is labelled.
+        bool labelPendingBands(const LabelingBudget &budget);
+
+        /// \brief Forgets the labelling in bands not finished yet, if any, before another labelling.
+        /// \param rows Rows of the image of the new labelling.
+        void resetLabeling(unsigned int rows);
     };
 
+    /// \brief Grows regions of a binary image until no foreground pixel lies on their sides, so that no blob
+    /// crosses them, merging those which overlap. Regions are clipped to the image first, and empty ones dropped.
+    /// Grown regions are left as they are by a second call, at the cost of checking their sides.
+    /// \param img Input binary image (type = CV_8UC1).
+    /// \param regions Regions, grown and merged on return.
+    /// \see BlobList::LabelRegions
+    CVBLOB_EXPORT void GrowRegions(const cv::Mat &img, std::vector<cv::Rect> &regions);
 
 } // Namespace
 
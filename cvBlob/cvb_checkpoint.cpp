@@ -0,0 +1,128 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include "cvb_checkpoint.h"
+
+using namespace cvb;
+
+namespace {
+    /// \brief Writes a file through a temporary file and a rename.
+    bool writeFile(const std::string &filename, const std::vector<unsigned char> &data) {
+        std::string temporary = filename + ".tmp";
+        {
+            std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write((const char *)data.data(), (std::streamsize)data.size());
+            out.flush();
+            if (!out)
+                return false;
+        }
+
+        if (std::rename(temporary.c_str(), filename.c_str())) {
+            // Windows does not replace existing files
+            std::remove(filename.c_str());
+            if (std::rename(temporary.c_str(), filename.c_str()))
+                return false;
+        }
+        return true;
+    }
+}  // namespace
+
+Checkpointer::Checkpointer(const std::string &filename) : filename(filename), has_pending(false), busy(false),
+    stopping(false), written(0), failed(0) {
+    writer = std::thread(&Checkpointer::Run, this);
+}
+
+Checkpointer::~Checkpointer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+void Checkpointer::Submit(const TrackList &tracks) {
+    tracks.Snapshot(staging);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // The previous pending buffer, if any, is recycled for the next snapshot
+        pending.swap(staging);
+        has_pending = true;
+    }
+    wake.notify_one();
+}
+
+void Checkpointer::Flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return !has_pending && !busy; });
+}
+
+size_t Checkpointer::get_Written() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return written;
+}
+
+size_t Checkpointer::get_Failed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+void Checkpointer::Run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return has_pending || stopping; });
+        if (!has_pending)
+            break;
+
+        writing.swap(pending);
+        has_pending = false;
+        busy = true;
+
+        lock.unlock();
+        bool done = writeFile(filename, writing);
+        lock.lock();
+
+        busy = false;
+        if (done)
+            written++;
+        else
+            failed++;
+        idle.notify_all();
+    }
+}
+
+bool cvb::LoadCheckpoint(const std::string &filename, TrackList &tracks) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in)
+        return false;
+
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return tracks.Restore(data.data(), data.size());
+}
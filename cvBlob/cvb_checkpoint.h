@@ -0,0 +1,109 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+/// \file cvb_checkpoint.h
+/// \brief cvBlob tracker checkpoint header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_checkpoint.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_CHECKPOINT_H_
+#define _CVBLOB_CHECKPOINT_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cvb_defines.h"
+#include "cvb_track.h"
+
+namespace cvb {
+
+    /// \brief Writes tracker snapshots to a file in the background.
+    /// Submit takes the snapshot in the calling thread, in a reused buffer, and hands it to a writer thread: the
+    /// frame loop never waits for the disk. If the writer is still busy, a newer snapshot replaces the pending one.
+    /// Files are written to a temporary file first, then renamed, so a crash never leaves a truncated checkpoint.
+    class CVBLOB_EXPORT Checkpointer {
+    public:
+        /// \brief Constructor, starting the writer thread.
+        /// \param filename Checkpoint file.
+        Checkpointer(const std::string &filename);
+
+        /// \brief Destructor, writing the pending snapshot and stopping the writer thread.
+        ~Checkpointer();
+
+        /// \brief Takes a snapshot of a tracker, to be written in the background.
+        /// \param tracks The tracker.
+        void Submit(const TrackList &tracks);
+
+        /// \brief Waits until the submitted snapshots have been written.
+        void Flush();
+
+        /// \brief Gets the number of snapshots written.
+        /// \return The number of snapshots.
+        size_t get_Written() const;
+
+        /// \brief Gets the number of snapshots that could not be written.
+        /// \return The number of failures.
+        size_t get_Failed() const;
+
+    protected:
+        /// \brief Writer thread loop.
+        void Run();
+
+        std::string filename; ///< Checkpoint file.
+
+        std::vector<unsigned char> staging; ///< Buffer for the next snapshot (caller side).
+        std::vector<unsigned char> pending; ///< Snapshot waiting for the writer.
+        std::vector<unsigned char> writing; ///< Snapshot being written (writer side).
+        bool has_pending;                   ///< Whether pending holds a snapshot.
+        bool busy;                          ///< Whether the writer is writing.
+        bool stopping;                      ///< Whether the writer must stop.
+        size_t written;                     ///< Snapshots written.
+        size_t failed;                      ///< Snapshots not written.
+
+        mutable std::mutex mutex;          ///< Protects the buffers and the flags.
+        std::condition_variable wake;      ///< Signals a pending snapshot or the stop.
+        std::condition_variable idle;      ///< Signals the end of a write.
+        std::thread writer;                ///< Writer thread.
+
+    private:
+        Checkpointer(const Checkpointer &);
+        Checkpointer &operator=(const Checkpointer &);
+    };
+
+    /// \brief Restores a tracker from a checkpoint file.
+    /// \param filename Checkpoint file, as written by a Checkpointer.
+    /// \param tracks The tracker, left unchanged on failure.
+    /// \return False if the file cannot be read or is malformed.
+    CVBLOB_EXPORT bool LoadCheckpoint(const std::string &filename, TrackList &tracks);
+
+} // Namespace
+
+#endif // _CVBLOB_CHECKPOINT_H_
@@ -20,9 +20,10 @@
 // along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
 //
 
+#include <algorithm>
 #include <climits>
 #include <cmath>
-#include <deque>
+#include <limits>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -63,44 +64,50 @@ Contour::Contour(unsigned int x, unsigned int y, ChainCodes chainCodes) {
 
 void Contour::reset(cv::Point startingPoint, ChainCodes chainCodes) {
     starting_point = startingPoint;
-    chain_codes = chainCodes;
+    chain_codes.clear();
     polygon.clear();
 
+    orthogonal_steps = 0;
+    diagonal_steps = 0;
+    doubled_area = 0;
+
+    minx = maxx = starting_point.x;
+    miny = maxy = starting_point.y;
+
     // Initializes polygon structure
 
     // Push first point
-    cv::Point a_point = starting_point;
-    polygon.push_back(a_point);
-
-    if (chain_codes.size() != 0) {
-        ChainCode lastCode = chain_codes.front();
-        for (auto &a_chain_code : chain_codes) {
-            if (lastCode != a_chain_code) {
-                // Direction change, add new point
-                polygon.push_back(a_point);
-                lastCode = a_chain_code;
-            }
-            // Update point position
-            a_point += ChainCodeMoves[a_chain_code];
-        }
-    }
+    polygon.push_back(starting_point);
 
+    for (auto &a_chain_code : chainCodes)
+        add_ChainCode(a_chain_code);
 }
 
 void Contour::add_ChainCode(ChainCode chainCode) {
+    const cv::Point &move = ChainCodeMoves[chainCode];
+
+    // Update accumulators: the shoelace sum is not affected by collinear vertices, so it can be updated per step
+    cv::Point lastPoint = polygon.back();
+    doubled_area += (long long)lastPoint.x * move.y - (long long)lastPoint.y * move.x;
+
+    if (chainCode % 2)
+        diagonal_steps++;
+    else
+        orthogonal_steps++;
+
+    cv::Point newPoint = lastPoint + move;
+    minx = std::min(minx, newPoint.x);
+    maxx = std::max(maxx, newPoint.x);
+    miny = std::min(miny, newPoint.y);
+    maxy = std::max(maxy, newPoint.y);
+
     // Update polygon structure
-    if (chain_codes.empty()) {
-        // First element added, add one end point
-        polygon.push_back(starting_point + ChainCodeMoves[chainCode]);
-    } else {
-        ChainCode lastCode = chain_codes.back();
-        if (lastCode == chainCode)
-            // Same direction, change end point
-            polygon.back() += ChainCodeMoves[chainCode];
-        else
-            // Different direction, add a new point
-            polygon.push_back(polygon.back() + ChainCodeMoves[chainCode]);
-    }
+    if (chain_codes.empty() || chain_codes.back() != chainCode)
+        // First element added or different direction, add a new point
+        polygon.push_back(newPoint);
+    else
+        // Same direction, change end point
+        polygon.back() = newPoint;
 
     // Add chainCode to list
     this->chain_codes.push_back(chainCode);
@@ -110,11 +117,11 @@ cv::Point Contour::get_StartingPoint() const {
     return starting_point;
 }
 
-ChainCodes Contour::get_ChainCodes() const {
+const ChainCodes &Contour::get_ChainCodes() const {
     return chain_codes;
 }
 
-ContourPolygon Contour::get_ContourPolygon() const {
+const ContourPolygon &Contour::get_ContourPolygon() const {
     return polygon;
 }
 
@@ -122,26 +129,19 @@ double Contour::get_Area() const {
     if (polygon.size() <= 2)
         return 1.;
 
-    cv::Point lastPoint = polygon.back();
-    double a = 0.;
-    for (auto &a_point : polygon) {
-        a += lastPoint.x * a_point.y - lastPoint.y * a_point.x;
-        lastPoint = a_point;
-    }
+    // Closes the polygon if the contour does not end at its starting point
+    const cv::Point &lastPoint = polygon.back();
+    long long closing = (long long)lastPoint.x * starting_point.y - (long long)lastPoint.y * starting_point.x;
 
-    return a * 0.5;
+    return (doubled_area + closing) * 0.5;
 }
 
 double Contour::get_Perimeter() const {
-    double perimeter = 0.;
-    for (auto &a_chain_code : chain_codes) {
-        if (a_chain_code % 2)
-            perimeter += std::sqrt(1. + 1.);
-        else
-            perimeter += 1.;
-    }
+    return orthogonal_steps + diagonal_steps * std::sqrt(1. + 1.);
+}
 
-    return perimeter;
+cv::Rect Contour::get_BoundingBox() const {
+    return cv::Rect(minx, miny, maxx - minx + 1, maxy - miny + 1);
 }
 
 double Contour::get_Circularity() const {
@@ -154,113 +154,437 @@ double Contour::get_Circularity() const {
         return 0.;
 }
 
-// Utility function
-void simplifyPolygonRecursive(const ContourPolygon &p, int const i1, int const i2, std::vector<bool> &pnUseFlag, const double delta) {
-    int endIndex = (i2 < 0) ? (int) p.size() : i2;
+namespace {
+    /// \brief Finds the vertex of p[first+1 .. last-1] furthest from segment ab.
+    /// Branch-free inner loop over a contiguous range, so that it can be vectorized.
+    /// \return Index of the furthest vertex, along with its squared distance.
+    inline std::pair<int, double> furthestFromSegment(const cv::Point *p, int first, int last, const cv::Point &a, const cv::Point &b) {
+        const double ax = a.x;
+        const double ay = a.y;
+        const double abx = b.x - a.x;
+        const double aby = b.y - a.y;
+        const double len2 = abx * abx + aby * aby;
+        const double safeLen2 = (len2 > 0.) ? len2 : 1.;
+
+        int furtherIndex = first;
+        double furtherDistance = -1.;
+
+        for (int i = first + 1; i < last; i++) {
+            double acx = p[i].x - ax;
+            double acy = p[i].y - ay;
+            double bcx = acx - abx;
+            double bcy = acy - aby;
+
+            double t = abx * acx + aby * acy;
+            double cross = abx * acy - aby * acx;
+
+            double dA = acx * acx + acy * acy;
+            double dB = bcx * bcx + bcy * bcy;
+            double dL = cross * cross / safeLen2;
+            double d = (t <= 0.) ? dA : ((t >= len2) ? dB : dL);
+
+            bool further = d > furtherDistance;
+            furtherDistance = further ? d : furtherDistance;
+            furtherIndex = further ? i : furtherIndex;
+        }
 
-    if (std::abs((int)(i1 - endIndex))<=1)
-        return;
+        return std::make_pair(furtherIndex, furtherDistance);
+    }
+}  // namespace
+
+size_t cvb::SimplifyPolygonFlags(const cv::Point *polygon, size_t n, unsigned char *keep, std::vector<std::pair<int, int> > &stack, const double delta) {
+    stack.clear();
+    if (n == 0)
+        return 0;
+
+    std::fill(keep, keep + n, 0);
+    keep[0] = 1;
 
-    cv::Point firstPoint = p[i1];
-    cv::Point lastPoint = (i2<0)?p.front():p[i2];
+    const double delta2 = delta * delta;
+    const double x0 = polygon[0].x;
+    const double y0 = polygon[0].y;
 
+    // Start from the vertex furthest from the first one
     double furtherDistance = 0.;
     int furtherIndex = 0;
+    for (int i = 1; i < (int)n; i++) {
+        double dx = polygon[i].x - x0;
+        double dy = polygon[i].y - y0;
+        double d = dx * dx + dy * dy;
 
-    for (int i = i1 + 1; i < endIndex; i++) {
-        double d = DistanceLinePoint(firstPoint, lastPoint, p[i]);
-
-        if ((d >= delta) && (d > furtherDistance)) {
+        if (d > furtherDistance) {
             furtherDistance = d;
             furtherIndex = i;
         }
     }
 
-    if (furtherIndex) {
-        pnUseFlag[furtherIndex]=true;
+    if (furtherIndex == 0 || furtherDistance < delta2)
+        return 1;
+
+    keep[furtherIndex] = 1;
+    size_t kept = 2;
+
+    // Sub-chains, the index n stands for the first vertex (closing the polygon)
+    stack.push_back(std::make_pair(0, furtherIndex));
+    stack.push_back(std::make_pair(furtherIndex, (int)n));
+
+    while (!stack.empty()) {
+        int first = stack.back().first;
+        int last = stack.back().second;
+        stack.pop_back();
 
-        simplifyPolygonRecursive(p, i1, furtherIndex, pnUseFlag, delta);
-        simplifyPolygonRecursive(p, furtherIndex, i2, pnUseFlag, delta);
+        if (last - first <= 1)
+            continue;
+
+        const cv::Point &lastPoint = (last == (int)n) ? polygon[0] : polygon[last];
+        std::pair<int, double> further = furthestFromSegment(polygon, first, last, polygon[first], lastPoint);
+
+        if (further.second >= delta2) {
+            keep[further.first] = 1;
+            kept++;
+
+            stack.push_back(std::make_pair(further.first, last));
+            stack.push_back(std::make_pair(first, further.first));
+        }
     }
+
+    return kept;
 }
 
 ContourPolygon Contour::get_SimplifiedPolygon(const double delta) const {
-    double furtherDistance = 0.;
-    unsigned int furtherIndex = 0;
+    ContourPolygon result;
+    SimplifyWorkspace workspace;
+    get_SimplifiedPolygon(result, workspace, delta);
+
+    return result;
+}
 
-    unsigned int i = 1;
-    for (auto &a_point : polygon) {
-        double d = DistancePointPoint(a_point, polygon.front());
+void Contour::get_SimplifiedPolygon(ContourPolygon &result, SimplifyWorkspace &workspace, const double delta) const {
+    result.clear();
+    workspace.keep.resize(polygon.size());
 
-        if (d>furtherDistance) {
-            furtherDistance = d;
-            furtherIndex = i;
+    size_t kept = SimplifyPolygonFlags(polygon.data(), polygon.size(), workspace.keep.data(), workspace.stack, delta);
+    result.reserve(kept);
+
+    for (unsigned int i = 0; i < polygon.size(); i++) {
+        if (workspace.keep[i])
+            result.push_back(polygon[i]);
+    }
+}
+
+void cvb::ConvexHull(const cv::Point *polygon, size_t n, ContourPolygon &hull) {
+    hull.clear();
+
+    // Closed polygons repeat their first vertex at the end
+    while (n > 1 && polygon[n - 1] == polygon[0])
+        n--;
+
+    if (n == 0)
+        return;
+
+    // Contours are not simple polygons (they go back and forth along thin parts), so instead of Melkman the
+    // hull is built with a monotone chain over the extreme vertices of each row, which come already sorted
+    int minY = polygon[0].y;
+    int maxY = polygon[0].y;
+    for (size_t i = 1; i < n; i++) {
+        minY = std::min(minY, polygon[i].y);
+        maxY = std::max(maxY, polygon[i].y);
+    }
+
+    // Minimum and maximum x of each row are kept in the upper half of the buffer
+    size_t rows = maxY - minY + 1;
+    std::vector<cv::Point> extremes(2 * rows, cv::Point(INT_MAX, INT_MIN));
+    for (size_t i = 0; i < n; i++) {
+        cv::Point &extreme = extremes[rows + polygon[i].y - minY];
+        extreme.x = std::min(extreme.x, polygon[i].x);
+        extreme.y = std::max(extreme.y, polygon[i].x);
+    }
+
+    // Sorted points, compacted into the lower half: (y, min x) and (y, max x) of each row
+    size_t m = 0;
+    for (size_t r = 0; r < rows; r++) {
+        cv::Point extreme = extremes[rows + r];
+        if (extreme.x == INT_MAX)
+            continue;
+        extremes[m++] = cv::Point(extreme.x, minY + (int)r);
+        if (extreme.y != extreme.x)
+            extremes[m++] = cv::Point(extreme.y, minY + (int)r);
+    }
+
+    if (m == 1) {
+        hull.assign(2, extremes[0]);
+        return;
+    }
+
+    // Andrew's monotone chain, both halves in the same buffer
+    hull.resize(2 * m);
+    cv::Point *h = hull.data();
+    size_t k = 0;
+    for (size_t i = 0; i < m; i++) {
+        while (k >= 2 && CrossProductPoints(h[k - 2], h[k - 1], extremes[i]) <= 0)
+            k--;
+        h[k++] = extremes[i];
+    }
+    for (size_t i = m - 1, lower = k + 1; i-- > 0;) {
+        while (k >= lower && CrossProductPoints(h[k - 2], h[k - 1], extremes[i]) <= 0)
+            k--;
+        h[k++] = extremes[i];
+    }
+    hull.resize(k);
+}
+
+namespace {
+    /// \brief Cross product of the vectors u and v.
+    inline double cross(const cv::Point2d &u, const cv::Point2d &v) {
+        return u.x * v.y - u.y * v.x;
+    }
+
+    /// \brief Smallest circle with a and b on its boundary.
+    inline void circleFrom(const cv::Point2d &a, const cv::Point2d &b, cv::Point2d &center, double &radius2) {
+        center = cv::Point2d((a.x + b.x) * .5, (a.y + b.y) * .5);
+        radius2 = (a.x - center.x) * (a.x - center.x) + (a.y - center.y) * (a.y - center.y);
+    }
+
+    /// \brief Smallest circle with a, b and c on its boundary, or enclosing them if they are collinear.
+    inline void circleFrom(const cv::Point2d &a, const cv::Point2d &b, const cv::Point2d &c, cv::Point2d &center, double &radius2) {
+        cv::Point2d ab = b - a;
+        cv::Point2d ac = c - a;
+        double d = 2. * cross(ab, ac);
+
+        if (d == 0.) {
+            // Collinear, use the two furthest points
+            circleFrom(a, b, center, radius2);
+            cv::Point2d otherCenter;
+            double otherRadius2;
+            circleFrom(a, c, otherCenter, otherRadius2);
+            if (otherRadius2 > radius2) {
+                center = otherCenter;
+                radius2 = otherRadius2;
+            }
+            circleFrom(b, c, otherCenter, otherRadius2);
+            if (otherRadius2 > radius2) {
+                center = otherCenter;
+                radius2 = otherRadius2;
+            }
+            return;
         }
+
+        double ab2 = ab.x * ab.x + ab.y * ab.y;
+        double ac2 = ac.x * ac.x + ac.y * ac.y;
+        cv::Point2d offset((ac.y * ab2 - ab.y * ac2) / d, (ab.x * ac2 - ac.x * ab2) / d);
+        center = a + offset;
+        radius2 = offset.x * offset.x + offset.y * offset.y;
     }
 
-    if (furtherDistance<delta) {
-        ContourPolygon result;
-        result.push_back(polygon.front());
+    inline bool inCircle(const cv::Point2d &p, const cv::Point2d &center, double radius2) {
+        double dx = p.x - center.x;
+        double dy = p.y - center.y;
+        return dx * dx + dy * dy <= radius2 * (1. + 1e-12);
+    }
+}  // namespace
+
+HullDescriptors cvb::ComputeHullDescriptors(const cv::Point *hull, size_t n) {
+    HullDescriptors result;
+    result.minFeret = 0.;
+    result.maxFeret = 0.;
+    result.circleRadius = 0.;
+
+    // Open, counter-clockwise (positive area) copy of the vertices
+    while (n > 1 && hull[n - 1] == hull[0])
+        n--;
+    if (n == 0)
+        return result;
+
+    std::vector<cv::Point2d> q(hull, hull + n);
+    double area2 = 0.;
+    for (size_t i = 0; i < n; i++)
+        area2 += cross(q[i], q[(i + 1) % n]);
+    if (area2 < 0.)
+        std::reverse(q.begin(), q.end());
+
+    if (n == 1) {
+        result.minAreaRect = cv::RotatedRect(cv::Point2f((float)q[0].x, (float)q[0].y), cv::Size2f(0.f, 0.f), 0.f);
+        result.circleCenter = q[0];
+        return result;
+    }
+
+    if (n == 2 || area2 == 0.) {
+        // Segment: take its two furthest points
+        size_t a = 0;
+        size_t b = 1;
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = i + 1; j < n; j++)
+                if (cv::norm(q[i] - q[j]) > cv::norm(q[a] - q[b])) {
+                    a = i;
+                    b = j;
+                }
+        cv::Point2d d = q[b] - q[a];
+        result.maxFeret = cv::norm(d);
+        result.circleCenter = (q[a] + q[b]) * .5;
+        result.circleRadius = result.maxFeret * .5;
+        result.minAreaRect = cv::RotatedRect(cv::Point2f((float)result.circleCenter.x, (float)result.circleCenter.y), cv::Size2f((float)result.maxFeret, 0.f), (float)(std::atan2(d.y, d.x) * 180. / kPi));
         return result;
     }
 
-    std::vector<bool> pnUseFlag(polygon.size(), false);
+    // Rotating calipers: for each edge, the furthest vertex from it, and the extreme projections along it
+    double minArea = std::numeric_limits<double>::max();
+    double minWidth = std::numeric_limits<double>::max();
+    double maxDiameter2 = 0.;
 
-    pnUseFlag[0] = pnUseFlag[furtherIndex] = true;
+    size_t far = 1;   // Furthest vertex from the edge
+    size_t right = 1; // Maximum projection along the edge
+    size_t left = 0;  // Minimum projection along the edge
 
-    simplifyPolygonRecursive(polygon, 0, furtherIndex, pnUseFlag, delta);
-    simplifyPolygonRecursive(polygon, furtherIndex, -1, pnUseFlag, delta);
+    for (size_t i = 0; i < n; i++) {
+        const cv::Point2d &a = q[i];
+        const cv::Point2d &b = q[(i + 1) % n];
+        cv::Point2d e = b - a;
 
-    ContourPolygon result;
+        for (size_t steps = 0; steps < n && cross(e, q[(far + 1) % n] - a) > cross(e, q[far] - a); steps++) {
+            far = (far + 1) % n;
+            maxDiameter2 = std::max(maxDiameter2, (q[far] - a).dot(q[far] - a));
+        }
+        maxDiameter2 = std::max(maxDiameter2, (q[far] - a).dot(q[far] - a));
+        maxDiameter2 = std::max(maxDiameter2, (q[far] - b).dot(q[far] - b));
 
-    for (unsigned int i = 0; i < polygon.size(); i++) {
-        if (pnUseFlag[i])
-            result.push_back(polygon[i]);
+        for (size_t steps = 0; steps < n && e.dot(q[(right + 1) % n]) > e.dot(q[right]); steps++)
+            right = (right + 1) % n;
+
+        if (i == 0)
+            left = far;
+        for (size_t steps = 0; steps < n && e.dot(q[(left + 1) % n]) < e.dot(q[left]); steps++)
+            left = (left + 1) % n;
+
+        double length = cv::norm(e);
+        double height = cross(e, q[far] - a) / length;
+        double minProj = e.dot(q[left] - a) / length;
+        double maxProj = e.dot(q[right] - a) / length;
+        double width = maxProj - minProj;
+
+        minWidth = std::min(minWidth, height);
+
+        if (width * height < minArea) {
+            minArea = width * height;
+
+            cv::Point2d u = e * (1. / length);
+            cv::Point2d normal(-u.y, u.x);
+            cv::Point2d center = a + u * ((minProj + maxProj) * .5) + normal * (height * .5);
+
+            result.minAreaRect = cv::RotatedRect(cv::Point2f((float)center.x, (float)center.y), cv::Size2f((float)width, (float)height), (float)(std::atan2(u.y, u.x) * 180. / kPi));
+        }
     }
 
+    result.minFeret = minWidth;
+    result.maxFeret = std::sqrt(maxDiameter2);
+
+    // Minimum enclosing circle: Welzl's algorithm, iterative form, on shuffled vertices
+    unsigned int seed = 0x2545f491u;
+    for (size_t i = n - 1; i > 0; i--) {
+        seed = seed * 1664525u + 1013904223u;
+        std::swap(q[i], q[seed % (i + 1)]);
+    }
+
+    cv::Point2d center = q[0];
+    double radius2 = 0.;
+    for (size_t i = 1; i < n; i++) {
+        if (inCircle(q[i], center, radius2))
+            continue;
+        circleFrom(q[0], q[i], center, radius2);
+        for (size_t j = 0; j < i; j++) {
+            if (inCircle(q[j], center, radius2))
+                continue;
+            circleFrom(q[i], q[j], center, radius2);
+            for (size_t k = 0; k < j; k++) {
+                if (!inCircle(q[k], center, radius2))
+                    circleFrom(q[i], q[j], q[k], center, radius2);
+            }
+        }
+    }
+
+    result.circleCenter = center;
+    result.circleRadius = std::sqrt(radius2);
+
     return result;
 }
 
 ContourPolygon Contour::get_ConvexHull() const {
-    if (polygon.size() <= 3) {
-        return ContourPolygon(polygon.begin(), polygon.end());
-    }
+    ContourPolygon hull;
+    ConvexHull(polygon.data(), polygon.size(), hull);
 
-    std::deque<cv::Point> dq;
+    return hull;
+}
 
-    if (CrossProductPoints(polygon[0], polygon[1], polygon[2])>0) {
-        dq.push_back(polygon[0]);
-        dq.push_back(polygon[1]);
-    } else {
-        dq.push_back(polygon[1]);
-        dq.push_back(polygon[0]);
-    }
+HullDescriptors Contour::get_HullDescriptors() const {
+    ContourPolygon hull;
+    ConvexHull(polygon.data(), polygon.size(), hull);
 
-    dq.push_back(polygon[2]);
-    dq.push_front(polygon[2]);
+    return ComputeHullDescriptors(hull.data(), hull.size());
+}
 
-    for (unsigned int i = 3; i < polygon.size(); i++) {
-        size_t s = dq.size();
 
-        if ((CrossProductPoints(polygon[i], dq.at(0), dq.at(1))>=0) && (CrossProductPoints(dq.at(s-2), dq.at(s-1), polygon[i])>=0))
-            continue; // TODO Optimize.
+std::vector<double> Contour::get_FourierDescriptors(size_t harmonics) const {
+    std::vector<double> descriptors(harmonics, 0.);
+    if (chain_codes.empty())
+        return descriptors;
 
-        while (CrossProductPoints(dq.at(s-2), dq.at(s-1), polygon[i]) < 0) {
-            dq.pop_back();
-            s = dq.size();
-        }
+    double period = get_Perimeter();
+    double omega = 2. * kPi / period;
 
-        dq.push_back(polygon[i]);
+    // Coefficients a, b, c and d of harmonics 1 to harmonics + 1
+    size_t n = harmonics + 1;
+    std::vector<double> coefficients(4 * n, 0.);
 
-        while (CrossProductPoints(polygon[i], dq.at(0), dq.at(1))<0)
-            dq.pop_front();
+    // cos and sin of n * omega * t, at the start of the current step
+    std::vector<double> lastCos(n, 1.);
+    std::vector<double> lastSin(n, 0.);
 
-        dq.push_front(polygon[i]);
+    double t = 0.;
+    for (auto &a_chain_code : chain_codes) {
+        const cv::Point &move = ChainCodeMoves[a_chain_code];
+        double dt = (a_chain_code % 2) ? std::sqrt(1. + 1.) : 1.;
+        double dxdt = move.x / dt;
+        double dydt = move.y / dt;
+
+        t += dt;
+        double baseCos = std::cos(omega * t);
+        double baseSin = std::sin(omega * t);
+
+        // Harmonics by successive rotations
+        double c = 1.;
+        double s = 0.;
+        for (size_t h = 0; h < n; h++) {
+            double nextC = c * baseCos - s * baseSin;
+            s = s * baseCos + c * baseSin;
+            c = nextC;
+
+            double dCos = c - lastCos[h];
+            double dSin = s - lastSin[h];
+            coefficients[4 * h + 0] += dxdt * dCos;
+            coefficients[4 * h + 1] += dxdt * dSin;
+            coefficients[4 * h + 2] += dydt * dCos;
+            coefficients[4 * h + 3] += dydt * dSin;
+
+            lastCos[h] = c;
+            lastSin[h] = s;
+        }
     }
 
-    return ContourPolygon(dq.begin(), dq.end());
-}
+    // The common factor T / (2 n^2 pi^2) is left out, so it is applied only to the magnitudes
+    std::vector<double> magnitudes(n);
+    for (size_t h = 0; h < n; h++) {
+        const double *k = &coefficients[4 * h];
+        double order = (double)(h + 1);
+        magnitudes[h] = std::sqrt(k[0] * k[0] + k[1] * k[1] + k[2] * k[2] + k[3] * k[3]) / (order * order);
+    }
 
+    if (magnitudes[0] <= std::numeric_limits<double>::epsilon() * period)
+        return descriptors;
+
+    for (size_t h = 0; h < harmonics; h++)
+        descriptors[h] = magnitudes[h + 1] / magnitudes[0];
+
+    return descriptors;
+}
 
 void Contour::RenderContour(cv::Mat &img, const cv::Scalar &color) const {
     CV_Assert(img.type() == CV_8UC3 && img.isContinuous());
@@ -286,26 +610,10 @@ void Contour::WriteCSV(const std::string &filename) const {
 }
 
 void Contour::WriteSVG(const std::string &filename, const cv::Scalar &stroke, const cv::Scalar &fill) const {
-    int minx=INT_MAX;
-    int miny=INT_MAX;
-    int maxx=INT_MIN;
-    int maxy=INT_MIN;
-
     std::stringstream buffer("");
 
-    for (auto &a_point : polygon) {
-        if (a_point.x > maxx)
-            maxx = a_point.x;
-        if (a_point.x < minx)
-            minx = a_point.x;
-
-        if (a_point.y > maxy)
-            maxy = a_point.y;
-        if (a_point.y < miny)
-            miny = a_point.y;
-
+    for (auto &a_point : polygon)
         buffer << a_point.x << "," << a_point.y << " ";
-    }
 
     std::ofstream f (filename);
 
@@ -325,6 +633,111 @@ void Contour::Print(std::ostream &out) const {
         out << a_point.x << ", " << a_point.y << std::endl;
 }
 
+namespace {
+    /// \brief Adds the crossings and pixels of a contour path.
+    /// A step crosses the row of its upper point (half-open rule), so that each crossing lies on a contour pixel.
+    void addContourEvents(const Contour &contour, std::vector<cv::Point> &crossings, std::vector<cv::Point> &pixels) {
+        cv::Point a_point = contour.get_StartingPoint();
+        pixels.push_back(a_point);
+
+        for (auto &a_chain_code : contour.get_ChainCodes()) {
+            cv::Point next = a_point + ChainCodeMoves[a_chain_code];
+            if (next.y != a_point.y)
+                crossings.push_back(next.y > a_point.y ? a_point : next);
+            pixels.push_back(next);
+            a_point = next;
+        }
+    }
+
+    /// \brief Sorts points by row and then by column. Rows are counting-sorted, in [first, first + rows).
+    void sortByRow(std::vector<cv::Point> &points, int first, size_t rows, std::vector<size_t> &offsets) {
+        offsets.assign(rows + 1, 0);
+        for (auto &a_point : points)
+            offsets[a_point.y - first + 1]++;
+        for (size_t r = 0; r < rows; r++)
+            offsets[r + 1] += offsets[r];
+
+        std::vector<cv::Point> sorted(points.size());
+        std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+        for (auto &a_point : points)
+            sorted[next[a_point.y - first]++] = a_point;
+
+        for (size_t r = 0; r < rows; r++) {
+            std::sort(sorted.begin() + offsets[r], sorted.begin() + offsets[r + 1],
+                      [](const cv::Point &a, const cv::Point &b) { return a.x < b.x; });
+        }
+
+        points.swap(sorted);
+    }
+
+    /// \brief Appends a run, merging it with the previous one when they touch.
+    inline void appendRun(Runs &runs, int y, int x0, int x1) {
+        if (!runs.empty() && runs.back().y == y && x0 <= runs.back().x1 + 1) {
+            runs.back().x1 = std::max(runs.back().x1, x1);
+        } else {
+            Run run = { y, x0, x1 };
+            runs.push_back(run);
+        }
+    }
+}  // namespace
+
+void cvb::RasterizeContours(const Contour &contour, const ContoursList &internalContours, Runs &runs) {
+    runs.clear();
+
+    std::vector<cv::Point> crossings;
+    std::vector<cv::Point> pixels;
+    addContourEvents(contour, crossings, pixels);
+    for (auto &a_contour : internalContours)
+        addContourEvents(*a_contour, crossings, pixels);
+
+    // Internal contours are inside the external one
+    cv::Rect box = contour.get_BoundingBox();
+    size_t rows = box.height;
+
+    std::vector<size_t> crossingOffsets;
+    std::vector<size_t> pixelOffsets;
+    sortByRow(crossings, box.y, rows, crossingOffsets);
+    sortByRow(pixels, box.y, rows, pixelOffsets);
+
+    for (size_t r = 0; r < rows; r++) {
+        int y = box.y + (int)r;
+
+        // Merge the spans between pairs of crossings with the contour pixels, both sorted by column
+        size_t c = crossingOffsets[r];
+        size_t cEnd = crossingOffsets[r + 1];
+        size_t p = pixelOffsets[r];
+        size_t pEnd = pixelOffsets[r + 1];
+
+        while (c + 1 < cEnd || p < pEnd) {
+            if (p < pEnd && (c + 1 >= cEnd || pixels[p].x < crossings[c].x)) {
+                appendRun(runs, y, pixels[p].x, pixels[p].x);
+                p++;
+            } else {
+                appendRun(runs, y, crossings[c].x, crossings[c + 1].x);
+                c += 2;
+            }
+        }
+    }
+}
+
+void cvb::FillRuns(const Runs &runs, cv::Mat &mask, const cv::Point &offset, unsigned char value) {
+    CV_Assert(mask.type() == CV_8UC1);
+
+    for (auto &a_run : runs) {
+        int y = a_run.y - offset.y;
+        if (y < 0 || y >= mask.rows)
+            continue;
+
+        int x0 = std::max(a_run.x0 - offset.x, 0);
+        int x1 = std::min(a_run.x1 - offset.x, mask.cols - 1);
+        if (x0 > x1)
+            continue;
+
+        unsigned char *row = mask.ptr<unsigned char>(y);
+        std::fill(row + x0, row + x1 + 1, value);
+    }
+}
+
 std::ostream &operator<< (std::ostream &output, const Contour &p) {
     p.Print(output);
     return output;
@@ -37,10 +37,13 @@
 #include <memory>
 #include <atomic>
 #include <mutex>
+#include <utility>
+#include <vector>
 
 #include <opencv2/core/core.hpp>
 
 #include "cvb_defines.h"
+#include "cvb_memory.h"
 
 namespace cvb {
 
@@ -60,11 +63,63 @@ namespace cvb {
     };
 
     /// \brief Chain code list.
-    typedef std::list<ChainCode> ChainCodes;
+    typedef std::list<ChainCode, ContainerAllocator<ChainCode, Memory_contours> > ChainCodes;
 
     /// \brief Polygon based contour.
     typedef std::vector<cv::Point> ContourPolygon;
 
+    /// \brief Scratch buffers for the polygon simplification.
+    /// Reusing the same workspace across calls avoids any allocation once it has grown to the longest contour.
+    struct CVBLOB_EXPORT SimplifyWorkspace {
+        std::vector<std::pair<int, int> > stack; ///< Pending sub-chains (first and last vertex indexes).
+        std::vector<unsigned char> keep;          ///< Per-vertex flags, set for kept vertices.
+    };
+
+    /// \brief Flags the vertices kept by the Ramer-Douglas-Peucker simplification of a closed polygon.
+    /// Iterative version working on squared distances, with an explicit stack.
+    /// \param polygon Polygon vertices.
+    /// \param n Number of vertices.
+    /// \param keep Output flags (n values), set to 1 for kept vertices and 0 otherwise.
+    /// \param stack Scratch stack, cleared on entry.
+    /// \param delta Minimun distance.
+    /// \return Number of kept vertices.
+    CVBLOB_EXPORT size_t SimplifyPolygonFlags(const cv::Point *polygon, size_t n, unsigned char *keep, std::vector<std::pair<int, int> > &stack, const double delta = 1.);
+
+    /// \brief Descriptors derived from the convex hull of a contour.
+    /// Distances are measured between pixel centers.
+    struct CVBLOB_EXPORT HullDescriptors {
+        cv::RotatedRect minAreaRect; ///< Minimum area rotated rectangle. Its angle is the one of its width side, in degrees.
+        double minFeret;             ///< Minimum Feret diameter (minimum caliper width).
+        double maxFeret;             ///< Maximum Feret diameter.
+        cv::Point2d circleCenter;    ///< Center of the minimum enclosing circle.
+        double circleRadius;         ///< Radius of the minimum enclosing circle.
+    };
+
+    /// \brief Calculates the convex hull of a contour polygon.
+    /// Linear in the number of vertices plus the polygon height: a monotone chain over the extreme vertices
+    /// of each row, on a contiguous buffer. The polygon does not need to be simple. Collinear vertices are not kept.
+    /// \param polygon Polygon vertices.
+    /// \param n Number of vertices.
+    /// \param hull Output hull, counter-clockwise and closed (the first vertex is repeated at the end), empty if n is 0.
+    CVBLOB_EXPORT void ConvexHull(const cv::Point *polygon, size_t n, ContourPolygon &hull);
+
+    /// \brief Calculates the hull descriptors of a convex polygon, in linear time.
+    /// Uses rotating calipers for the rectangle and Feret diameters, and Welzl's algorithm for the circle.
+    /// \param hull Convex polygon vertices, as returned by ConvexHull.
+    /// \param n Number of vertices.
+    /// \return The hull descriptors.
+    CVBLOB_EXPORT HullDescriptors ComputeHullDescriptors(const cv::Point *hull, size_t n);
+
+    /// \brief Horizontal run of pixels.
+    struct CVBLOB_EXPORT Run {
+        int y;  ///< Row.
+        int x0; ///< First column.
+        int x1; ///< Last column (included).
+    };
+
+    /// \brief Run list, sorted by row and then by column.
+    typedef std::vector<Run> Runs;
+
     /// \brief Contour class.
     class CVBLOB_EXPORT Contour {
     public:
@@ -98,20 +153,26 @@ namespace cvb {
 
         /// \brief Gets the list of chain codes.
         /// \return The list of chain codes
-        ChainCodes get_ChainCodes() const;
+        const ChainCodes &get_ChainCodes() const;
 
         /// \brief Returns a polygon structure.
         /// \return A polygon.
-        ContourPolygon get_ContourPolygon() const;
+        const ContourPolygon &get_ContourPolygon() const;
 
-        /// \brief Calculates area of a contour.
+        /// \brief Gets the area of a contour.
+        /// Kept up to date by add_ChainCode, constant time.
         /// \return Area of the contour.
         double get_Area() const;
 
-        /// \brief Calculates perimeter of a contour.
+        /// \brief Gets the perimeter of a contour.
+        /// Kept up to date by add_ChainCode, constant time.
         /// \return Perimeter of the contour.
         double get_Perimeter() const;
 
+        /// \brief Gets the bounding box of the contour points.
+        /// \return Bounding box, including its last row and column.
+        cv::Rect get_BoundingBox() const;
+
         /// \brief Calculates the circularity of a contour (compactness measure).
         /// \return Circularity: a non-negative value, where 0 correspond with a circumference.
         double get_Circularity() const;
@@ -122,11 +183,31 @@ namespace cvb {
         /// \return A simplify version of the original polygon.
         ContourPolygon get_SimplifiedPolygon(const double delta = 1.) const;
 
+        /// \brief Calculates a simplified polygon structure, without allocating once the buffers have grown.
+        /// \param result Output polygon, cleared on entry.
+        /// \param workspace Scratch buffers.
+        /// \param delta Minimun distance.
+        /// \see get_SimplifiedPolygon
+        void get_SimplifiedPolygon(ContourPolygon &result, SimplifyWorkspace &workspace, const double delta = 1.) const;
+
         /// \brief Calculates convex hull of a contour.
-        /// Uses the Melkman Algorithm. Code based on the version in http://w3.impa.br/~rdcastan/Cgeometry/.
         /// \return Convex hull.
+        /// \see ConvexHull
         ContourPolygon get_ConvexHull() const;
 
+        /// \brief Calculates the minimum area rectangle, Feret diameters and minimum enclosing circle of a contour.
+        /// All of them are computed from the convex hull.
+        /// \return The hull descriptors.
+        /// \see ComputeHullDescriptors
+        HullDescriptors get_HullDescriptors() const;
+
+        /// \brief Calculates the elliptic Fourier descriptors of the chain codes (Kuhl and Giardina).
+        /// For each harmonic n, sqrt(an^2 + bn^2 + cn^2 + dn^2), divided by the one of the first harmonic:
+        /// invariant to translation, rotation, scale and starting point.
+        /// \param harmonics Number of descriptors, for harmonics 2 to harmonics + 1.
+        /// \return The descriptors, all zero for contours without area.
+        std::vector<double> get_FourierDescriptors(size_t harmonics) const;
+
         /// \brief Draw a contour.
         /// \param img Image to draw on, must be of type CV_8UC3, and continuous.
         /// \param color Color to draw with (default, white).
@@ -150,10 +231,35 @@ namespace cvb {
         cv::Point starting_point;  ///< Point where contour begins.
         ChainCodes chain_codes;    ///< Polygon description based on chain codes.
         ContourPolygon polygon;    ///< Polygon description based on cv::Point.
+
+        unsigned int orthogonal_steps; ///< Number of orthogonal chain codes.
+        unsigned int diagonal_steps;   ///< Number of diagonal chain codes.
+        long long doubled_area;        ///< Shoelace sum of the chain code steps (twice the signed area).
+
+        int minx; ///< X min.
+        int maxx; ///< X max.
+        int miny; ///< Y min.
+        int maxy; ///< Y max.
     };
 
     typedef std::shared_ptr<Contour> SharedContour; ///< Shared contour.
-    typedef std::list<SharedContour> ContoursList;  ///< List of contours (chain codes type).
+    typedef std::list<SharedContour, ContainerAllocator<SharedContour, Memory_contours> > ContoursList; ///< List of contours (chain codes type).
+
+    /// \brief Rasterizes the region enclosed by a contour and its internal contours.
+    /// Even-odd scanline fill of the chain code paths, so holes are left out. Contour pixels are always part of
+    /// the region, which gives back exactly the pixels of a labelled blob from its contours.
+    /// \param contour External contour.
+    /// \param internalContours Internal contours (holes).
+    /// \param runs Output runs, cleared on entry.
+    CVBLOB_EXPORT void RasterizeContours(const Contour &contour, const ContoursList &internalContours, Runs &runs);
+
+    /// \brief Sets the pixels of runs in a mask.
+    /// Pixels outside of the mask are ignored.
+    /// \param runs Runs to draw.
+    /// \param mask Mask (type = CV_8UC1), can be a ROI of a larger image.
+    /// \param offset Image coordinates of the top-left pixel of the mask.
+    /// \param value Value to set.
+    CVBLOB_EXPORT void FillRuns(const Runs &runs, cv::Mat &mask, const cv::Point &offset = cv::Point(0, 0), unsigned char value = 255);
 
     /// \brief Overload operator "<<" for printing polygons in CSV format.
     /// \return Stream.
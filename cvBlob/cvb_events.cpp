@@ -0,0 +1,305 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "cvb_events.h"
+
+using namespace cvb;
+
+namespace {
+    /// \brief Cross product of (b - a) and (p - a): positive when p is on the right of a->b, with the y axis down.
+    inline double side(const cv::Point2d &a, const cv::Point2d &b, const cv::Point2d &p) {
+        return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+    }
+
+    /// \brief Even-odd point in polygon test.
+    bool pointInPolygon(const std::vector<cv::Point2d> &polygon, const cv::Point2d &p) {
+        bool inside = false;
+        size_t n = polygon.size();
+        for (size_t i = 0, j = n - 1; i < n; j = i++) {
+            const cv::Point2d &a = polygon[i];
+            const cv::Point2d &b = polygon[j];
+            if ((a.y > p.y) != (b.y > p.y) && p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y))
+                inside = !inside;
+        }
+        return inside;
+    }
+}  // namespace
+
+EventEngine::EventEngine() : grid_built(false), cell_size(1.), cols(0), rows(0), stamp(0), frame(0) {}
+
+size_t EventEngine::add_Zone(const std::vector<cv::Point2d> &polygon, unsigned int dwellFrames) {
+    CV_Assert(polygon.size() >= 3);
+
+    Zone zone;
+    zone.points = polygon;
+    zone.tripwire = false;
+    zone.dwell = dwellFrames;
+    zone.minx = zone.maxx = polygon[0].x;
+    zone.miny = zone.maxy = polygon[0].y;
+    for (auto &a_point : polygon) {
+        zone.minx = std::min(zone.minx, a_point.x);
+        zone.miny = std::min(zone.miny, a_point.y);
+        zone.maxx = std::max(zone.maxx, a_point.x);
+        zone.maxy = std::max(zone.maxy, a_point.y);
+    }
+
+    zones.push_back(zone);
+    grid_built = false;
+    return zones.size() - 1;
+}
+
+size_t EventEngine::add_Tripwire(const cv::Point2d &a, const cv::Point2d &b) {
+    Zone zone;
+    zone.points.push_back(a);
+    zone.points.push_back(b);
+    zone.tripwire = true;
+    zone.dwell = 0;
+    zone.minx = std::min(a.x, b.x);
+    zone.miny = std::min(a.y, b.y);
+    zone.maxx = std::max(a.x, b.x);
+    zone.maxy = std::max(a.y, b.y);
+
+    zones.push_back(zone);
+    grid_built = false;
+    return zones.size() - 1;
+}
+
+size_t EventEngine::get_ZoneCount() const {
+    return zones.size();
+}
+
+void EventEngine::BuildGrid() {
+    grid_built = true;
+    cell_starts.assign(1, 0);
+    cell_zones.clear();
+    stamps.assign(zones.size(), 0);
+    stamp = 0;
+    cols = rows = 0;
+    if (zones.empty())
+        return;
+
+    double minx = zones[0].minx, miny = zones[0].miny, maxx = zones[0].maxx, maxy = zones[0].maxy;
+    double extent = 0.;
+    for (auto &a_zone : zones) {
+        minx = std::min(minx, a_zone.minx);
+        miny = std::min(miny, a_zone.miny);
+        maxx = std::max(maxx, a_zone.maxx);
+        maxy = std::max(maxy, a_zone.maxy);
+        extent += std::max(a_zone.maxx - a_zone.minx, a_zone.maxy - a_zone.miny);
+    }
+
+    // Cells of the mean zone size, and no more cells than a few per zone
+    cell_size = std::max(1., extent / zones.size());
+    double maxCells = 4. * zones.size() + 16.;
+    while (((maxx - minx) / cell_size + 1.) * ((maxy - miny) / cell_size + 1.) > maxCells)
+        cell_size *= 2.;
+    cols = (int)((maxx - minx) / cell_size) + 1;
+    rows = (int)((maxy - miny) / cell_size) + 1;
+    grid_origin = cv::Point2d(minx, miny);
+
+    // Counting sort of the (cell, zone) entries
+    std::vector<size_t> counts((size_t)cols * rows + 1, 0);
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t z = 0; z < zones.size(); z++) {
+            const Zone &zone = zones[z];
+            int c0 = (int)((zone.minx - minx) / cell_size), c1 = (int)((zone.maxx - minx) / cell_size);
+            int r0 = (int)((zone.miny - miny) / cell_size), r1 = (int)((zone.maxy - miny) / cell_size);
+            for (int r = r0; r <= r1; r++) {
+                for (int c = c0; c <= c1; c++) {
+                    size_t cell = (size_t)r * cols + c;
+                    if (pass)
+                        cell_zones[counts[cell]++] = z;
+                    else
+                        counts[cell + 1]++;
+                }
+            }
+        }
+        if (!pass) {
+            for (size_t k = 1; k < counts.size(); k++)
+                counts[k] += counts[k - 1];
+            cell_starts = counts;
+            cell_zones.resize(counts.back());
+        }
+    }
+}
+
+void EventEngine::FindZones(double minx, double miny, double maxx, double maxy, std::vector<size_t> &found) {
+    if (!grid_built)
+        BuildGrid();
+    found.clear();
+    if (zones.empty())
+        return;
+
+    int c0 = std::max(0, (int)std::floor((minx - grid_origin.x) / cell_size));
+    int c1 = std::min(cols - 1, (int)std::floor((maxx - grid_origin.x) / cell_size));
+    int r0 = std::max(0, (int)std::floor((miny - grid_origin.y) / cell_size));
+    int r1 = std::min(rows - 1, (int)std::floor((maxy - grid_origin.y) / cell_size));
+    if (c0 > c1 || r0 > r1)
+        return;
+
+    if (!++stamp) {
+        std::fill(stamps.begin(), stamps.end(), 0);
+        stamp = 1;
+    }
+
+    for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++) {
+            size_t cell = (size_t)r * cols + c;
+            for (size_t k = cell_starts[cell]; k < cell_starts[cell + 1]; k++) {
+                size_t z = cell_zones[k];
+                const Zone &zone = zones[z];
+                if (stamps[z] == stamp || zone.maxx < minx || zone.minx > maxx || zone.maxy < miny || zone.miny > maxy)
+                    continue;
+                stamps[z] = stamp;
+                found.push_back(z);
+            }
+        }
+    }
+    std::sort(found.begin(), found.end());
+}
+
+void EventEngine::add_Event(EventType type, TrackID track, size_t zone, const cv::Point2d &position, int direction) {
+    Event event;
+    event.type = type;
+    event.track = track;
+    event.zone = zone;
+    event.frame = frame;
+    event.position = position;
+    event.direction = direction;
+    events.push_back(event);
+}
+
+void EventEngine::BeginUpdate(uint32_t frame) {
+    this->frame = frame;
+    events.clear();
+}
+
+void EventEngine::update_Track(TrackID id, const cv::Point2d &position) {
+    auto it = states.find(id);
+    if (it == states.end()) {
+        TrackState &state = states[id];
+        state.position = position;
+
+        FindZones(position.x, position.y, position.x, position.y, found);
+        for (auto z : found) {
+            const Zone &zone = zones[z];
+            if (zone.tripwire || !pointInPolygon(zone.points, position))
+                continue;
+            Presence presence = {z, frame};
+            state.presences.push_back(presence);
+            if (zone.dwell) {
+                Dwell dwell = {frame + zone.dwell, frame, id, z};
+                dwells.push(dwell);
+            }
+        }
+        return;
+    }
+
+    TrackState &state = it->second;
+    cv::Point2d from = state.position;
+    if (from == position)
+        return;
+    state.position = position;
+
+    FindZones(std::min(from.x, position.x), std::min(from.y, position.y), std::max(from.x, position.x), std::max(from.y, position.y), found);
+    for (auto z : found) {
+        const Zone &zone = zones[z];
+
+        if (zone.tripwire) {
+            const cv::Point2d &a = zone.points[0];
+            const cv::Point2d &b = zone.points[1];
+            bool rightBefore = side(a, b, from) > 0.;
+            bool rightAfter = side(a, b, position) > 0.;
+            if (rightBefore == rightAfter)
+                continue;
+            // The movement must also separate the tripwire ends
+            double sa = side(from, position, a);
+            double sb = side(from, position, b);
+            if ((sa > 0. && sb > 0.) || (sa < 0. && sb < 0.))
+                continue;
+            add_Event(EventType_cross, id, z, position, rightAfter ? 1 : -1);
+            continue;
+        }
+
+        bool inside = pointInPolygon(zone.points, position);
+        auto presence = std::find_if(state.presences.begin(), state.presences.end(), [z](const Presence &p) { return p.zone == z; });
+        bool wasInside = presence != state.presences.end();
+        if (inside && !wasInside) {
+            Presence newPresence = {z, frame};
+            state.presences.push_back(newPresence);
+            add_Event(EventType_enter, id, z, position);
+            if (zone.dwell) {
+                Dwell dwell = {frame + zone.dwell, frame, id, z};
+                dwells.push(dwell);
+            }
+        } else if (!inside && wasInside) {
+            state.presences.erase(presence);
+            add_Event(EventType_exit, id, z, position);
+        }
+    }
+}
+
+void EventEngine::remove_Track(TrackID id) {
+    // Pending dwells of the track are dropped when due
+    states.erase(id);
+}
+
+void EventEngine::clear() {
+    states.clear();
+    dwells = std::priority_queue<Dwell>();
+    events.clear();
+}
+
+void EventEngine::EndUpdate() {
+    while (!dwells.empty() && dwells.top().due <= frame) {
+        Dwell dwell = dwells.top();
+        dwells.pop();
+
+        auto it = states.find(dwell.track);
+        if (it == states.end())
+            continue;
+        for (auto &a_presence : it->second.presences) {
+            if (a_presence.zone == dwell.zone && a_presence.since == dwell.since)
+                add_Event(EventType_dwell, dwell.track, dwell.zone, it->second.position);
+        }
+    }
+}
+
+const std::vector<Event> &EventEngine::get_Events() const {
+    return events;
+}
+
+bool EventEngine::IsInside(TrackID id, size_t zone) const {
+    auto it = states.find(id);
+    if (it == states.end())
+        return false;
+
+    for (auto &a_presence : it->second.presences) {
+        if (a_presence.zone == zone)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,188 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+/// \file cvb_events.h
+/// \brief cvBlob zone and tripwire events header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_events.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_EVENTS_H_
+#define _CVBLOB_EVENTS_H_
+
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "cvb_defines.h"
+#include "cvb_trajectory.h"
+
+namespace cvb {
+
+    /// \brief Type of event.
+    CVBLOB_EXPORT enum EventType {
+        EventType_enter = 0, ///< A track entered a zone.
+        EventType_exit  = 1, ///< A track left a zone.
+        EventType_cross = 2, ///< A track crossed a tripwire.
+        EventType_dwell = 3, ///< A track has been in a zone for its dwell time.
+    };
+
+    /// \brief Zone or tripwire event.
+    struct CVBLOB_EXPORT Event {
+        EventType type;       ///< Type of event.
+        TrackID track;        ///< Track identification number.
+        size_t zone;          ///< Zone or tripwire, as returned by EventEngine::add_Zone or EventEngine::add_Tripwire.
+        uint32_t frame;       ///< Frame of the event.
+        cv::Point2d position; ///< Position of the track.
+        int direction;        ///< For crossings, 1 from the left to the right of the tripwire (looking from its first point), -1 otherwise.
+    };
+
+    /// \brief Generates the zone and tripwire events of moving tracks.
+    /// Zones are indexed by a uniform grid of their bounding boxes. Only the segment moved by each track since the
+    /// last update is tested, against the zones whose cells it covers, so the cost grows with the number of moving
+    /// tracks and nearby zones rather than with tracks x zones. Dwell events are scheduled when a track enters a zone.
+    /// \see TrackList::set_EventEngine
+    class CVBLOB_EXPORT EventEngine {
+    public:
+        EventEngine();
+
+        /// \brief Adds a polygonal zone.
+        /// \param polygon Zone vertices (at least 3).
+        /// \param dwellFrames Frames after which a track still in the zone generates a dwell event (0 for none).
+        /// \return Id of the zone.
+        size_t add_Zone(const std::vector<cv::Point2d> &polygon, unsigned int dwellFrames = 0);
+
+        /// \brief Adds a tripwire.
+        /// \param a First point.
+        /// \param b Second point.
+        /// \return Id of the tripwire.
+        size_t add_Tripwire(const cv::Point2d &a, const cv::Point2d &b);
+
+        /// \brief Gets the number of zones and tripwires.
+        /// \return The number of zones.
+        size_t get_ZoneCount() const;
+
+        /// \brief Starts an update, clearing the events of the previous one.
+        /// \param frame Frame number.
+        void BeginUpdate(uint32_t frame);
+
+        /// \brief Moves a track. A new track only gets its zones, without events.
+        /// \param id Track identification number.
+        /// \param position New position of the track.
+        void update_Track(TrackID id, const cv::Point2d &position);
+
+        /// \brief Forgets a track, without events.
+        /// \param id Track identification number.
+        void remove_Track(TrackID id);
+
+        /// \brief Forgets all the tracks and their pending dwell events, without events. Zones are kept.
+        void clear();
+
+        /// \brief Ends an update, generating the dwell events due.
+        void EndUpdate();
+
+        /// \brief Gets the events of the last update, in order of generation.
+        /// \return The events.
+        const std::vector<Event> &get_Events() const;
+
+        /// \brief Whether a track is in a zone.
+        /// \param id Track identification number.
+        /// \param zone Zone id.
+        /// \return True if the track is in the zone.
+        bool IsInside(TrackID id, size_t zone) const;
+
+    protected:
+        /// \brief Zone or tripwire.
+        struct Zone {
+            std::vector<cv::Point2d> points; ///< Polygon vertices, or the two tripwire points.
+            bool tripwire;                   ///< Whether it is a tripwire.
+            unsigned int dwell;              ///< Dwell time, in frames.
+            double minx, miny, maxx, maxy;   ///< Bounding box.
+        };
+
+        /// \brief Zone a track is in.
+        struct Presence {
+            size_t zone;    ///< Zone id.
+            uint32_t since; ///< Frame the track entered the zone.
+        };
+
+        /// \brief State of a track.
+        struct TrackState {
+            cv::Point2d position;            ///< Last position.
+            std::vector<Presence> presences; ///< Zones the track is in.
+        };
+
+        /// \brief Pending dwell event.
+        struct Dwell {
+            uint32_t due;   ///< Frame of the event.
+            uint32_t since; ///< Frame the track entered the zone.
+            TrackID track;  ///< Track identification number.
+            size_t zone;    ///< Zone id.
+
+            bool operator<(const Dwell &other) const {
+                return due > other.due;
+            }
+        };
+
+        /// \brief Builds the grid of the zones.
+        void BuildGrid();
+
+        /// \brief Collects the zones whose cells intersect a box, each once.
+        void FindZones(double minx, double miny, double maxx, double maxy, std::vector<size_t> &found);
+
+        /// \brief Adds an event.
+        void add_Event(EventType type, TrackID track, size_t zone, const cv::Point2d &position, int direction = 0);
+
+        std::vector<Zone> zones; ///< Zones and tripwires.
+
+        bool grid_built;                 ///< Whether the grid is up to date.
+        cv::Point2d grid_origin;         ///< Top-left corner of the grid.
+        double cell_size;                ///< Side of the cells.
+        int cols;                        ///< Number of columns.
+        int rows;                        ///< Number of rows.
+        std::vector<size_t> cell_starts; ///< First entry of each cell in cell_zones (cols * rows + 1 values).
+        std::vector<size_t> cell_zones;  ///< Zones of each cell.
+        std::vector<uint32_t> stamps;    ///< Last query of each zone.
+        uint32_t stamp;                  ///< Current query.
+
+        std::unordered_map<TrackID, TrackState> states; ///< State of each track.
+        std::priority_queue<Dwell> dwells;              ///< Pending dwell events, earliest first.
+
+        uint32_t frame;             ///< Current frame.
+        std::vector<Event> events;  ///< Events of the last update.
+        std::vector<size_t> found;  ///< Scratch buffer for the zone queries.
+    };
+
+    typedef std::shared_ptr<EventEngine> SharedEventEngine; ///< Shared event engine.
+
+} // Namespace
+
+#endif // _CVBLOB_EVENTS_H_
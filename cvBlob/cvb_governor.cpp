@@ -0,0 +1,141 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <algorithm>
+#include <chrono>
+
+#include "cvb_governor.h"
+#include "cvb_trace.h"
+
+using namespace cvb;
+
+namespace {
+    // Bounds of the cost ratio between two levels: a level never costs more than the one above
+    const double kMinRatio = 1.;
+    const double kMaxRatio = 16.;
+
+    // Cost ratio between two levels until measured
+    const double kDefaultRatio = 1.25;
+
+    // Longest hold, in multiples of GovernorSettings::holdFrames
+    const unsigned int kMaxHoldFactor = 64;
+}  // namespace
+
+GovernorSettings::GovernorSettings() : target(0.), headroom(.7), smoothing(.3), holdFrames(30), minArea(20),
+    downsample(2), lowest(Fidelity_downsampled) {}
+
+FidelityGovernor::FidelityGovernor(const GovernorSettings &settings) : settings(settings) {
+    this->settings.holdFrames = std::max(1u, settings.holdFrames);
+    this->settings.lowest = std::min(std::max(Fidelity_full, settings.lowest), Fidelity_downsampled);
+    Reset();
+}
+
+GovernedLabeling FidelityGovernor::LabelImage(BlobList &blobs, const cv::Mat &img, Label max_label) {
+    GovernedLabeling result;
+    result.fidelity = fidelity;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    blobs.LabelImage(img, max_label, get_Options());
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.next = add_Frame(result.seconds);
+    return result;
+}
+
+Fidelity FidelityGovernor::add_Frame(double seconds) {
+    // The first frame at a new level gives the cost ratio with the level it comes from
+    if (!frames && cost_before > 0. && seconds > 0.) {
+        if (stepped_up)
+            ratios[fidelity + 1] = std::min(kMaxRatio, std::max(kMinRatio, seconds / cost_before));
+        else if (fidelity > Fidelity_full)
+            ratios[fidelity] = std::min(kMaxRatio, std::max(kMinRatio, cost_before / seconds));
+    }
+    cost = frames ? (1. - settings.smoothing) * cost + settings.smoothing * seconds : seconds;
+    frames++;
+
+    if (settings.target <= 0.)
+        return fidelity;
+
+    if (cost > settings.target) {
+        if (fidelity < settings.lowest)
+            set_Fidelity((Fidelity)(fidelity + 1));
+    }
+    else if (fidelity > Fidelity_full && frames >= hold && cost * ratios[fidelity] < settings.headroom * settings.target)
+        set_Fidelity((Fidelity)(fidelity - 1));
+
+    return fidelity;
+}
+
+Fidelity FidelityGovernor::get_Fidelity() const {
+    return fidelity;
+}
+
+LabelingOptions FidelityGovernor::get_Options(Fidelity fidelity) const {
+    LabelingOptions options = settings.options;
+    if (fidelity >= Fidelity_noHoles)
+        options.internalContours = false;
+    if (fidelity >= Fidelity_noContours)
+        options.contours = false;
+    if (fidelity >= Fidelity_minArea)
+        options.minArea = std::max(options.minArea, settings.minArea);
+    if (fidelity >= Fidelity_downsampled)
+        options.downsample = std::max(options.downsample, settings.downsample);
+    return options;
+}
+
+LabelingOptions FidelityGovernor::get_Options() const {
+    return get_Options(fidelity);
+}
+
+double FidelityGovernor::get_Cost() const {
+    return cost;
+}
+
+void FidelityGovernor::Reset() {
+    fidelity = Fidelity_full;
+    cost = 0.;
+    cost_before = 0.;
+    std::fill(ratios, ratios + Fidelity_levels, kDefaultRatio);
+    frames = 0;
+    hold = settings.holdFrames;
+    stepped_up = false;
+}
+
+void FidelityGovernor::set_Fidelity(Fidelity fidelity) {
+    TraceSpan span("Fidelity", "labeling", "level", fidelity);
+
+    bool up = fidelity < this->fidelity;
+    if (!up) {
+        // A step up undone before its hold was over: wait longer before the next one
+        if (stepped_up && frames < hold)
+            hold = std::min(hold * 2, settings.holdFrames * kMaxHoldFactor);
+        else
+            hold = settings.holdFrames;
+    }
+
+    this->fidelity = fidelity;
+    stepped_up = up;
+    cost_before = cost;
+    cost = 0.;
+    frames = 0;
+}
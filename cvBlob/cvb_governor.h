@@ -0,0 +1,138 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+/// \file cvb_governor.h
+/// \brief cvBlob labelling fidelity governor header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_governor.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_GOVERNOR_H_
+#define _CVBLOB_GOVERNOR_H_
+
+#include "cvb_blob_list.h"
+#include "cvb_defines.h"
+
+namespace cvb {
+
+    /// \brief Labelling fidelity levels, from the full labelling to the cheapest one.
+    /// Each level leaves out the work of the previous ones.
+    /// \see FidelityGovernor
+    CVBLOB_EXPORT enum Fidelity {
+        Fidelity_full             = 0, ///< Contours and internal contours.
+        Fidelity_noHoles          = 1, ///< No internal contours.
+        Fidelity_noContours       = 2, ///< No contours: blobs only have their moments and bounding box.
+        Fidelity_minArea          = 3, ///< Small blobs dropped while labelling, with a raised minimum area.
+        Fidelity_downsampled      = 4, ///< Downsampled mask.
+        Fidelity_levels           = 5, ///< Number of levels.
+    };
+
+    /// \brief Parameters of a FidelityGovernor.
+    struct CVBLOB_EXPORT GovernorSettings {
+        GovernorSettings(); ///< Default settings, with no target.
+
+        double target;            ///< Latency target of a frame, in seconds (0 keeps the full fidelity).
+        double headroom;          ///< Steps back up when the cost expected at the level above is below this fraction of the target.
+        double smoothing;         ///< Weight of the last frame in the smoothed cost.
+        unsigned int holdFrames;  ///< Frames spent at a level before stepping up, doubled after each step up undone at once.
+        LabelingOptions options;  ///< Options at full fidelity, e.g. a minimum area.
+        unsigned int minArea;     ///< Minimum area from Fidelity_minArea on.
+        unsigned int downsample;  ///< Downsampling factor at Fidelity_downsampled.
+        Fidelity lowest;          ///< Lowest fidelity allowed.
+    };
+
+    /// \brief Result of a labelling through a FidelityGovernor.
+    struct CVBLOB_EXPORT GovernedLabeling {
+        Fidelity fidelity; ///< Fidelity the frame was labelled with.
+        double seconds;    ///< Labelling time.
+        Fidelity next;     ///< Fidelity for the next frame.
+    };
+
+    /// \brief Holds the labelling time of the frames within a target, degrading the labelling fidelity when the
+    /// scene gets too complex, and restoring it when the time goes down.
+    /// The cost of the frames is smoothed, and the fidelity goes one level down as soon as the smoothed cost is
+    /// over the target. It goes one level up once the cost expected at the level above, from the ratio between the
+    /// two levels measured at the last step down, leaves enough headroom, and after a number of frames at the
+    /// current level, which doubles whenever a step up has to be undone right away.
+    class CVBLOB_EXPORT FidelityGovernor {
+    public:
+        /// \brief Constructor, at full fidelity.
+        /// \param settings Parameters.
+        FidelityGovernor(const GovernorSettings &settings = GovernorSettings());
+
+        /// \brief Labels a frame with the current fidelity, and adapts the fidelity to its labelling time.
+        /// \param blobs Output blobs.
+        /// \param img Input binary image (type = CV_8UC1).
+        /// \param max_label Maximum number of labels.
+        /// \return The fidelity used and the time spent.
+        GovernedLabeling LabelImage(BlobList &blobs, const cv::Mat &img, Label max_label);
+
+        /// \brief Reports the cost of a frame processed with the current fidelity, and adapts the fidelity.
+        /// For frames labelled elsewhere, with get_Options; the cost can include other work than the labelling.
+        /// \param seconds Cost of the frame.
+        /// \return The fidelity for the next frame.
+        Fidelity add_Frame(double seconds);
+
+        /// \brief Gets the current fidelity.
+        /// \return The fidelity.
+        Fidelity get_Fidelity() const;
+
+        /// \brief Gets the labelling options of a fidelity level.
+        /// \param fidelity The level.
+        /// \return The options.
+        LabelingOptions get_Options(Fidelity fidelity) const;
+
+        /// \brief Gets the labelling options of the current fidelity.
+        /// \return The options.
+        LabelingOptions get_Options() const;
+
+        /// \brief Gets the smoothed cost of the frames at the current fidelity.
+        /// \return The cost, in seconds.
+        double get_Cost() const;
+
+        /// \brief Goes back to full fidelity and forgets the costs, e.g. after a scene change.
+        void Reset();
+
+    protected:
+        /// \brief Changes the fidelity.
+        /// \param fidelity New level.
+        void set_Fidelity(Fidelity fidelity);
+
+        GovernorSettings settings;          ///< Parameters.
+
+        Fidelity fidelity;                  ///< Current level.
+        double cost;                        ///< Smoothed cost at the current level, 0 before its first frame.
+        double cost_before;                 ///< Smoothed cost at the previous level, for the ratio.
+        double ratios[Fidelity_levels];     ///< Cost of each level over the cost of the level below.
+        unsigned int frames;                ///< Frames at the current level.
+        unsigned int hold;                  ///< Frames to spend at a level before stepping up.
+        bool stepped_up;                    ///< Whether the current level was reached by a step up.
+    };
+
+} // Namespace
+
+#endif // _CVBLOB_GOVERNOR_H_
@@ -0,0 +1,75 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file cvb_memory.cpp
+/// \brief cvBlob memory accounting source file.
+
+#include <algorithm>
+#include <new>
+
+#include "cvb_memory.h"
+
+using namespace cvb;
+
+namespace {
+    thread_local MemoryStats thread_stats;
+}  // namespace
+
+MemoryStats::MemoryStats() : allocations(0), frees(0), allocatedBytes(0), totalLiveBytes(0), peakBytes(0) {
+    std::fill(liveBytes, liveBytes + Memory_categories, 0);
+}
+
+const MemoryStats &cvb::get_MemoryStats() {
+    return thread_stats;
+}
+
+void cvb::ResetMemoryPeak() {
+    thread_stats.peakBytes = thread_stats.totalLiveBytes;
+}
+
+void *cvb::AllocateCounted(size_t bytes, MemoryCategory category) {
+    void *p = ::operator new(bytes);
+#ifdef CVBLOB_ENABLE_STATS
+    MemoryStats &stats = thread_stats;
+    stats.allocations++;
+    stats.allocatedBytes += bytes;
+    stats.liveBytes[category] += bytes;
+    stats.totalLiveBytes += bytes;
+    stats.peakBytes = std::max(stats.peakBytes, stats.totalLiveBytes);
+#else
+    (void)category;
+#endif
+    return p;
+}
+
+void cvb::FreeCounted(void *p, size_t bytes, MemoryCategory category) {
+#ifdef CVBLOB_ENABLE_STATS
+    MemoryStats &stats = thread_stats;
+    stats.frees++;
+    stats.liveBytes[category] -= bytes;
+    stats.totalLiveBytes -= bytes;
+#else
+    (void)bytes;
+    (void)category;
+#endif
+    ::operator delete(p);
+}
@@ -0,0 +1,138 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file cvb_memory.h
+/// \brief cvBlob memory accounting header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_memory.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_MEMORY_H_
+#define _CVBLOB_MEMORY_H_
+
+#include <cstddef>
+#include <memory>
+
+#include "cvb_defines.h"
+
+namespace cvb {
+
+    /// \brief Kinds of memory accounted.
+    CVBLOB_EXPORT enum MemoryCategory {
+        Memory_blobs      = 0, ///< Blob objects and blob maps.
+        Memory_contours   = 1, ///< Contour objects, chain codes and internal contour lists.
+        Memory_categories = 2  ///< Number of categories.
+    };
+
+    /// \brief Allocation counters of the library containers, for the calling thread.
+    /// Only maintained when the library is built with CVBLOB_ENABLE_STATS, all zero otherwise. Memory freed by
+    /// another thread than the one which allocated it is subtracted from the live bytes of the freeing thread,
+    /// which can then be negative.
+    struct CVBLOB_EXPORT MemoryStats {
+        MemoryStats(); ///< All zero.
+
+        unsigned long long allocations;              ///< Allocations.
+        unsigned long long frees;                    ///< Deallocations.
+        unsigned long long allocatedBytes;           ///< Bytes allocated.
+        long long liveBytes[Memory_categories];      ///< Bytes allocated and not freed yet, per category.
+        long long totalLiveBytes;                    ///< Bytes allocated and not freed yet.
+        long long peakBytes;                         ///< High-water mark of totalLiveBytes since the last reset (each labelling resets it).
+    };
+
+    /// \brief Gets the allocation counters of the calling thread.
+    /// \return The counters.
+    CVBLOB_EXPORT const MemoryStats &get_MemoryStats();
+
+    /// \brief Resets the high-water mark of the calling thread to its current live bytes.
+    CVBLOB_EXPORT void ResetMemoryPeak();
+
+    /// \brief Allocates memory, counting it when the library is built with CVBLOB_ENABLE_STATS.
+    /// \param bytes Size.
+    /// \param category Category to account the memory to.
+    /// \return The memory.
+    CVBLOB_EXPORT void *AllocateCounted(size_t bytes, MemoryCategory category);
+
+    /// \brief Frees memory allocated by AllocateCounted.
+    /// \param p The memory.
+    /// \param bytes Size, as allocated.
+    /// \param category Category, as allocated.
+    CVBLOB_EXPORT void FreeCounted(void *p, size_t bytes, MemoryCategory category);
+
+    /// \brief Allocator accounting memory to a category, used by the library containers with CVBLOB_ENABLE_STATS.
+    /// Counting is done in the library, so that containers filled by the library and by its users agree.
+    /// \see get_MemoryStats
+    /// \see ContainerAllocator
+    template <typename T, MemoryCategory C>
+    class CountingAllocator {
+    public:
+        typedef T value_type; ///< Allocated type.
+
+        /// \brief Same allocator for another type.
+        template <typename U>
+        struct rebind {
+            typedef CountingAllocator<U, C> other; ///< Rebound allocator.
+        };
+
+        CountingAllocator() {}
+
+        template <typename U>
+        CountingAllocator(const CountingAllocator<U, C> &) {}
+
+        /// \brief Allocates memory for n objects.
+        /// \param n Number of objects.
+        /// \return The memory.
+        T *allocate(size_t n) {
+            return static_cast<T *>(AllocateCounted(n * sizeof(T), C));
+        }
+
+        /// \brief Frees memory allocated by allocate.
+        /// \param p The memory.
+        /// \param n Number of objects.
+        void deallocate(T *p, size_t n) {
+            FreeCounted(p, n * sizeof(T), C);
+        }
+
+        template <typename U>
+        bool operator==(const CountingAllocator<U, C> &) const { return true; }
+
+        template <typename U>
+        bool operator!=(const CountingAllocator<U, C> &) const { return false; }
+    };
+
+#ifdef CVBLOB_ENABLE_STATS
+    /// \brief Allocator of the library containers: counting, as the library is built with CVBLOB_ENABLE_STATS.
+    /// The definition is public with the option, so that users see the same container types.
+    template <typename T, MemoryCategory C>
+    using ContainerAllocator = CountingAllocator<T, C>;
+#else
+    /// \brief Allocator of the library containers: the standard one, as nothing is counted without CVBLOB_ENABLE_STATS.
+    template <typename T, MemoryCategory C>
+    using ContainerAllocator = std::allocator<T>;
+#endif
+
+} // Namespace
+
+#endif // _CVBLOB_MEMORY_H_
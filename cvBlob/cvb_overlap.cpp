@@ -0,0 +1,157 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "cvb_overlap.h"
+
+using namespace cvb;
+
+namespace {
+    /// \brief Number of label values.
+    const unsigned int kLabels = 256;
+
+    /// \brief Label of the background pixels next to the contours, in the images of BlobList::LabelImage.
+    const Label kBorder = std::numeric_limits<Label>::max();
+
+    /// \brief Low 7 bits of each byte of a word.
+    const uint64_t kLowBits = 0x7f7f7f7f7f7f7f7full;
+
+    /// \brief Tells whether each byte of a word is either 0 or 0xff (background or border).
+    inline bool backgroundWord(uint64_t word) {
+        // Within each byte, every bit equals the one above it
+        return !((word ^ (word >> 1)) & kLowBits);
+    }
+
+    /// \brief Label of a pixel, the border being background.
+    inline unsigned int pixelLabel(Label label) {
+        return label == kBorder ? 0 : label;
+    }
+}  // namespace
+
+LabelOverlap::LabelOverlap() : counts(kLabels * kLabels, 0), previous_areas(kLabels, 0), current_areas(kLabels, 0) {}
+
+void LabelOverlap::clear() {
+    // Only the touched pairs are reset
+    for (auto &a_pair : pairs)
+        counts[(a_pair.first << 8) | a_pair.second] = 0;
+    pairs.clear();
+
+    std::fill(previous_areas.begin(), previous_areas.end(), 0);
+    std::fill(current_areas.begin(), current_areas.end(), 0);
+}
+
+void LabelOverlap::add_Run(unsigned int key, unsigned int length) {
+    Label previous = (Label)(key >> 8);
+    Label current = (Label)(key & 0xff);
+
+    previous_areas[previous] += length;
+    current_areas[current] += length;
+
+    if (previous && current) {
+        if (!counts[key])
+            pairs.push_back(LabelPair(previous, current));
+        counts[key] += length;
+    }
+}
+
+void LabelOverlap::Compute(const cv::Mat &imgPrevious, const cv::Mat &imgCurrent) {
+    CV_Assert(imgPrevious.type() == CVB_LABEL && imgCurrent.type() == CVB_LABEL);
+    CV_Assert(imgPrevious.size() == imgCurrent.size());
+
+    clear();
+
+    int rows = imgPrevious.rows;
+    int cols = imgPrevious.cols;
+    if (imgPrevious.isContinuous() && imgCurrent.isContinuous()) {
+        cols *= rows;
+        rows = 1;
+    }
+
+    for (int y = 0; y < rows; y++) {
+        const Label *previous = imgPrevious.ptr<Label>(y);
+        const Label *current = imgCurrent.ptr<Label>(y);
+
+        unsigned int key = 0;
+        unsigned int length = 0;
+        int x = 0;
+
+        while (x < cols) {
+            if (x + 8 <= cols) {
+                // Background on both images: skip the whole word
+                uint64_t wordPrevious, wordCurrent;
+                std::memcpy(&wordPrevious, previous + x, sizeof(wordPrevious));
+                std::memcpy(&wordCurrent, current + x, sizeof(wordCurrent));
+                if (backgroundWord(wordPrevious) && backgroundWord(wordCurrent)) {
+                    if (key) {
+                        add_Run(key, length);
+                        key = 0;
+                    }
+                    length = 0;
+                    x += 8;
+                    continue;
+                }
+            }
+
+            unsigned int pixelKey = (pixelLabel(previous[x]) << 8) | pixelLabel(current[x]);
+            if (pixelKey != key) {
+                if (key)
+                    add_Run(key, length);
+                key = pixelKey;
+                length = 0;
+            }
+            length++;
+            x++;
+        }
+
+        if (key)
+            add_Run(key, length);
+    }
+}
+
+const std::vector<LabelPair> &LabelOverlap::get_Pairs() const {
+    return pairs;
+}
+
+unsigned int LabelOverlap::get_Overlap(Label previous, Label current) const {
+    return counts[((unsigned int)previous << 8) | current];
+}
+
+unsigned int LabelOverlap::get_PreviousArea(Label previous) const {
+    return previous_areas[previous];
+}
+
+unsigned int LabelOverlap::get_CurrentArea(Label current) const {
+    return current_areas[current];
+}
+
+double LabelOverlap::get_IntersectionOverUnion(Label previous, Label current) const {
+    unsigned int intersection = get_Overlap(previous, current);
+    if (!intersection)
+        return 0.;
+
+    return (double)intersection / (previous_areas[previous] + current_areas[current] - intersection);
+}
@@ -0,0 +1,107 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+/// \file cvb_overlap.h
+/// \brief cvBlob label overlap header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_overlap.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_OVERLAP_H_
+#define _CVBLOB_OVERLAP_H_
+
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "cvb_blob.h"
+#include "cvb_defines.h"
+
+namespace cvb {
+
+    /// \brief Pair (previous label, current label).
+    typedef std::pair<Label, Label> LabelPair;
+
+    /// \brief Sparse histogram of the overlap between the labels of two label images.
+    /// Typically built from the label images of two consecutive frames, to associate their blobs by their
+    /// common pixels. The buffers are kept between calls, so computing it again does not allocate.
+    /// Label 255, written by BlobList::LabelImage on the background pixels next to the contours, is background:
+    /// it has no pairs and no area.
+    class CVBLOB_EXPORT LabelOverlap {
+    public:
+        LabelOverlap();
+
+        /// \brief Counts the pixels of each pair of labels, in one pass over both images.
+        /// Background words (labels 0 and 255) are skipped eight pixels at a time, and equal pixels are counted by runs, so
+        /// the cost depends on the number of pixels, not on the number of blobs.
+        /// \param imgPrevious Previous label image (type = CVB_LABEL).
+        /// \param imgCurrent Current label image (type = CVB_LABEL), of the same size.
+        void Compute(const cv::Mat &imgPrevious, const cv::Mat &imgCurrent);
+
+        /// \brief Clears the histogram.
+        void clear();
+
+        /// \brief Gets the pairs of labels with a non empty overlap, in order of first appearance.
+        /// \return The pairs of labels.
+        const std::vector<LabelPair> &get_Pairs() const;
+
+        /// \brief Gets the number of pixels with both labels.
+        /// \param previous Label in the previous image.
+        /// \param current Label in the current image.
+        /// \return The number of pixels.
+        unsigned int get_Overlap(Label previous, Label current) const;
+
+        /// \brief Gets the number of pixels of a label in the previous image.
+        /// \param previous Label in the previous image.
+        /// \return The number of pixels.
+        unsigned int get_PreviousArea(Label previous) const;
+
+        /// \brief Gets the number of pixels of a label in the current image.
+        /// \param current Label in the current image.
+        /// \return The number of pixels.
+        unsigned int get_CurrentArea(Label current) const;
+
+        /// \brief Gets the intersection over union of two labels.
+        /// \param previous Label in the previous image.
+        /// \param current Label in the current image.
+        /// \return Intersection over union, between 0 and 1 (0 for the background).
+        double get_IntersectionOverUnion(Label previous, Label current) const;
+
+    protected:
+        /// \brief Adds a run of pixels with the same pair of labels.
+        void add_Run(unsigned int key, unsigned int length);
+
+        std::vector<unsigned int> counts;          ///< Overlap of each pair, indexed by (previous << 8) | current.
+        std::vector<LabelPair> pairs;              ///< Pairs with a non empty overlap.
+        std::vector<unsigned int> previous_areas;  ///< Pixels of each label in the previous image.
+        std::vector<unsigned int> current_areas;   ///< Pixels of each label in the current image.
+    };
+
+} // Namespace
+
+#endif // _CVBLOB_OVERLAP_H_
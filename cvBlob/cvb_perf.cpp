@@ -0,0 +1,188 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file cvb_perf.cpp
+/// \brief cvBlob hardware performance counters source file.
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "cvb_perf.h"
+
+using namespace cvb;
+
+namespace {
+    std::atomic<bool> requested(false);
+
+#if defined(__linux__)
+    const int kCounters = 4;
+    const unsigned long long kEvents[kCounters] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    /// \brief Counters of a thread, in one group read at once, the first one leading.
+    struct PerfGroup {
+        PerfGroup() : tried(false), available(false) {
+            for (int i = 0; i < kCounters; i++)
+                fds[i] = -1;
+        }
+
+        ~PerfGroup() {
+            Close();
+        }
+
+        void Close() {
+            for (int i = 0; i < kCounters; i++) {
+                if (fds[i] >= 0)
+                    close(fds[i]);
+                fds[i] = -1;
+            }
+            available = false;
+        }
+
+        /// \brief Opens the counters, once.
+        /// \return False if one of them is not available.
+        bool Open() {
+            if (tried)
+                return available;
+            tried = true;
+
+            for (int i = 0; i < kCounters; i++) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = kEvents[i];
+                attr.disabled = i == 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                // This thread, any CPU
+                fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, i ? fds[0] : -1, 0);
+                if (fds[i] < 0) {
+                    Close();
+                    return false;
+                }
+            }
+
+            ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            available = true;
+            return true;
+        }
+
+        /// \brief Reads the counters.
+        bool Read(PerfCounters &counters) {
+            struct {
+                unsigned long long nr;
+                unsigned long long timeEnabled;
+                unsigned long long timeRunning;
+                unsigned long long values[kCounters];
+            } data;
+
+            if (read(fds[0], &data, sizeof(data)) != (ssize_t)sizeof(data) || data.nr != kCounters)
+                return false;
+
+            // Raw counts: they are scaled by the difference of two readings
+            counters.cycles = data.values[0];
+            counters.instructions = data.values[1];
+            counters.branchMisses = data.values[2];
+            counters.cacheMisses = data.values[3];
+            counters.timeEnabled = data.timeEnabled;
+            counters.timeRunning = data.timeRunning;
+            return true;
+        }
+
+        int fds[kCounters];
+        bool tried;
+        bool available;
+    };
+
+    thread_local PerfGroup group;
+#endif
+
+    /// \brief Difference of two counts, 0 if it would be negative.
+    inline unsigned long long minus(unsigned long long a, unsigned long long b) {
+        return a > b ? a - b : 0;
+    }
+
+    /// \brief Scaled difference of two counts.
+    inline unsigned long long scaled(unsigned long long a, unsigned long long b, double scale) {
+        return (unsigned long long)(minus(a, b) * scale + .5);
+    }
+}  // namespace
+
+PerfCounters::PerfCounters() : cycles(0), instructions(0), branchMisses(0), cacheMisses(0), timeEnabled(0), timeRunning(0) {}
+
+PerfCounters &PerfCounters::operator+=(const PerfCounters &other) {
+    cycles += other.cycles;
+    instructions += other.instructions;
+    branchMisses += other.branchMisses;
+    cacheMisses += other.cacheMisses;
+    timeEnabled += other.timeEnabled;
+    timeRunning += other.timeRunning;
+    return *this;
+}
+
+PerfCounters PerfCounters::operator-(const PerfCounters &other) const {
+    // Scale up when the group was not always on the PMU between the readings
+    unsigned long long enabled = minus(timeEnabled, other.timeEnabled);
+    unsigned long long running = minus(timeRunning, other.timeRunning);
+    double scale = running ? (double)enabled / running : 1.;
+
+    PerfCounters result;
+    result.cycles = scaled(cycles, other.cycles, scale);
+    result.instructions = scaled(instructions, other.instructions, scale);
+    result.branchMisses = scaled(branchMisses, other.branchMisses, scale);
+    result.cacheMisses = scaled(cacheMisses, other.cacheMisses, scale);
+    result.timeEnabled = enabled;
+    result.timeRunning = enabled;
+    return result;
+}
+
+bool cvb::set_PerfCounters(bool enabled) {
+    requested.store(enabled);
+#if defined(__linux__)
+    return enabled && group.Open();
+#else
+    return false;
+#endif
+}
+
+bool cvb::get_PerfCounters(PerfCounters &counters) {
+    if (!requested.load(std::memory_order_relaxed))
+        return false;
+#if defined(__linux__)
+    return group.Open() && group.Read(counters);
+#else
+    (void)counters;
+    return false;
+#endif
+}
@@ -0,0 +1,84 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file cvb_perf.h
+/// \brief cvBlob hardware performance counters header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_perf.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_PERF_H_
+#define _CVBLOB_PERF_H_
+
+#include "cvb_defines.h"
+
+namespace cvb {
+
+    /// \brief Hardware performance counters of a thread.
+    /// A reading (get_PerfCounters) holds the raw cumulative counts, and the times the counters were enabled and
+    /// actually running: they differ when the kernel had to multiplex them. The difference of two readings scales
+    /// the counts by the ratio of the elapsed times, and holds equal times, so that differences can be added up
+    /// and subtracted in turn.
+    struct CVBLOB_EXPORT PerfCounters {
+        PerfCounters(); ///< All zero.
+
+        /// \brief Adds other counters.
+        /// \param other Counters to add.
+        /// \return This object.
+        PerfCounters &operator+=(const PerfCounters &other);
+
+        /// \brief Difference of counters.
+        /// Counts are scaled by the time enabled over the time running between the two readings. Counts and times
+        /// lower than the ones subtracted give 0.
+        /// \param other Counters to subtract, read earlier.
+        /// \return The counts between the two readings.
+        PerfCounters operator-(const PerfCounters &other) const;
+
+        unsigned long long cycles;       ///< CPU cycles.
+        unsigned long long instructions; ///< Instructions retired.
+        unsigned long long branchMisses; ///< Mispredicted branches.
+        unsigned long long cacheMisses;  ///< Last level cache misses.
+        unsigned long long timeEnabled;  ///< Time the counters were enabled, in nanoseconds.
+        unsigned long long timeRunning;  ///< Time the counters were running, in nanoseconds.
+    };
+
+    /// \brief Turns the hardware performance counters on or off, for all threads.
+    /// Counters are read with perf_event_open, on Linux only, and user space only. Each thread opens its counters
+    /// on its first reading; where they are not available (other systems, containers, perf_event_paranoid), the
+    /// readings fail and the labelling statistics only hold the timings.
+    /// \param enabled Whether to read the counters.
+    /// \return True if the counters can be read on the calling thread.
+    /// \see LabelingStats
+    CVBLOB_EXPORT bool set_PerfCounters(bool enabled);
+
+    /// \brief Reads the hardware performance counters of the calling thread.
+    /// \param counters Output counters, cumulative since they were opened.
+    /// \return False if the counters are off or not available.
+    CVBLOB_EXPORT bool get_PerfCounters(PerfCounters &counters);
+
+} // Namespace
+
+#endif // _CVBLOB_PERF_H_
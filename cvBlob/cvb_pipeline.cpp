@@ -0,0 +1,336 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "cvb_pipeline.h"
+#include "cvb_trace.h"
+
+using namespace cvb;
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    /// \brief Stage names, for the trace and the thread names.
+    const char *const stageNames[PipelineStage_count] = { "Capture", "Threshold", "Label", "Track", "Render" };
+
+    /// \brief Monotonic time.
+    /// \return Nanoseconds since an arbitrary origin.
+    inline long long nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    /// \brief Waits for a queue: spins first, as the other stage is likely busy with a frame for it, then sleeps.
+    /// \param spins Number of waits so far, updated.
+    inline void backOff(unsigned int &spins) {
+        if (spins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        spins++;
+    }
+
+    /// \brief Bucket of a latency in a LatencyHistogram.
+    /// \param ns Latency, in nanoseconds.
+    /// \param buckets Number of buckets.
+    /// \return Bucket index: the latency itself below 16, then 8 buckets per octave.
+    inline size_t bucketOf(unsigned long long ns, size_t buckets) {
+        size_t shift = 0;
+        while ((ns >> shift) >= 16)
+            shift++;
+        return std::min(buckets - 1, shift * 8 + (size_t)(ns >> shift));
+    }
+
+    /// \brief Middle of a bucket of a LatencyHistogram.
+    /// \param bucket Bucket index.
+    /// \return Latency, in nanoseconds.
+    inline double bucketMiddle(size_t bucket) {
+        if (bucket < 16)
+            return (double)bucket;
+        size_t shift = bucket / 8 - 1;
+        double width = (double)(1ULL << shift);
+        return (bucket % 8 + 8) * width + (width - 1.) / 2.;
+    }
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() {
+    Reset();
+}
+
+void LatencyHistogram::add_Sample(unsigned long long ns) {
+    // Single writer: no read-modify-write needed
+    std::atomic<unsigned long long> &bucket = buckets[bucketOf(ns, Buckets)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if (ns > max.load(std::memory_order_relaxed))
+        max.store(ns, std::memory_order_relaxed);
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void LatencyHistogram::Reset() {
+    for (auto &bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_release);
+}
+
+LatencyStats LatencyHistogram::get_Stats() const {
+    LatencyStats stats = LatencyStats();
+    unsigned long long n = count.load(std::memory_order_acquire);
+    if (!n)
+        return stats;
+
+    // Read while samples are added, the buckets can hold a few more of them than the count
+    unsigned long long largest = max.load(std::memory_order_relaxed);
+    stats.count = (size_t)n;
+    stats.mean = sum.load(std::memory_order_relaxed) / (double)n * 1e-9;
+    stats.max = largest * 1e-9;
+
+    const double quantiles[2] = { .5, .99 };
+    double *results[2] = { &stats.p50, &stats.p99 };
+    size_t q = 0;
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < Buckets && q < 2; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        while (q < 2 && seen >= (unsigned long long)std::ceil(quantiles[q] * n)) {
+            *results[q] = std::min(bucketMiddle(i), (double)largest) * 1e-9;
+            q++;
+        }
+    }
+    for (; q < 2; q++)
+        *results[q] = stats.max;
+    return stats;
+}
+
+PipelineSettings::PipelineSettings() : frames(8), threshold(100.), channel(0), maxLabel(std::numeric_limits<Label>::max()),
+    minArea(0), maxArea(std::numeric_limits<unsigned int>::max()), thDistance(20.), thInactive(5), thActive(0),
+    blobRenderMode(CV_BLOB_RENDER_CENTROID|CV_BLOB_RENDER_BOUNDING_BOX),
+    trackRenderMode(CV_TRACK_RENDER_ID|CV_TRACK_RENDER_BOUNDING_BOX) {}
+
+Pipeline::FrameQueue::FrameQueue(size_t capacity) : slots(capacity + 1), head(0), tail(0) {}
+
+bool Pipeline::FrameQueue::Push(PipelineFrame *frame) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t next = (t + 1) % slots.size();
+    if (next == head.load(std::memory_order_acquire))
+        return false;
+    slots[t] = frame;
+    tail.store(next, std::memory_order_release);
+    return true;
+}
+
+bool Pipeline::FrameQueue::Pop(PipelineFrame *&frame) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+        return false;
+    frame = slots[h];
+    head.store((h + 1) % slots.size(), std::memory_order_release);
+    return true;
+}
+
+Pipeline::Pipeline(const PipelineSettings &settings) : settings(settings), governor(settings.governor), stopping(false), failed(false), processed(0),
+    start_ns(0), end_ns(0) {
+    this->settings.frames = std::max((size_t)2, settings.frames);
+    for (size_t i = 0; i < this->settings.frames; i++)
+        frames.push_back(std::unique_ptr<PipelineFrame>(new PipelineFrame()));
+    // Every frame, and the end of the run, fit in every queue: pushes never wait
+    for (int stage = 0; stage < PipelineStage_count; stage++)
+        queues.push_back(std::unique_ptr<FrameQueue>(new FrameQueue(frames.size() + 1)));
+}
+
+void Pipeline::set_Threshold(const PipelineThreshold &threshold) {
+    this->threshold = threshold;
+}
+
+size_t Pipeline::Run(const PipelineSource &source, const PipelineSink &sink) {
+    for (auto &latency : latencies)
+        latency.Reset();
+    end_to_end.Reset();
+    stopping = false;
+    failed = false;
+    error = std::exception_ptr();
+    processed = 0;
+    end_ns = 0;
+    start_ns = nowNs();
+
+    // No stage runs: all the frames, including the one left by the capture at the end of the last run, are free
+    PipelineFrame *frame;
+    for (auto &queue : queues)
+        while (queue->Pop(frame)) {}
+    for (auto &a_frame : frames)
+        queues[PipelineStage_capture]->Push(a_frame.get());
+
+    std::vector<std::thread> threads;
+    for (int stage = 0; stage < PipelineStage_count; stage++)
+        threads.push_back(std::thread(&Pipeline::Work, this, (PipelineStage)stage, std::cref(source), std::cref(sink)));
+    for (auto &thread : threads)
+        thread.join();
+    end_ns = nowNs();
+
+    if (error)
+        std::rethrow_exception(error);
+    return processed;
+}
+
+void Pipeline::Stop() {
+    stopping = true;
+}
+
+LatencyStats Pipeline::get_Latency(PipelineStage stage) const {
+    CV_Assert(stage >= 0 && stage < PipelineStage_count);
+    return latencies[stage].get_Stats();
+}
+
+LatencyStats Pipeline::get_EndToEndLatency() const {
+    return end_to_end.get_Stats();
+}
+
+double Pipeline::get_FramesPerSecond() const {
+    long long start = start_ns, end = end_ns;
+    if (!start)
+        return 0.;
+    if (!end)
+        end = nowNs();
+    return end > start ? processed * 1e9 / (end - start) : 0.;
+}
+
+FidelityGovernor &Pipeline::get_Governor() {
+    return governor;
+}
+
+TrackList &Pipeline::get_TrackList() {
+    return tracks;
+}
+
+void Pipeline::Work(PipelineStage stage, const PipelineSource &source, const PipelineSink &sink) {
+    set_TraceThreadName(std::string("cvBlob pipeline ") + stageNames[stage]);
+    FrameQueue &input = *queues[stage];
+    FrameQueue &output = *queues[(stage + 1) % PipelineStage_count];
+
+    for (size_t index = 0; ; index++) {
+        if (stage == PipelineStage_capture && stopping)
+            break;
+
+        PipelineFrame *frame = nullptr;
+        for (unsigned int spins = 0; !input.Pop(frame); )
+            backOff(spins);
+        // End of the run, passed down to the render stage
+        if (!frame)
+            break;
+
+        if (!failed) {
+            try {
+                if (stage == PipelineStage_capture) {
+                    frame->index = index;
+                    frame->captured = Clock::now();
+                }
+                long long start = nowNs();
+                // End of the video: the frame is left out until the next run
+                if (!Process(stage, *frame, source, sink))
+                    break;
+                latencies[stage].add_Sample(nowNs() - start);
+                if (stage == PipelineStage_render) {
+                    end_to_end.add_Sample(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame->captured).count());
+                    processed++;
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+                failed = true;
+                stopping = true;
+            }
+        }
+
+        for (unsigned int spins = 0; !output.Push(frame); )
+            backOff(spins);
+    }
+
+    if (stage != PipelineStage_render) {
+        for (unsigned int spins = 0; !output.Push(nullptr); )
+            backOff(spins);
+    }
+}
+
+bool Pipeline::Process(PipelineStage stage, PipelineFrame &frame, const PipelineSource &source, const PipelineSink &sink) {
+    TraceSpan span(stageNames[stage], "pipeline", "frame", (long long)frame.index);
+
+    switch (stage) {
+    case PipelineStage_capture:
+        return source(frame.image);
+
+    case PipelineStage_threshold:
+        if (threshold)
+            threshold(frame.image, frame.binary);
+        else {
+            // Both calls write into the binary image of the frame, which keeps its buffer
+            if (frame.image.channels() == 1)
+                cv::threshold(frame.image, frame.binary, settings.threshold, 255., cv::THRESH_BINARY);
+            else {
+                cv::extractChannel(frame.image, frame.binary, settings.channel);
+                cv::threshold(frame.binary, frame.binary, settings.threshold, 255., cv::THRESH_BINARY);
+            }
+        }
+        break;
+
+    case PipelineStage_label:
+        frame.fidelity = governor.LabelImage(frame.blobs, frame.binary, settings.maxLabel).fidelity;
+        if (settings.minArea || settings.maxArea != std::numeric_limits<unsigned int>::max())
+            frame.blobs.FilterByArea(settings.minArea, settings.maxArea);
+        break;
+
+    case PipelineStage_track:
+        tracks.UpdateTracks(frame.blobs, settings.thDistance, settings.thInactive, settings.thActive);
+        // The render stage works on the next frames meanwhile: it draws a copy of the tracks
+        frame.tracks.clear();
+        for (auto &a_track : tracks.get_Tracks())
+            frame.tracks.push_back(*a_track.second);
+        break;
+
+    case PipelineStage_render:
+        if (settings.blobRenderMode || settings.trackRenderMode) {
+            if (frame.image.type() == CV_8UC3)
+                frame.image.copyTo(frame.rendered);
+            else
+                cv::cvtColor(frame.image, frame.rendered, cv::COLOR_GRAY2BGR);
+            if (settings.blobRenderMode)
+                frame.blobs.RenderBlobs(frame.rendered, frame.rendered, settings.blobRenderMode);
+            if (settings.trackRenderMode)
+                for (auto &track : frame.tracks)
+                    RenderTrack(track, frame.rendered, settings.trackRenderMode);
+        }
+        if (sink)
+            sink(frame);
+        break;
+
+    default:
+        break;
+    }
+    return true;
+}
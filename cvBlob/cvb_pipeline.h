@@ -0,0 +1,264 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+/// \file cvb_pipeline.h
+/// \brief cvBlob pipelined video processing header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_pipeline.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_PIPELINE_H_
+#define _CVBLOB_PIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cvb_blob_list.h"
+#include "cvb_defines.h"
+#include "cvb_governor.h"
+#include "cvb_track.h"
+
+namespace cvb {
+
+    /// \brief Stages of a Pipeline, in processing order.
+    CVBLOB_EXPORT enum PipelineStage {
+        PipelineStage_capture   = 0, ///< Grabs the image of a frame.
+        PipelineStage_threshold = 1, ///< Builds the binary image.
+        PipelineStage_label     = 2, ///< Labels and filters the blobs.
+        PipelineStage_track     = 3, ///< Updates the tracks.
+        PipelineStage_render    = 4, ///< Draws the blobs and the tracks, and hands the frame over to the sink.
+        PipelineStage_count     = 5, ///< Number of stages.
+    };
+
+    /// \brief Latency distribution, in seconds.
+    struct CVBLOB_EXPORT LatencyStats {
+        size_t count; ///< Number of samples.
+        double mean;  ///< Mean.
+        double p50;   ///< Median.
+        double p99;   ///< 99th percentile.
+        double max;   ///< Maximum.
+    };
+
+    /// \brief Histogram of latencies, with logarithmic buckets: 8 per octave, exact below 16 ns.
+    /// Percentiles are the middle of their bucket, within 6% of the samples. One thread adds the samples, any
+    /// thread can read the statistics meanwhile.
+    class CVBLOB_EXPORT LatencyHistogram {
+    public:
+        LatencyHistogram(); ///< Empty histogram.
+
+        /// \brief Adds a sample.
+        /// \param ns Latency, in nanoseconds.
+        void add_Sample(unsigned long long ns);
+
+        /// \brief Removes all the samples.
+        void Reset();
+
+        /// \brief Gets the statistics of the samples.
+        /// \return The statistics, all zero without sample.
+        LatencyStats get_Stats() const;
+
+    protected:
+        static const size_t Buckets = 344; ///< Number of buckets, up to 2^45 ns.
+
+        std::atomic<unsigned long long> buckets[Buckets]; ///< Samples per bucket.
+        std::atomic<unsigned long long> count;            ///< Number of samples.
+        std::atomic<unsigned long long> sum;              ///< Sum of the samples.
+        std::atomic<unsigned long long> max;              ///< Largest sample.
+
+    private:
+        LatencyHistogram(const LatencyHistogram &);
+        LatencyHistogram &operator=(const LatencyHistogram &);
+    };
+
+    /// \brief Labelling, tracking and rendering parameters of a Pipeline.
+    struct CVBLOB_EXPORT PipelineSettings {
+        PipelineSettings(); ///< Default settings.
+
+        size_t frames;                  ///< Number of recycled frames, which bounds the frames in flight (at least 2).
+        double threshold;               ///< Pixels of the thresholded channel above this are foreground.
+        int channel;                    ///< Channel of the captured image thresholded, when it has more than one.
+        Label maxLabel;                 ///< Maximum number of labels (BlobList::LabelImage).
+        GovernorSettings governor;      ///< Labelling fidelity governor, with a target on the label stage (none by default).
+        unsigned int minArea;           ///< Blobs smaller than this are filtered out.
+        unsigned int maxArea;           ///< Blobs larger than this are filtered out.
+        double thDistance;              ///< Maximum distance between a track and a blob (TrackList::UpdateTracks).
+        unsigned int thInactive;        ///< Maximum number of frames a track can be inactive.
+        unsigned int thActive;          ///< Tracks active for less frames are deleted when they become inactive (0 disables).
+        unsigned short blobRenderMode;  ///< Blob render mode (BlobList::RenderBlobs), 0 to draw no blob.
+        unsigned short trackRenderMode; ///< Track render mode (RenderTrack), 0 to draw no track.
+    };
+
+    /// \brief Frame going through a Pipeline.
+    /// Frames are recycled: their images keep their buffers from one video frame to the next, so the pipeline does
+    /// not allocate images once all the frames have been used.
+    struct CVBLOB_EXPORT PipelineFrame {
+        size_t index;                                  ///< Frame number, from 0.
+        std::chrono::steady_clock::time_point captured; ///< When the capture of the frame started.
+        cv::Mat image;                                 ///< Captured image (type = CV_8UC3 or CV_8UC1).
+        cv::Mat binary;                                ///< Binary image (type = CV_8UC1).
+        BlobList blobs;                                ///< Blobs, after filtering.
+        Fidelity fidelity;                             ///< Fidelity the blobs were labelled with.
+        std::vector<Track> tracks;                     ///< Copy of the tracks after this frame.
+        cv::Mat rendered;                              ///< Image with the blobs and tracks drawn (type = CV_8UC3).
+    };
+
+    /// \brief Grabs the next image, from the capture stage.
+    /// The image given is the one of a recycled frame: reading into it (e.g. cv::VideoCapture::read) reuses its buffer.
+    /// Return false at the end of the video.
+    typedef std::function<bool(cv::Mat &image)> PipelineSource;
+
+    /// \brief Builds the binary image (type = CV_8UC1) of a captured image, from the threshold stage.
+    /// The binary image given is the one of a recycled frame, of the size of the last image thresholded into it.
+    typedef std::function<void(const cv::Mat &image, cv::Mat &binary)> PipelineThreshold;
+
+    /// \brief Receives each processed frame, in order, from the render stage.
+    /// The frame is recycled on return: anything kept must be copied.
+    typedef std::function<void(const PipelineFrame &frame)> PipelineSink;
+
+    /// \brief Video processing where each stage runs on its own thread: capture, threshold, label, track and render.
+    /// Stages pass frames to the next one through bounded single-producer single-consumer lock-free queues, and the
+    /// render stage gives them back to the capture one. Up to PipelineSettings::frames frames are in flight, so
+    /// the throughput is the one of the slowest stage instead of the sum of all the stages, as long as there are
+    /// enough cores. Idle stages spin for a while, then sleep for short periods: a frame can wait for a few tens
+    /// of microseconds more at each stage when the pipeline is idle.
+    class CVBLOB_EXPORT Pipeline {
+    public:
+        /// \brief Constructor, allocating the frames.
+        /// \param settings Labelling, tracking and rendering parameters.
+        Pipeline(const PipelineSettings &settings = PipelineSettings());
+
+        /// \brief Replaces the threshold stage, which by default extracts the channel and thresholds it.
+        /// Must not be called while running.
+        /// \param threshold The function.
+        void set_Threshold(const PipelineThreshold &threshold);
+
+        /// \brief Processes a video, until the source ends or Stop is called.
+        /// Starts a thread per stage and waits for them to process all the frames captured. Tracks carry over
+        /// from a run to the next one. An exception thrown by a stage stops the run, and is thrown again here.
+        /// \param source Grabs the images.
+        /// \param sink Receives the processed frames (none by default).
+        /// \return Number of frames processed.
+        size_t Run(const PipelineSource &source, const PipelineSink &sink = PipelineSink());
+
+        /// \brief Asks the running pipeline to stop capturing. The frames in flight are still processed.
+        /// Can be called from any thread, including from the source or the sink.
+        void Stop();
+
+        /// \brief Gets the latencies of a stage, in the current or last run: processing time, without queueing.
+        /// \param stage The stage.
+        /// \return Latency statistics.
+        LatencyStats get_Latency(PipelineStage stage) const;
+
+        /// \brief Gets the latencies from the start of the capture to the end of the sink, in the current or last run.
+        /// \return Latency statistics.
+        LatencyStats get_EndToEndLatency() const;
+
+        /// \brief Gets the throughput of the current or last run.
+        /// \return Frames processed per second.
+        double get_FramesPerSecond() const;
+
+        /// \brief Gets the labelling fidelity governor.
+        /// Must not be used while running.
+        /// \return The governor.
+        FidelityGovernor &get_Governor();
+
+        /// \brief Gets the tracker, e.g. to configure it.
+        /// Must not be used while running.
+        /// \return The tracker.
+        TrackList &get_TrackList();
+
+    protected:
+        /// \brief Bounded single-producer single-consumer lock-free queue of frames.
+        class FrameQueue {
+        public:
+            /// \brief Constructor.
+            /// \param capacity Maximum number of entries.
+            FrameQueue(size_t capacity);
+
+            /// \brief Adds an entry, from the producer thread.
+            /// \param frame The frame, or nullptr to mark the end of the run.
+            /// \return False if the queue is full.
+            bool Push(PipelineFrame *frame);
+
+            /// \brief Removes the oldest entry, from the consumer thread.
+            /// \param frame Output frame.
+            /// \return False if the queue is empty.
+            bool Pop(PipelineFrame *&frame);
+
+        protected:
+            std::vector<PipelineFrame *> slots; ///< Ring buffer, one slot being always free.
+            std::atomic<size_t> head;           ///< Next slot to pop, written by the consumer.
+            char padding[64];                   ///< Keeps the indexes on different cache lines.
+            std::atomic<size_t> tail;           ///< Next slot to push, written by the producer.
+        };
+
+        /// \brief Stage thread loop: takes frames from the stage queue and passes them to the next one.
+        /// \param stage The stage.
+        /// \param source Grabs the images (capture stage).
+        /// \param sink Receives the processed frames (render stage).
+        void Work(PipelineStage stage, const PipelineSource &source, const PipelineSink &sink);
+
+        /// \brief Processes a frame in a stage.
+        /// \param stage The stage.
+        /// \param frame The frame.
+        /// \param source Grabs the images (capture stage).
+        /// \param sink Receives the processed frames (render stage).
+        /// \return False at the end of the video (capture stage).
+        bool Process(PipelineStage stage, PipelineFrame &frame, const PipelineSource &source, const PipelineSink &sink);
+
+        PipelineSettings settings;     ///< Parameters.
+        PipelineThreshold threshold;   ///< Threshold stage, if replaced.
+        TrackList tracks;              ///< Tracker, owned by the track stage while running.
+        FidelityGovernor governor;     ///< Labelling fidelity governor, owned by the label stage while running.
+
+        std::vector<std::unique_ptr<PipelineFrame> > frames;   ///< Recycled frames.
+        std::vector<std::unique_ptr<FrameQueue> > queues;      ///< Input queue of each stage, the capture one holding the free frames.
+        LatencyHistogram latencies[PipelineStage_count];      ///< Processing times of each stage.
+        LatencyHistogram end_to_end;                           ///< Latencies from the capture to the end of the sink.
+
+        std::atomic<bool> stopping;                       ///< Whether the capture must stop.
+        std::atomic<bool> failed;                         ///< Whether a stage threw: the frames left are not processed.
+        std::exception_ptr error;                         ///< First exception thrown by a stage.
+        std::mutex error_mutex;                           ///< Protects the exception.
+        std::atomic<size_t> processed;                    ///< Frames processed in the current or last run.
+        std::atomic<long long> start_ns;                  ///< Start of the current or last run.
+        std::atomic<long long> end_ns;                    ///< End of the last run, 0 while running.
+
+    private:
+        Pipeline(const Pipeline &);
+        Pipeline &operator=(const Pipeline &);
+    };
+
+} // Namespace
+
+#endif // _CVBLOB_PIPELINE_H_
@@ -0,0 +1,194 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "cvb_shape_index.h"
+
+using namespace cvb;
+
+namespace {
+    /// \brief Orders matches by distance, as a max-heap.
+    inline bool closer(const ShapeMatch &a, const ShapeMatch &b) {
+        return a.distance < b.distance;
+    }
+
+    /// \brief Subtree to visit, with a lower bound of the distance from the query to its shapes.
+    struct PendingNode {
+        size_t first;
+        size_t last;
+        double bound;
+    };
+}  // namespace
+
+ShapeIndex::ShapeIndex() : dimension(0), built(true) {}
+
+size_t ShapeIndex::add_Shape(const ShapeDescriptor &descriptor) {
+    if (descriptors.empty())
+        dimension = descriptor.size();
+    CV_Assert(descriptor.size() == dimension);
+
+    descriptors.insert(descriptors.end(), descriptor.begin(), descriptor.end());
+    built = false;
+
+    return get_Size() - 1;
+}
+
+size_t ShapeIndex::add_Shape(const Blob &blob, size_t harmonics) {
+    return add_Shape(blob.get_ShapeDescriptor(harmonics));
+}
+
+void ShapeIndex::clear() {
+    dimension = 0;
+    descriptors.clear();
+    ids.clear();
+    middles.clear();
+    thresholds.clear();
+    built = true;
+}
+
+size_t ShapeIndex::get_Size() const {
+    return dimension ? descriptors.size() / dimension : 0;
+}
+
+double ShapeIndex::Distance(const double *query, size_t id) const {
+    const double *descriptor = &descriptors[id * dimension];
+
+    double d = 0.;
+    for (size_t i = 0; i < dimension; i++) {
+        double diff = query[i] - descriptor[i];
+        d += diff * diff;
+    }
+
+    return std::sqrt(d);
+}
+
+void ShapeIndex::Build() {
+    size_t n = get_Size();
+
+    ids.resize(n);
+    for (size_t i = 0; i < n; i++)
+        ids[i] = i;
+    middles.assign(n, 0);
+    thresholds.assign(n, 0.);
+
+    std::vector<std::pair<double, size_t> > distances(n);
+    std::vector<std::pair<size_t, size_t> > stack;
+    if (n)
+        stack.push_back(std::make_pair(0, n));
+
+    while (!stack.empty()) {
+        size_t first = stack.back().first;
+        size_t last = stack.back().second;
+        stack.pop_back();
+
+        size_t middle = (first + 1 + last) / 2;
+        middles[first] = middle;
+        if (last - first <= 1)
+            continue;
+
+        // Split the other shapes at the median distance to the vantage point
+        const double *vantage = &descriptors[ids[first] * dimension];
+        for (size_t i = first + 1; i < last; i++)
+            distances[i] = std::make_pair(Distance(vantage, ids[i]), ids[i]);
+
+        std::nth_element(distances.begin() + first + 1, distances.begin() + middle, distances.begin() + last);
+        for (size_t i = first + 1; i < last; i++)
+            ids[i] = distances[i].second;
+        thresholds[first] = distances[middle].first;
+
+        if (middle > first + 1)
+            stack.push_back(std::make_pair(first + 1, middle));
+        stack.push_back(std::make_pair(middle, last));
+    }
+
+    built = true;
+}
+
+void ShapeIndex::FindNearest(const ShapeDescriptor &query, size_t k, std::vector<ShapeMatch> &matches) const {
+    CV_Assert(built);
+    matches.clear();
+
+    size_t n = get_Size();
+    if (n == 0 || k == 0)
+        return;
+    CV_Assert(query.size() == dimension);
+
+    k = std::min(k, n);
+    matches.reserve(k);
+    double radius = std::numeric_limits<double>::max();
+
+    std::vector<PendingNode> stack;
+    PendingNode root = { 0, n, 0. };
+    stack.push_back(root);
+
+    while (!stack.empty()) {
+        PendingNode node = stack.back();
+        stack.pop_back();
+        if (node.bound > radius)
+            continue;
+
+        size_t first = node.first;
+        size_t last = node.last;
+
+        double d = Distance(query.data(), ids[first]);
+        if (d < radius || matches.size() < k) {
+            ShapeMatch match = { ids[first], d };
+            if (matches.size() == k) {
+                std::pop_heap(matches.begin(), matches.end(), closer);
+                matches.back() = match;
+            } else {
+                matches.push_back(match);
+            }
+            std::push_heap(matches.begin(), matches.end(), closer);
+
+            if (matches.size() == k)
+                radius = matches.front().distance;
+        }
+
+        size_t middle = middles[first];
+        double threshold = thresholds[first];
+        PendingNode inside = { first + 1, middle, d - threshold };
+        PendingNode outside = { middle, last, threshold - d };
+        bool hasInside = middle > first + 1 && inside.bound <= radius;
+        bool hasOutside = middle < last && outside.bound <= radius;
+
+        // Visit the most promising side first
+        if (d < threshold) {
+            if (hasOutside)
+                stack.push_back(outside);
+            if (hasInside)
+                stack.push_back(inside);
+        } else {
+            if (hasInside)
+                stack.push_back(inside);
+            if (hasOutside)
+                stack.push_back(outside);
+        }
+    }
+
+    std::sort_heap(matches.begin(), matches.end(), closer);
+}
@@ -0,0 +1,101 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+/// \file cvb_shape_index.h
+/// \brief cvBlob shape index header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_shape_index.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_SHAPE_INDEX_H_
+#define _CVBLOB_SHAPE_INDEX_H_
+
+#include <vector>
+
+#include "cvb_blob.h"
+#include "cvb_defines.h"
+
+namespace cvb {
+
+    /// \brief Result of a shape query.
+    struct CVBLOB_EXPORT ShapeMatch {
+        size_t id;       ///< Id of the matched shape, as returned by ShapeIndex::add_Shape.
+        double distance; ///< Euclidean distance between the descriptors.
+    };
+
+    /// \brief Index of shape descriptors, for k-nearest shape queries.
+    /// Vantage-point tree over the Euclidean distance between descriptors, stored in flat arrays.
+    /// \see Blob::get_ShapeDescriptor
+    class CVBLOB_EXPORT ShapeIndex {
+    public:
+        ShapeIndex();
+
+        /// \brief Adds a shape. The index must be built again before the next query.
+        /// \param descriptor Shape descriptor, of the same size for all the shapes.
+        /// \return Id of the shape (insertion order).
+        size_t add_Shape(const ShapeDescriptor &descriptor);
+
+        /// \brief Adds the shape of a blob. The index must be built again before the next query.
+        /// \param blob Blob, with its moments computed.
+        /// \param harmonics Number of Fourier descriptors.
+        /// \return Id of the shape (insertion order).
+        size_t add_Shape(const Blob &blob, size_t harmonics = 8);
+
+        /// \brief Removes all the shapes.
+        void clear();
+
+        /// \brief Builds the tree, in O(n log n).
+        void Build();
+
+        /// \brief Gets the number of shapes.
+        /// \return The number of shapes.
+        size_t get_Size() const;
+
+        /// \brief Finds the nearest shapes to a descriptor. Exact search.
+        /// \param query Shape descriptor.
+        /// \param k Number of shapes to find.
+        /// \param matches Output matches, sorted by distance.
+        void FindNearest(const ShapeDescriptor &query, size_t k, std::vector<ShapeMatch> &matches) const;
+
+    protected:
+        /// \brief Distance between a query and a stored descriptor.
+        double Distance(const double *query, size_t id) const;
+
+        size_t dimension;                ///< Descriptor size.
+        std::vector<double> descriptors; ///< Descriptors, one after another.
+        bool built;                      ///< Whether the tree is up to date.
+
+        // The node of the range [first, last) of the tree is at position first: its vantage point is ids[first],
+        // its inside children are [first + 1, middle) and its outside children [middle, last).
+        std::vector<size_t> ids;        ///< Shape ids, in tree order.
+        std::vector<size_t> middles;    ///< First outside child of each node.
+        std::vector<double> thresholds; ///< Radius of each node.
+    };
+
+} // Namespace
+
+#endif // _CVBLOB_SHAPE_INDEX_H_
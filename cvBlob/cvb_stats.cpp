@@ -0,0 +1,91 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file cvb_stats.cpp
+/// \brief cvBlob labelling statistics source file.
+
+#include <algorithm>
+#include <mutex>
+
+#include "cvb_stats.h"
+
+using namespace cvb;
+
+namespace {
+    std::mutex totals_mutex;
+    LabelingStats totals;
+}  // namespace
+
+LabelingStats::LabelingStats() : calls(0), truncated(0), scanNs(0), contourNs(0), holeNs(0), momentsNs(0), listNs(0),
+    pixelsVisited(0), runs(0), contourSteps(0), holeSteps(0), merges(0), blobsCreated(0), blobsFiltered(0),
+    allocations(0), allocatedBytes(0), peakBytes(0), labelImageBytes(0), blobBytes(0), contourBytes(0), perfCalls(0) {}
+
+LabelingStats &LabelingStats::operator+=(const LabelingStats &other) {
+    calls += other.calls;
+    truncated += other.truncated;
+    scanNs += other.scanNs;
+    contourNs += other.contourNs;
+    holeNs += other.holeNs;
+    momentsNs += other.momentsNs;
+    listNs += other.listNs;
+    pixelsVisited += other.pixelsVisited;
+    runs += other.runs;
+    contourSteps += other.contourSteps;
+    holeSteps += other.holeSteps;
+    merges += other.merges;
+    blobsCreated += other.blobsCreated;
+    blobsFiltered += other.blobsFiltered;
+    allocations += other.allocations;
+    allocatedBytes += other.allocatedBytes;
+    peakBytes = std::max(peakBytes, other.peakBytes);
+    labelImageBytes = std::max(labelImageBytes, other.labelImageBytes);
+    blobBytes = std::max(blobBytes, other.blobBytes);
+    contourBytes = std::max(contourBytes, other.contourBytes);
+    perfCalls += other.perfCalls;
+    scanCounters += other.scanCounters;
+    traceCounters += other.traceCounters;
+    finalizeCounters += other.finalizeCounters;
+    return *this;
+}
+
+bool cvb::LabelingStatsEnabled() {
+#ifdef CVBLOB_ENABLE_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void cvb::add_LabelingTotals(const LabelingStats &stats) {
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    totals += stats;
+}
+
+LabelingStats cvb::get_LabelingTotals() {
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    return totals;
+}
+
+void cvb::ResetLabelingTotals() {
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    totals = LabelingStats();
+}
@@ -0,0 +1,103 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file cvb_stats.h
+/// \brief cvBlob labelling statistics header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_stats.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_STATS_H_
+#define _CVBLOB_STATS_H_
+
+#include "cvb_defines.h"
+#include "cvb_perf.h"
+
+namespace cvb {
+
+    /// \brief Per-stage timings, hardware counters, work counters and memory of the labelling.
+    /// Filled by the labelling functions of BlobList when the library is built with CVBLOB_ENABLE_STATS (CMake
+    /// option CVBLOB_ENABLE_STATS, Meson option stats). Otherwise the instrumentation is compiled out and all the
+    /// values stay zero. Times are in nanoseconds.
+    /// \see BlobList::get_LabelingStats
+    /// \see get_LabelingTotals
+    struct CVBLOB_EXPORT LabelingStats {
+        LabelingStats(); ///< All zero.
+
+        /// \brief Adds the timings and counters of other calls.
+        /// \param other Statistics to add.
+        /// \return This object.
+        LabelingStats &operator+=(const LabelingStats &other);
+
+        unsigned long long calls;         ///< Labelling calls.
+        unsigned long long truncated;     ///< Calls which stopped early because the labels ran out.
+        unsigned long long scanNs;        ///< Raster scan, without the contour tracing (and region growth, for LabelRegions).
+        unsigned long long contourNs;     ///< External contour tracing.
+        unsigned long long holeNs;        ///< Internal contour (hole) tracing.
+        unsigned long long momentsNs;     ///< Moments finalization.
+        unsigned long long listNs;        ///< Blobs list building.
+        unsigned long long pixelsVisited; ///< Pixels read by the raster scan.
+        unsigned long long runs;          ///< Horizontal runs of foreground pixels.
+        unsigned long long contourSteps;  ///< Chain codes of the external contours.
+        unsigned long long holeSteps;     ///< Chain codes of the internal contours.
+        unsigned long long merges;        ///< Blobs merged into others (SimpleLabel).
+        unsigned long long blobsCreated;  ///< Blobs created.
+        unsigned long long blobsFiltered; ///< Blobs removed by BlobList::FilterByArea or BlobList::FilterByLabel.
+
+        // Memory, see MemoryStats. Sums add up the allocations, but keep the maximum of the footprints.
+        unsigned long long allocations;     ///< Allocations of the library containers.
+        unsigned long long allocatedBytes;  ///< Bytes allocated by the library containers.
+        unsigned long long peakBytes;       ///< High-water mark of the library containers during the call.
+        unsigned long long labelImageBytes; ///< Footprint of the label image.
+        unsigned long long blobBytes;       ///< Footprint of the blobs, without their contours.
+        unsigned long long contourBytes;    ///< Footprint of the contours: chain codes and polygons.
+
+        // Hardware counters, see set_PerfCounters. All zero where they are not available.
+        unsigned long long perfCalls;  ///< Calls with hardware counters.
+        PerfCounters scanCounters;     ///< Raster scan, without the contour tracing (and region growth, for LabelRegions).
+        PerfCounters traceCounters;    ///< External and internal contour tracing.
+        PerfCounters finalizeCounters; ///< Moments finalization and blobs list building.
+    };
+
+    /// \brief Tells whether the library was built with CVBLOB_ENABLE_STATS.
+    /// \return True if the labelling statistics are collected.
+    CVBLOB_EXPORT bool LabelingStatsEnabled();
+
+    /// \brief Adds statistics to the process-wide totals.
+    /// Called by BlobList after each labelling or filtering. Thread safe.
+    /// \param stats Statistics to add.
+    CVBLOB_EXPORT void add_LabelingTotals(const LabelingStats &stats);
+
+    /// \brief Gets the sum of the statistics of all the labelling calls since the last reset, from all threads.
+    /// \return The totals.
+    CVBLOB_EXPORT LabelingStats get_LabelingTotals();
+
+    /// \brief Resets the process-wide totals to zero.
+    CVBLOB_EXPORT void ResetLabelingTotals();
+
+} // Namespace
+
+#endif // _CVBLOB_STATS_H_
@@ -0,0 +1,259 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "cvb_streams.h"
+#include "cvb_trace.h"
+
+using namespace cvb;
+
+namespace {
+    /// \brief Binds a thread to a core, where supported.
+    void pinThread(std::thread &thread, unsigned int core) {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+        (void)thread;
+        (void)core;
+#endif
+    }
+}  // namespace
+
+StreamSettings::StreamSettings() : maxLabel(std::numeric_limits<Label>::max()), minArea(0), thDistance(20.),
+    thInactive(5), thActive(0), maxQueue(4) {}
+
+StreamEngine::StreamEngine(unsigned int workers, bool pinWorkers) : pending(0), stopping(false) {
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    if (!workers)
+        workers = cores;
+
+    for (unsigned int i = 0; i < workers; i++) {
+        this->workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        this->workers.back()->idle = false;
+    }
+    // All the workers exist before any of them looks for work to steal
+    for (unsigned int i = 0; i < workers; i++) {
+        this->workers[i]->thread = std::thread(&StreamEngine::Run, this, i);
+        if (pinWorkers)
+            pinThread(this->workers[i]->thread, i % cores);
+    }
+}
+
+StreamEngine::~StreamEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    for (auto &worker : workers)
+        worker->wake.notify_one();
+    for (auto &worker : workers)
+        worker->thread.join();
+}
+
+StreamID StreamEngine::add_Stream(const StreamSettings &settings) {
+    std::unique_ptr<Stream> stream(new Stream());
+    stream->settings = settings;
+    stream->scheduled = false;
+    stream->total_latency = 0.;
+    stream->stats = StreamStats();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    StreamID id = (StreamID)streams.size();
+    // Streams are spread over the workers
+    stream->home = id % workers.size();
+    stream->stats.worker = stream->home;
+    streams.push_back(std::move(stream));
+    return id;
+}
+
+void StreamEngine::set_Callback(const StreamCallback &callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->callback = callback;
+}
+
+bool StreamEngine::Submit(StreamID stream, const cv::Mat &img) {
+    CV_Assert(img.type() == CV_8UC1);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    CV_Assert(stream < streams.size());
+    Stream &s = *streams[stream];
+
+    Frame frame;
+    frame.img = img;
+    frame.submitted = Clock::now();
+
+    bool kept = true;
+    if (s.queue.size() >= std::max((size_t)1, s.settings.maxQueue)) {
+        // Live streams: the newest frame is worth more than the oldest one
+        s.queue.pop_front();
+        s.stats.dropped++;
+        kept = false;
+    }
+    else
+        pending++;
+    s.queue.push_back(frame);
+    s.stats.queueDepth = s.queue.size();
+
+    if (!s.scheduled)
+        Schedule(stream);
+
+    return kept;
+}
+
+void StreamEngine::Flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+}
+
+StreamStats StreamEngine::get_Stats(StreamID stream) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    CV_Assert(stream < streams.size());
+    return streams[stream]->stats;
+}
+
+TrackList &StreamEngine::get_TrackList(StreamID stream) {
+    std::lock_guard<std::mutex> lock(mutex);
+    CV_Assert(stream < streams.size());
+    return streams[stream]->tracks;
+}
+
+size_t StreamEngine::get_StreamCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return streams.size();
+}
+
+unsigned int StreamEngine::get_WorkerCount() const {
+    return (unsigned int)workers.size();
+}
+
+void StreamEngine::Schedule(StreamID stream) {
+    Stream &s = *streams[stream];
+    s.scheduled = true;
+
+    // A worker woken up is no longer idle, so that the next stream wakes up another one
+    Worker &home = *workers[s.home];
+    home.runnable.push_back(stream);
+    if (home.idle) {
+        home.idle = false;
+        home.wake.notify_one();
+        return;
+    }
+    // The home worker is busy: let an idle one steal the stream
+    for (auto &worker : workers)
+        if (worker->idle) {
+            worker->idle = false;
+            worker->wake.notify_one();
+            return;
+        }
+}
+
+void StreamEngine::Run(unsigned int index) {
+    Worker &self = *workers[index];
+    set_TraceThreadName("cvBlob worker " + std::to_string(index));
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        StreamID id = 0;
+        bool found = false;
+        if (!self.runnable.empty()) {
+            id = self.runnable.front();
+            self.runnable.pop_front();
+            found = true;
+        }
+        else {
+            // Steal the stream waiting for the longest time on the next busy workers
+            for (size_t k = 1; k < workers.size() && !found; k++) {
+                Worker &victim = *workers[(index + k) % workers.size()];
+                if (!victim.runnable.empty()) {
+                    id = victim.runnable.front();
+                    victim.runnable.pop_front();
+                    found = true;
+                }
+            }
+        }
+
+        if (!found) {
+            if (stopping)
+                return;
+            self.idle = true;
+            self.wake.wait(lock);
+            self.idle = false;
+            continue;
+        }
+
+        Stream &s = *streams[id];
+        if (s.home != index)
+            s.stats.steals++;
+        Frame frame = s.queue.front();
+        s.queue.pop_front();
+        s.stats.queueDepth = s.queue.size();
+        StreamCallback callback = this->callback;
+        lock.unlock();
+
+        // The stream is owned by this worker until it is scheduled again
+        {
+            TraceSpan span("Frame", "streams", "stream", id);
+            s.blobs.LabelImage(frame.img, s.settings.maxLabel);
+            if (s.settings.minArea)
+                s.blobs.FilterByArea(s.settings.minArea);
+            s.tracks.UpdateTracks(s.blobs, s.settings.thDistance, s.settings.thInactive, s.settings.thActive);
+            if (callback) {
+                TraceSpan callbackSpan("Callback", "streams", "stream", id);
+                callback(id, s.blobs, s.tracks);
+            }
+            frame.img.release();
+        }
+        double latency = std::chrono::duration<double>(Clock::now() - frame.submitted).count();
+
+        lock.lock();
+        s.stats.worker = index;
+        s.stats.processed++;
+        s.stats.lastLatency = latency;
+        s.stats.maxLatency = std::max(s.stats.maxLatency, latency);
+        s.total_latency += latency;
+        s.stats.meanLatency = s.total_latency / s.stats.processed;
+
+        // One frame per turn: back to the end of the round robin of the home worker
+        if (!s.queue.empty()) {
+            Worker &home = *workers[s.home];
+            home.runnable.push_back(id);
+            if (home.idle) {
+                home.idle = false;
+                home.wake.notify_one();
+            }
+        }
+        else
+            s.scheduled = false;
+
+        if (--pending == 0)
+            done.notify_all();
+    }
+}
@@ -0,0 +1,192 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file cvb_streams.h
+/// \brief cvBlob multi-stream tracking header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_streams.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_STREAMS_H_
+#define _CVBLOB_STREAMS_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cvb_blob_list.h"
+#include "cvb_defines.h"
+#include "cvb_track.h"
+
+namespace cvb {
+
+    /// \brief Stream identification number.
+    typedef unsigned int StreamID;
+
+    /// \brief Labelling and tracking parameters of a stream.
+    struct CVBLOB_EXPORT StreamSettings {
+        StreamSettings(); ///< Default settings.
+
+        Label maxLabel;          ///< Maximum number of labels (BlobList::LabelImage).
+        unsigned int minArea;    ///< Blobs smaller than this are filtered out (0 keeps them all).
+        double thDistance;       ///< Maximum distance between a track and a blob (TrackList::UpdateTracks).
+        unsigned int thInactive; ///< Maximum number of frames a track can be inactive.
+        unsigned int thActive;   ///< Tracks active for less frames are deleted when they become inactive (0 disables).
+        size_t maxQueue;         ///< Maximum number of frames waiting, the oldest one being dropped beyond.
+    };
+
+    /// \brief Statistics of a stream.
+    /// Latencies are in seconds, from the submission of a frame to the end of its processing.
+    struct CVBLOB_EXPORT StreamStats {
+        size_t queueDepth;   ///< Frames waiting.
+        size_t processed;    ///< Frames processed.
+        size_t dropped;      ///< Frames dropped because the queue was full.
+        size_t steals;       ///< Frames processed by another worker than the home one.
+        unsigned int worker; ///< Worker that processed the last frame.
+        double lastLatency;  ///< Latency of the last frame.
+        double meanLatency;  ///< Mean latency.
+        double maxLatency;   ///< Maximum latency.
+    };
+
+    /// \brief Function called after each processed frame, from a worker thread.
+    /// Calls for one stream never overlap and come in frame order. Calls for different streams can run concurrently.
+    typedef std::function<void(StreamID, const BlobList &, const TrackList &)> StreamCallback;
+
+    /// \brief Labels and tracks many video streams on a fixed pool of worker threads.
+    /// Each stream has its own BlobList and TrackList and a queue of frames, processed in order. A stream with
+    /// frames waiting is runnable, and gets one frame per turn on the round robin of its home worker, so a busy
+    /// stream cannot starve the others. The stream stays on its home worker, whose cache holds its workspace: idle
+    /// workers steal runnable streams from busy ones, but only for one frame.
+    class CVBLOB_EXPORT StreamEngine {
+    public:
+        /// \brief Constructor, starting the workers.
+        /// \param workers Number of worker threads (0 for one per hardware thread).
+        /// \param pinWorkers Whether to bind each worker to a core (Linux only, ignored elsewhere).
+        StreamEngine(unsigned int workers = 0, bool pinWorkers = false);
+
+        /// \brief Destructor, processing the frames waiting and stopping the workers.
+        ~StreamEngine();
+
+        /// \brief Adds a stream.
+        /// \param settings Labelling and tracking parameters.
+        /// \return Stream identification number.
+        StreamID add_Stream(const StreamSettings &settings = StreamSettings());
+
+        /// \brief Sets the function called after each processed frame.
+        /// Must be set before submitting frames.
+        /// \param callback The function.
+        void set_Callback(const StreamCallback &callback);
+
+        /// \brief Queues a frame for processing.
+        /// The image is not copied: it must not be modified until processed.
+        /// \param stream Stream identification number.
+        /// \param img Input binary image (type = CV_8UC1).
+        /// \return False if the queue was full and its oldest frame was dropped.
+        bool Submit(StreamID stream, const cv::Mat &img);
+
+        /// \brief Waits until all the frames submitted have been processed.
+        void Flush();
+
+        /// \brief Gets the statistics of a stream.
+        /// \param stream Stream identification number.
+        /// \return The statistics.
+        StreamStats get_Stats(StreamID stream) const;
+
+        /// \brief Gets the tracker of a stream, e.g. to configure it.
+        /// Only safe while the stream has no frame waiting or being processed, e.g. after Flush.
+        /// \param stream Stream identification number.
+        /// \return The tracker.
+        TrackList &get_TrackList(StreamID stream);
+
+        /// \brief Gets the number of streams.
+        /// \return The number of streams.
+        size_t get_StreamCount() const;
+
+        /// \brief Gets the number of worker threads.
+        /// \return The number of workers.
+        unsigned int get_WorkerCount() const;
+
+    protected:
+        typedef std::chrono::steady_clock Clock; ///< Latency clock.
+
+        /// \brief Frame waiting to be processed.
+        struct Frame {
+            cv::Mat img;                ///< Binary image.
+            Clock::time_point submitted; ///< Submission time.
+        };
+
+        /// \brief Workspace and queue of a stream.
+        struct Stream {
+            StreamSettings settings;  ///< Parameters.
+            BlobList blobs;           ///< Blobs of the last frame.
+            TrackList tracks;         ///< Tracker.
+            std::deque<Frame> queue;  ///< Frames waiting.
+            bool scheduled;           ///< Whether the stream is runnable or being processed.
+            unsigned int home;        ///< Home worker.
+            double total_latency;     ///< Sum of the latencies.
+            StreamStats stats;        ///< Statistics.
+        };
+
+        /// \brief Worker thread and its runnable streams.
+        struct Worker {
+            std::deque<StreamID> runnable; ///< Runnable streams, in turn order.
+            std::condition_variable wake;  ///< Signals a runnable stream or the stop.
+            bool idle;                     ///< Whether the worker waits for work.
+            std::thread thread;            ///< Worker thread.
+        };
+
+        /// \brief Worker thread loop.
+        /// \param index Worker index.
+        void Run(unsigned int index);
+
+        /// \brief Makes a stream runnable on its home worker, waking a worker for it. Called with the mutex held.
+        /// \param stream Stream identification number.
+        void Schedule(StreamID stream);
+
+        std::vector<std::unique_ptr<Stream> > streams; ///< Streams, by identification number.
+        std::vector<std::unique_ptr<Worker> > workers; ///< Workers.
+        StreamCallback callback;                       ///< Called after each frame.
+
+        size_t pending;                 ///< Frames waiting or being processed, over all the streams.
+        bool stopping;                  ///< Whether the workers must stop.
+
+        mutable std::mutex mutex;       ///< Protects the queues, the runnable lists, the flags and the statistics.
+        std::condition_variable done;   ///< Signals that no frame is pending.
+
+    private:
+        StreamEngine(const StreamEngine &);
+        StreamEngine &operator=(const StreamEngine &);
+    };
+
+} // Namespace
+
+#endif // _CVBLOB_STREAMS_H_
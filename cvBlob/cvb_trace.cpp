@@ -0,0 +1,239 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file cvb_trace.cpp
+/// \brief cvBlob timeline tracing source file.
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cvb_trace.h"
+
+using namespace cvb;
+
+namespace {
+    /// \brief Complete event (start and duration).
+    struct TraceEvent {
+        const char *name;
+        const char *category;
+        const char *argName;
+        long long arg;
+        long long start;
+        long long duration;
+    };
+
+    /// \brief Events of one thread.
+    /// Only the owner thread writes events, publishing them through count; the buffer is reset by the owner
+    /// on its first event of a new trace, and then tagged with the trace generation. When its thread exits, the
+    /// buffer goes to the free list with its events, and the next new thread takes it over, tid included.
+    struct ThreadBuffer {
+        std::vector<TraceEvent> events;
+        std::atomic<size_t> count;
+        std::atomic<unsigned int> generation;
+        unsigned int tid;
+        std::string name; ///< Guarded by registry_mutex.
+    };
+
+    std::atomic<bool> tracing(false);
+    std::atomic<unsigned int> generation(0);
+    std::atomic<size_t> capacity(0);
+    std::atomic<size_t> dropped(0);
+    std::atomic<long long> origin(0);
+
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer> > buffers;
+    std::vector<ThreadBuffer *> free_buffers; ///< Buffers of exited threads, guarded by registry_mutex.
+
+    /// \brief Buffer of the calling thread, given back to the free list when the thread exits.
+    struct BufferOwner {
+        BufferOwner() : buffer(nullptr) {}
+
+        ~BufferOwner() {
+            if (!buffer)
+                return;
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            free_buffers.push_back(buffer);
+        }
+
+        ThreadBuffer *buffer;
+    };
+
+    thread_local BufferOwner thread_buffer;
+
+    inline long long nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    ThreadBuffer &threadBuffer() {
+        if (!thread_buffer.buffer) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            if (!free_buffers.empty()) {
+                // Events of the current trace are kept: the threads were not running at the same time
+                thread_buffer.buffer = free_buffers.back();
+                free_buffers.pop_back();
+            }
+            else {
+                buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+                thread_buffer.buffer = buffers.back().get();
+                thread_buffer.buffer->count = 0;
+                thread_buffer.buffer->generation = 0;
+                thread_buffer.buffer->tid = (unsigned int)buffers.size();
+            }
+        }
+        return *thread_buffer.buffer;
+    }
+
+    void record(const TraceEvent &event) {
+        ThreadBuffer &buffer = threadBuffer();
+
+        unsigned int current = generation.load(std::memory_order_acquire);
+        if (buffer.generation.load(std::memory_order_relaxed) != current) {
+            buffer.count.store(0, std::memory_order_relaxed);
+            buffer.events.resize(capacity.load(std::memory_order_relaxed));
+            buffer.generation.store(current, std::memory_order_release);
+        }
+
+        size_t n = buffer.count.load(std::memory_order_relaxed);
+        if (n >= buffer.events.size()) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        buffer.events[n] = event;
+        buffer.count.store(n + 1, std::memory_order_release);
+    }
+
+    void writeString(std::ostream &out, const char *s) {
+        out << '"';
+        for (; *s; s++) {
+            if (*s == '"' || *s == '\\')
+                out << '\\';
+            if ((unsigned char)*s >= 0x20)
+                out << *s;
+        }
+        out << '"';
+    }
+}  // namespace
+
+void cvb::StartTracing(size_t eventsPerThread) {
+    tracing.store(false);
+    capacity.store(eventsPerThread);
+    dropped.store(0);
+    origin.store(nowNs());
+    generation.fetch_add(1, std::memory_order_release);
+
+    // The events of the exited threads belong to the previous trace: their storage is released
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto buffer : free_buffers) {
+            std::vector<TraceEvent>().swap(buffer->events);
+            buffer->count.store(0, std::memory_order_relaxed);
+            buffer->name.clear();
+        }
+    }
+    tracing.store(true);
+}
+
+void cvb::StopTracing() {
+    tracing.store(false);
+}
+
+bool cvb::IsTracing() {
+    return tracing.load(std::memory_order_relaxed);
+}
+
+void cvb::set_TraceThreadName(const std::string &name) {
+    ThreadBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    buffer.name = name;
+}
+
+size_t cvb::get_TraceDropped() {
+    return dropped.load();
+}
+
+bool cvb::WriteTrace(const std::string &filename) {
+    std::ofstream out(filename);
+    if (!out)
+        return false;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    unsigned int current = generation.load(std::memory_order_acquire);
+    long long start = origin.load();
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    for (auto &buffer : buffers) {
+        if (!buffer->name.empty()) {
+            out << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"args\":{\"name\":";
+            writeString(out, buffer->name.c_str());
+            out << "}}";
+            first = false;
+        }
+
+        if (buffer->generation.load(std::memory_order_acquire) != current)
+            continue;
+
+        // Timestamps in microseconds
+        size_t n = buffer->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; i++) {
+            const TraceEvent &event = buffer->events[i];
+            out << (first ? "\n" : ",\n") << "{\"ph\":\"X\",\"name\":";
+            writeString(out, event.name);
+            out << ",\"cat\":";
+            writeString(out, event.category);
+            out << ",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << (event.start - start) / 1e3
+                << ",\"dur\":" << event.duration / 1e3;
+            if (event.argName) {
+                out << ",\"args\":{";
+                writeString(out, event.argName);
+                out << ":" << event.arg << "}";
+            }
+            out << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+
+    return (bool)out;
+}
+
+TraceSpan::TraceSpan(const char *name, const char *category, const char *argName, long long arg) :
+    name(name), category(category), arg_name(argName), arg(arg), start(-1) {
+    if (tracing.load(std::memory_order_relaxed))
+        start = nowNs();
+}
+
+TraceSpan::~TraceSpan() {
+    if (start < 0 || !tracing.load(std::memory_order_relaxed))
+        return;
+
+    TraceEvent event = {name, category, arg_name, arg, start, nowNs() - start};
+    record(event);
+}
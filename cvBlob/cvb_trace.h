@@ -0,0 +1,103 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file cvb_trace.h
+/// \brief cvBlob timeline tracing header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_trace.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_TRACE_H_
+#define _CVBLOB_TRACE_H_
+
+#include <cstddef>
+#include <string>
+
+#include "cvb_defines.h"
+
+namespace cvb {
+
+    /// \brief Starts recording trace events, discarding those recorded before.
+    /// Each thread records into its own buffer, without locking. The buffer of a thread is allocated by its first
+    /// event; events beyond its capacity are dropped. The buffers of exited threads are taken over by new threads,
+    /// events included, so memory is bounded by the number of threads running at the same time; their storage is
+    /// released here.
+    /// \param eventsPerThread Capacity of each thread buffer.
+    /// \see WriteTrace
+    CVBLOB_EXPORT void StartTracing(size_t eventsPerThread = 65536);
+
+    /// \brief Stops recording trace events. The events recorded are kept until the next StartTracing.
+    CVBLOB_EXPORT void StopTracing();
+
+    /// \brief Tells whether trace events are being recorded.
+    /// \return True between StartTracing and StopTracing.
+    CVBLOB_EXPORT bool IsTracing();
+
+    /// \brief Names the calling thread in the trace.
+    /// \param name Thread name.
+    CVBLOB_EXPORT void set_TraceThreadName(const std::string &name);
+
+    /// \brief Gets the number of events dropped because a thread buffer was full, since StartTracing.
+    /// \return Number of events dropped.
+    CVBLOB_EXPORT size_t get_TraceDropped();
+
+    /// \brief Writes the recorded events in the Chrome trace event format (JSON).
+    /// The file can be opened in chrome://tracing or https://ui.perfetto.dev. Should be called once the traced
+    /// threads are done: events recorded meanwhile may or may not be written.
+    /// \param filename File name.
+    /// \return False if the file could not be written.
+    CVBLOB_EXPORT bool WriteTrace(const std::string &filename);
+
+    /// \brief Timed span of a trace, from construction to destruction.
+    /// Costs a single flag test when not tracing. Labelling, filtering, tracking and rendering are traced by the
+    /// library; applications can add their own spans.
+    class CVBLOB_EXPORT TraceSpan {
+    public:
+        /// \brief Constructor, starting the span.
+        /// Strings are not copied: they must outlive the trace, string literals usually.
+        /// \param name Span name.
+        /// \param category Span category.
+        /// \param argName Name of an integer argument shown with the span (none by default).
+        /// \param arg Value of the argument.
+        TraceSpan(const char *name, const char *category, const char *argName = nullptr, long long arg = 0);
+
+        /// \brief Destructor, ending the span.
+        ~TraceSpan();
+
+    private:
+        TraceSpan(const TraceSpan &) = delete;
+        TraceSpan &operator=(const TraceSpan &) = delete;
+
+        const char *name;     ///< Span name.
+        const char *category; ///< Span category.
+        const char *arg_name; ///< Argument name, or null.
+        long long arg;        ///< Argument value.
+        long long start;      ///< Start time in nanoseconds, negative when not tracing.
+    };
+
+} // Namespace
+
+#endif // _CVBLOB_TRACE_H_
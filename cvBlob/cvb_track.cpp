@@ -20,346 +20,1060 @@
 // along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
 //
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <queue>
 #include <sstream>
+#include <utility>
+#include <vector>
 
+#include "cvb_aux.h"
+#include "cvb_trace.h"
 #include "cvb_track.h"
 
 using namespace cvb;
 
-double Track::DistanceFromBlob(const Blob &b) const {
-    double d1;
-    cv::Point blob_centroid = b.get_Centroid();
-
-    if (blob_centroid.x < this->minx) {
-        if (blob_centroid.y < this->miny)
-            d1 = std::max(this->minx - blob_centroid.x, this->miny - blob_centroid.y);
-        else if (blob_centroid.y > this->maxy)
-            d1 = std::max(this->minx - blob_centroid.x, blob_centroid.y - this->maxy);
-        else // if (this->miny < blob_centroid.y)&&(blob_centroid.y < this->maxy)
-            d1 = this->minx - blob_centroid.x;
-    } else if (blob_centroid.x > this->maxx) {
-        if (blob_centroid.y < this->miny)
-            d1 = std::max(blob_centroid.x - this->maxx, this->miny - blob_centroid.y);
-        else if (blob_centroid.y > this->maxy)
-            d1 = std::max(blob_centroid.x - this->maxx, blob_centroid.y - this->maxy);
-        else
-            d1 = blob_centroid.x - this->maxx;
-    } else { //if (this->minx =< blob_centroid.x) && (blob_centroid.x =< this->maxx)
-        if (blob_centroid.y < this->miny)
-            d1 = this->miny - blob_centroid.y;
-        else if (blob_centroid.y > this->maxy)
-            d1 = blob_centroid.y - this->maxy;
-        else 
-            return 0.;
+namespace {
+    /// \brief Initial variance of the velocity of new tracks, in pixels per frame squared.
+    const double kInitialVelocityVariance = 100.;
+
+    /// \brief Tag of the tracker snapshots ("CVBT").
+    const uint32_t kSnapshotMagic = 0x54425643;
+
+    /// \brief Version of the tracker snapshots.
+    const uint32_t kSnapshotVersion = 2;
+
+    /// \brief Counts the foreground pixels outside of some regions, on every stride-th row from the first one.
+    unsigned int countOutside(const cv::Mat &img, const std::vector<cv::Rect> &regions, unsigned int first, unsigned int stride) {
+        unsigned int count = 0;
+        std::vector<std::pair<int, int> > spans;
+        for (int y = first; y < img.rows; y += stride) {
+            spans.clear();
+            for (auto &region : regions)
+                if (y >= region.y && y < region.y + region.height)
+                    spans.push_back(std::make_pair(region.x, region.x + region.width));
+            std::sort(spans.begin(), spans.end());
+            spans.push_back(std::make_pair(img.cols, img.cols));
+
+            const unsigned char *row = img.ptr(y);
+            int x = 0;
+            for (auto &span : spans) {
+                for (; x < span.first; x++)
+                    count += row[x] != 0;
+                x = std::max(x, span.second);
+            }
+        }
+        return count;
     }
+}  // namespace
 
-    double d2;
-    cv::Rect bounding_box = b.get_BoundingBox();
-    unsigned int blob_minx = bounding_box.x;
-    unsigned int blob_miny = bounding_box.y;
-    unsigned int blob_maxx = blob_minx + bounding_box.width;
-    unsigned int blob_maxy = blob_miny + bounding_box.height;
-
-    if (this->centroid.x < blob_minx) {
-        if (this->centroid.y < blob_miny)
-            d2 = std::max(blob_minx - this->centroid.x, blob_miny - this->centroid.y);
-        else if (this->centroid.y > blob_maxy)
-            d2 = std::max(blob_minx - this->centroid.x, this->centroid.y - blob_maxy);
-        else // if (blob_miny < this->centroid.y)&&(this->centroid.y < blob_maxy)
-            d2 = minx - this->centroid.x;
-    } else if (this->centroid.x > blob_maxx) {
-        if (this->centroid.y < blob_miny)
-            d2 = std::max(this->centroid.x - blob_maxx, blob_miny - this->centroid.y);
-        else if (this->centroid.y > blob_maxy)
-            d2 = std::max(this->centroid.x - blob_maxx, this->centroid.y - blob_maxy);
-        else
-            d2 = this->centroid.x - blob_maxx;
-    } else { // if (blob_minx =< this->centroid.x) && (this->centroid.x =< blob_maxx)
-        if (this->centroid.y < blob_miny)
-            d2 = blob_miny - this->centroid.y;
-        else if (this->centroid.y > blob_maxy)
-            d2 = this->centroid.y - blob_maxy;
-        else 
-            return 0.;
+Track::Track() : id(0), label(0), minx(0), maxx(0), miny(0), maxy(0), var_position(0.), cov_position_velocity(0.),
+    var_velocity(0.), coasted(0), lifetime(0), active(0), inactive(0) {}
+
+Track::Track(TrackID id, const Blob &blob, double measurementNoise) : id(id), coasted(0), lifetime(0), active(0), inactive(0) {
+    set_Observation(blob);
+
+    position = centroid;
+    velocity = cv::Point2d(0., 0.);
+    var_position = measurementNoise;
+    cov_position_velocity = 0.;
+    var_velocity = kInitialVelocityVariance;
+}
+
+TrackID Track::get_ID() const {
+    return id;
+}
+
+Label Track::get_Label() const {
+    return label;
+}
+
+cv::Rect Track::get_BoundingBox() const {
+    return cv::Rect(minx, miny, maxx - minx + 1, maxy - miny + 1);
+}
+
+cv::Point2d Track::get_Centroid() const {
+    return centroid;
+}
+
+unsigned int Track::get_Lifetime() const {
+    return lifetime;
+}
+
+unsigned int Track::get_Active() const {
+    return active;
+}
+
+unsigned int Track::get_Inactive() const {
+    return inactive;
+}
+
+namespace {
+    /// \brief Chessboard distance from a point to a box, 0 inside.
+    inline double distancePointBox(const cv::Point2d &p, double minx, double miny, double maxx, double maxy) {
+        double dx = std::max(0., std::max(minx - p.x, p.x - maxx));
+        double dy = std::max(0., std::max(miny - p.y, p.y - maxy));
+        return std::max(dx, dy);
     }
+}  // namespace
+
+bool Track::get_Measured() const {
+    return !coasted && !inactive;
+}
+
+cv::Point2d Track::get_Innovation() const {
+    return innovation;
+}
+
+cv::Point2d Track::get_Velocity() const {
+    return velocity;
+}
+
+double Track::get_PredictionDeviation() const {
+    return std::sqrt(var_position);
+}
+
+cv::Point2d Track::get_PredictedCentroid() const {
+    return centroid + predicted_offset;
+}
+
+cv::Rect Track::get_PredictedBoundingBox() const {
+    cv::Point shift((int)std::floor(predicted_offset.x + .5), (int)std::floor(predicted_offset.y + .5));
+    return get_BoundingBox() + shift;
+}
+
+double Track::DistanceFromBlob(const Blob &b) const {
+    double dx = predicted_offset.x;
+    double dy = predicted_offset.y;
+    double d1 = distancePointBox(b.get_Centroid(), minx + dx, miny + dy, maxx + dx, maxy + dy);
+
+    cv::Rect box = b.get_BoundingBox();
+    double d2 = distancePointBox(get_PredictedCentroid(), box.x, box.y, box.x + box.width - 1, box.y + box.height - 1);
 
     return std::min(d1, d2);
 }
 
-// Access to matrix
-//#define C(blob, track) close[((blob) + (track)*(nBlobs+2))]
+void Track::Predict(double processNoise) {
+    // x' = x + v, P' = F P F^T + Q, with white noise acceleration
+    position += velocity;
+    var_position += 2. * cov_position_velocity + var_velocity + processNoise / 4.;
+    cov_position_velocity += var_velocity + processNoise / 2.;
+    var_velocity += processNoise;
+
+    predicted_offset = position - centroid;
+}
+
+void Track::update_Blob(const Blob &blob, double measurementNoise) {
+    set_Observation(blob);
+
+    // Kalman correction, the centroid being the measured position
+    double innovationVariance = var_position + measurementNoise;
+    double gainPosition = var_position / innovationVariance;
+    double gainVelocity = cov_position_velocity / innovationVariance;
+    innovation = centroid - position;
+
+    position += innovation * gainPosition;
+    velocity += innovation * gainVelocity;
+    var_velocity -= gainVelocity * cov_position_velocity;
+    cov_position_velocity -= gainPosition * cov_position_velocity;
+    var_position -= gainPosition * var_position;
+
+    if (inactive)
+        active = 0;
+    inactive = 0;
+}
+
+void Track::set_Observation(const Blob &blob) {
+    cv::Rect box = blob.get_BoundingBox();
+
+    label = blob.label;
+    centroid = blob.get_Centroid();
+    minx = box.x;
+    miny = box.y;
+    maxx = box.x + box.width - 1;
+    maxy = box.y + box.height - 1;
+
+    predicted_offset = cv::Point2d(0., 0.);
+    coasted = 0;
+}
+
+void Track::Coast(bool predict, double processNoise) {
+    if (predict)
+        Predict(processNoise);
+    coasted++;
+}
+
+void Track::IncreaseInactive() {
+    inactive++;
+    label = 0;
+}
+
+void Track::IncreaseLifetime() {
+    lifetime++;
+    if (!inactive)
+        active++;
+}
+
+bool Track::IsTooOld(const unsigned int thInactive, const unsigned int thActive) const {
+    return (inactive >= thInactive) || (inactive && thActive && active < thActive);
+}
+
+void Track::Print(std::ostream &out) const {
+    out << id << ": " << (int)label << ", (" << centroid.x << ", " << centroid.y << "), [(" << minx << ", " << miny << ") - (" << maxx << ", " << maxy << ")], " << lifetime << ", " << active << ", " << inactive;
+}
+
+void Track::Write(std::vector<unsigned char> &data) const {
+    AppendBytes(data, id);
+    AppendBytes(data, label);
+    AppendBytes(data, minx);
+    AppendBytes(data, maxx);
+    AppendBytes(data, miny);
+    AppendBytes(data, maxy);
+    AppendBytes(data, centroid);
+    AppendBytes(data, position);
+    AppendBytes(data, velocity);
+    AppendBytes(data, var_position);
+    AppendBytes(data, cov_position_velocity);
+    AppendBytes(data, var_velocity);
+    AppendBytes(data, predicted_offset);
+    AppendBytes(data, innovation);
+    AppendBytes(data, coasted);
+    AppendBytes(data, lifetime);
+    AppendBytes(data, active);
+    AppendBytes(data, inactive);
+}
 
-// Access to accumulators
-//#define AB(label) C((label), (nTracks))
-//#define AT(id) C((nBlobs), (id))
+std::shared_ptr<Track> Track::Read(const unsigned char *&data, const unsigned char *end) {
+    std::shared_ptr<Track> track(new Track());
+    const unsigned char *start = data;
+    bool complete = ReadBytes(data, end, track->id) && ReadBytes(data, end, track->label) &&
+        ReadBytes(data, end, track->minx) && ReadBytes(data, end, track->maxx) &&
+        ReadBytes(data, end, track->miny) && ReadBytes(data, end, track->maxy) &&
+        ReadBytes(data, end, track->centroid) && ReadBytes(data, end, track->position) &&
+        ReadBytes(data, end, track->velocity) && ReadBytes(data, end, track->var_position) &&
+        ReadBytes(data, end, track->cov_position_velocity) && ReadBytes(data, end, track->var_velocity) &&
+        ReadBytes(data, end, track->predicted_offset) && ReadBytes(data, end, track->innovation) &&
+        ReadBytes(data, end, track->coasted) && ReadBytes(data, end, track->lifetime) &&
+        ReadBytes(data, end, track->active) && ReadBytes(data, end, track->inactive);
 
-// Access to identifications
-#define IB(label) C((label), (nTracks)+1)
-#define IT(id) C((nBlobs)+1, (id))
+    if (!complete) {
+        data = start;
+        track.reset();
+    }
+    return track;
+}
 
-// Access to registers
-#define B(label) blob_map.find(IB(label))->second
-#define T(id) tracks.find(IT(id))->second
+std::ostream &cvb::operator<< (std::ostream &output, const Track &t) {
+    t.Print(output);
+    return output;
+}
 
-inline TrackID &C(unsigned int blob, unsigned int track, std::vector<TrackID> &close, unsigned int nBlobs) {
-    return close[blob + track * (nBlobs + 2)];
+double cvb::CentroidDistanceCost(const Track &track, const Blob &blob) {
+    cv::Point2d d = track.get_PredictedCentroid() - blob.get_Centroid();
+    return std::sqrt(d.x * d.x + d.y * d.y);
 }
 
-inline TrackID &AB(unsigned int label, unsigned int nTracks, std::vector<TrackID> &close, unsigned int nBlobs) {
-    return C(label, nTracks, close, nBlobs);
+double cvb::OverlapCost(const Track &track, const Blob &blob) {
+    cv::Rect a = track.get_PredictedBoundingBox();
+    cv::Rect b = blob.get_BoundingBox();
+    double intersection = (a & b).area();
+
+    return 1. - intersection / (a.area() + b.area() - intersection);
 }
 
-inline TrackID &AT(unsigned int id, unsigned int nTracks, std::vector<TrackID> &close, unsigned int nBlobs) {
-    return C(nBlobs, id, close, nBlobs);
+AssociationCost cvb::LabelOverlapCost(const LabelOverlap &overlap) {
+    const LabelOverlap *labelOverlap = &overlap;
+    return [labelOverlap](const Track &track, const Blob &blob) {
+        return 1. - labelOverlap->get_IntersectionOverUnion(track.get_Label(), blob.label);
+    };
 }
 
+void cvb::SolveAssignment(size_t nRows, size_t nCols, const std::vector<AssignmentEdge> &edges, std::vector<int> &rowMatch) {
+    rowMatch.assign(nRows, -1);
+    if (edges.empty())
+        return;
+
+    // Edges by row
+    std::vector<size_t> starts(nRows + 1, 0);
+    for (auto &an_edge : edges) {
+        CV_Assert(an_edge.row < nRows && an_edge.col < nCols && an_edge.cost >= 0.);
+        starts[an_edge.row + 1]++;
+    }
+    for (size_t r = 0; r < nRows; r++)
+        starts[r + 1] += starts[r];
 
-void getClusterForTrack(unsigned int trackPos, std::vector<TrackID> &close, unsigned int nBlobs, unsigned int nTracks, const BlobsMap &blob_map, TrackList const &tracks, std::list<SharedBlob> &bb, std::list<SharedTrack> &tt);
+    std::vector<size_t> cols(edges.size());
+    std::vector<double> costs(edges.size());
+    std::vector<size_t> next(starts.begin(), starts.end() - 1);
+    for (auto &an_edge : edges) {
+        size_t k = next[an_edge.row]++;
+        cols[k] = an_edge.col;
+        costs[k] = an_edge.cost;
+    }
 
-void getClusterForBlob(unsigned int blobPos, std::vector<TrackID> &close, unsigned int nBlobs, unsigned int nTracks, const BlobsMap &blob_map, TrackList const &tracks, std::list<SharedBlob> &bb, std::list<SharedTrack> &tt) {
-    for (unsigned int j = 0; j < nTracks; j++) {
-        if (C(blobPos, j, close, nBlobs)) {
-            tt.push_back(T(j));
+    // Nodes: rows [0, nRows), columns [nRows, nRows + nCols)
+    const double infinity = std::numeric_limits<double>::infinity();
+    size_t nNodes = nRows + nCols;
+    std::vector<int> colMatch(nCols, -1);
+    std::vector<double> matchedCost(nRows, 0.);
+    std::vector<double> potentials(nNodes, 0.);
+    std::vector<double> distances(nNodes);
+    std::vector<size_t> previousRow(nCols);
+    std::vector<double> previousCost(nCols);
 
-            unsigned int c = AT(j);
+    typedef std::pair<double, size_t> QueueItem;
 
-            C(blobPos, j, close, nBlobs) = 0;
-            AB(blobPos, nTracks, close, nBlobs)--;
-            AT(j)--;
+    for (;;) {
+        std::fill(distances.begin(), distances.end(), infinity);
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem> > queue;
 
-            if (c>1) {
-                getClusterForTrack(j, close, nBlobs, nTracks, blob_map, tracks, bb, tt);
+        for (size_t r = 0; r < nRows; r++) {
+            if (rowMatch[r] < 0 && starts[r] != starts[r + 1]) {
+                distances[r] = 0.;
+                queue.push(QueueItem(0., r));
             }
         }
+
+        // Shortest augmenting path, on reduced costs
+        int target = -1;
+        double length = 0.;
+        while (!queue.empty()) {
+            QueueItem item = queue.top();
+            queue.pop();
+            size_t u = item.second;
+            if (item.first > distances[u])
+                continue;
+
+            if (u >= nRows) {
+                size_t c = u - nRows;
+                if (colMatch[c] < 0) {
+                    target = (int)c;
+                    length = item.first;
+                    break;
+                }
+
+                // Back along the matched edge
+                size_t r = colMatch[c];
+                double d = item.first - matchedCost[r] + potentials[u] - potentials[r];
+                if (d < distances[r]) {
+                    distances[r] = d;
+                    queue.push(QueueItem(d, r));
+                }
+            } else {
+                for (size_t k = starts[u]; k < starts[u + 1]; k++) {
+                    size_t c = cols[k];
+                    if (rowMatch[u] == (int)c)
+                        continue;
+
+                    size_t v = nRows + c;
+                    double d = item.first + costs[k] + potentials[u] - potentials[v];
+                    if (d < distances[v]) {
+                        distances[v] = d;
+                        previousRow[c] = u;
+                        previousCost[c] = costs[k];
+                        queue.push(QueueItem(d, v));
+                    }
+                }
+            }
+        }
+
+        if (target < 0)
+            break;
+
+        // Keep the reduced costs non-negative
+        for (size_t v = 0; v < nNodes; v++)
+            potentials[v] += std::min(distances[v], length);
+
+        // Augment
+        size_t c = target;
+        for (;;) {
+            size_t r = previousRow[c];
+            int freed = rowMatch[r];
+            rowMatch[r] = (int)c;
+            colMatch[c] = (int)r;
+            matchedCost[r] = previousCost[c];
+            if (freed < 0)
+                break;
+            c = freed;
+        }
     }
 }
 
-void getClusterForTrack(unsigned int trackPos, std::vector<TrackID> &close, unsigned int nBlobs, unsigned int nTracks, const BlobsMap &blob_map, TrackList const &tracks, std::list<SharedBlob> &bb, std::list<SharedTrack> &tt) {
-    for (unsigned int i=0; i<nBlobs; i++) {
-        if (C(i, trackPos)) {
-            bb.push_back(B(i));
+namespace {
+    /// \brief Uniform grid of points, stored as sorted cell ranges.
+    class PointGrid {
+    public:
+        PointGrid(const std::vector<cv::Point2d> &points, const cv::Point2d &origin, double cellSize, int cols, int rows)
+            : origin(origin), cellSize(cellSize), cols(cols), rows(rows), starts(cols * rows + 1, 0), items(points.size()) {
+            std::vector<int> cells(points.size());
+            for (size_t i = 0; i < points.size(); i++) {
+                cells[i] = get_Cell(points[i]);
+                starts[cells[i] + 1]++;
+            }
+            for (size_t c = 0; c + 1 < starts.size(); c++)
+                starts[c + 1] += starts[c];
+
+            std::vector<size_t> next(starts.begin(), starts.end() - 1);
+            for (size_t i = 0; i < points.size(); i++)
+                items[next[cells[i]]++] = i;
+        }
+
+        /// \brief Calls f(index) for the points in the cells overlapping a box.
+        template <typename F>
+        void ForEachInBox(double minx, double miny, double maxx, double maxy, F f) const {
+            int x0 = clampCol(minx);
+            int x1 = clampCol(maxx);
+            int y0 = clampRow(miny);
+            int y1 = clampRow(maxy);
+
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    int c = y * cols + x;
+                    for (size_t k = starts[c]; k < starts[c + 1]; k++)
+                        f(items[k]);
+                }
+            }
+        }
+
+    private:
+        int clampCol(double x) const {
+            return std::min(cols - 1, std::max(0, (int)std::floor((x - origin.x) / cellSize)));
+        }
+
+        int clampRow(double y) const {
+            return std::min(rows - 1, std::max(0, (int)std::floor((y - origin.y) / cellSize)));
+        }
+
+        int get_Cell(const cv::Point2d &p) const {
+            return clampRow(p.y) * cols + clampCol(p.x);
+        }
 
-            unsigned int c = AB(i);
+        cv::Point2d origin;
+        double cellSize;
+        int cols;
+        int rows;
+        std::vector<size_t> starts;
+        std::vector<size_t> items;
+    };
 
-            C(i, trackPos) = 0;
-            AB(i)--;
-            AT(trackPos)--;
+    /// \brief Union-find with path halving.
+    class DisjointSets {
+    public:
+        explicit DisjointSets(size_t n) : parents(n) {
+            for (size_t i = 0; i < n; i++)
+                parents[i] = i;
+        }
 
-            if (c>1) {
-                getClusterForBlob(i, close, nBlobs, nTracks, blob_map, tracks, bb, tt);
+        size_t Find(size_t i) {
+            while (parents[i] != i) {
+                parents[i] = parents[parents[i]];
+                i = parents[i];
             }
+            return i;
+        }
+
+        void Union(size_t a, size_t b) {
+            a = Find(a);
+            b = Find(b);
+            if (a != b)
+                parents[std::max(a, b)] = std::min(a, b);
         }
+
+    private:
+        std::vector<size_t> parents;
+    };
+
+    /// \brief Number of standard deviations of the predicted position added to the gating distance.
+    const double kGateSigmas = 3.;
+
+    /// \brief Finds the (blob, track) pairs closer than the gating distance of the track.
+    /// A pair is close if the blob centroid is near the predicted track box, or the predicted track centroid near
+    /// the blob box: both are found with uniform grids of points, queried by boxes expanded by the gating distance.
+    void gatePairs(const std::vector<SharedBlob> &bb, const std::vector<SharedTrack> &tt, const std::vector<double> &gates, std::vector<std::pair<size_t, size_t> > &close) {
+        size_t nBlobs = bb.size();
+        size_t nTracks = tt.size();
+        close.clear();
+
+        if (!nBlobs || !nTracks)
+            return;
+
+        std::vector<cv::Point2d> blobCentroids(nBlobs);
+        std::vector<cv::Rect> blobBoxes(nBlobs);
+        std::vector<cv::Point2d> trackCentroids(nTracks);
+        std::vector<cv::Rect> trackBoxes(nTracks);
+
+        double minx = std::numeric_limits<double>::max();
+        double miny = std::numeric_limits<double>::max();
+        double maxx = -std::numeric_limits<double>::max();
+        double maxy = -std::numeric_limits<double>::max();
+        double side = 0.;
+        double maxGate = *std::max_element(gates.begin(), gates.end());
+
+        for (size_t i = 0; i < nBlobs; i++) {
+            blobCentroids[i] = bb[i]->get_Centroid();
+            blobBoxes[i] = bb[i]->get_BoundingBox();
+            side += std::max(blobBoxes[i].width, blobBoxes[i].height);
+            minx = std::min(minx, blobCentroids[i].x);
+            miny = std::min(miny, blobCentroids[i].y);
+            maxx = std::max(maxx, blobCentroids[i].x);
+            maxy = std::max(maxy, blobCentroids[i].y);
+        }
+        for (size_t j = 0; j < nTracks; j++) {
+            trackCentroids[j] = tt[j]->get_PredictedCentroid();
+            trackBoxes[j] = tt[j]->get_PredictedBoundingBox();
+            side += std::max(trackBoxes[j].width, trackBoxes[j].height);
+            minx = std::min(minx, trackCentroids[j].x);
+            miny = std::min(miny, trackCentroids[j].y);
+            maxx = std::max(maxx, trackCentroids[j].x);
+            maxy = std::max(maxy, trackCentroids[j].y);
+        }
+
+        // Cells no smaller than the gating distance and the mean box size, and no more cells than points
+        double cellSize = std::max(1., std::max(maxGate, side / (nBlobs + nTracks)));
+        double maxCells = 4. * (nBlobs + nTracks);
+        while (((maxx - minx) / cellSize + 1.) * ((maxy - miny) / cellSize + 1.) > maxCells)
+            cellSize *= 2.;
+        int cols = (int)((maxx - minx) / cellSize) + 1;
+        int rows = (int)((maxy - miny) / cellSize) + 1;
+        cv::Point2d origin(minx, miny);
+
+        PointGrid blobGrid(blobCentroids, origin, cellSize, cols, rows);
+        for (size_t j = 0; j < nTracks; j++) {
+            const cv::Rect &box = trackBoxes[j];
+            // One more pixel: the predicted box is rounded
+            double gate = gates[j] + 1.;
+            blobGrid.ForEachInBox(box.x - gate, box.y - gate, box.x + box.width - 1 + gate, box.y + box.height - 1 + gate,
+                                  [&](size_t i) { close.push_back(std::make_pair(i, j)); });
+        }
+
+        PointGrid trackGrid(trackCentroids, origin, cellSize, cols, rows);
+        for (size_t i = 0; i < nBlobs; i++) {
+            const cv::Rect &box = blobBoxes[i];
+            trackGrid.ForEachInBox(box.x - maxGate, box.y - maxGate, box.x + box.width - 1 + maxGate, box.y + box.height - 1 + maxGate,
+                                   [&](size_t j) { close.push_back(std::make_pair(i, j)); });
+        }
+
+        std::sort(close.begin(), close.end());
+        close.erase(std::unique(close.begin(), close.end()), close.end());
+        close.erase(std::remove_if(close.begin(), close.end(), [&](const std::pair<size_t, size_t> &a_pair) {
+            return !(tt[a_pair.second]->DistanceFromBlob(*bb[a_pair.first]) < gates[a_pair.second]);
+        }), close.end());
     }
+}  // namespace
+
+TrackList::TrackList() : last_id(0), association_mode(AssociationMode_greedy), association_cost(CentroidDistanceCost),
+    motion_prediction(true), process_noise(1.), measurement_noise(1.), label_overlap_enabled(false),
+    frame(0), trajectories_enabled(false) {}
+
+const TracksMap &TrackList::get_Tracks() const {
+    return tracks;
+}
+
+void TrackList::set_AssociationMode(AssociationMode mode) {
+    association_mode = mode;
+}
+
+void TrackList::set_AssociationCost(const AssociationCost &cost) {
+    association_cost = cost;
+}
+
+void TrackList::set_LabelOverlap(bool enabled) {
+    label_overlap_enabled = enabled;
+    if (!enabled) {
+        label_overlap.clear();
+        previous_labels.release();
+    }
+}
+
+const LabelOverlap &TrackList::get_LabelOverlap() const {
+    return label_overlap;
+}
+
+void TrackList::set_Trajectories(bool enabled, size_t capacity) {
+    trajectories_enabled = enabled;
+    trajectories = TrajectoryStore(capacity);
+}
+
+void TrackList::PredictTracks() {
+    TraceSpan span("PredictTracks", "tracking");
+    for (auto &a_track : tracks) {
+        a_track.second->Coast(motion_prediction, process_noise);
+        a_track.second->IncreaseLifetime();
+    }
+
+    frame++;
+}
+
+void TrackList::Snapshot(std::vector<unsigned char> &data) const {
+    data.clear();
+    AppendBytes(data, kSnapshotMagic);
+    AppendBytes(data, kSnapshotVersion);
+    AppendBytes(data, last_id);
+    AppendBytes(data, frame);
+
+    AppendBytes(data, (uint64_t)tracks.size());
+    for (auto &a_track : tracks)
+        a_track.second->Write(data);
+
+    AppendBytes(data, (uint8_t)trajectories_enabled);
+    if (trajectories_enabled)
+        trajectories.Write(data);
+}
+
+bool TrackList::Restore(const unsigned char *data, size_t size) {
+    const unsigned char *end = data + size;
+    uint32_t magic, version;
+    TrackID newLastId;
+    uint32_t newFrame;
+    uint64_t count;
+    if (!ReadBytes(data, end, magic) || magic != kSnapshotMagic || !ReadBytes(data, end, version) || version != kSnapshotVersion)
+        return false;
+    if (!ReadBytes(data, end, newLastId) || !ReadBytes(data, end, newFrame) || !ReadBytes(data, end, count))
+        return false;
+
+    TracksMap newTracks;
+    for (uint64_t k = 0; k < count; k++) {
+        SharedTrack track = Track::Read(data, end);
+        if (!track || track->get_ID() > newLastId || !newTracks.insert(IDTrackPair(track->get_ID(), track)).second)
+            return false;
+    }
+
+    uint8_t withTrajectories;
+    if (!ReadBytes(data, end, withTrajectories))
+        return false;
+    TrajectoryStore newTrajectories(trajectories.get_Capacity());
+    if (withTrajectories && !newTrajectories.Read(data, end))
+        return false;
+    if (data != end)
+        return false;
+
+    tracks.swap(newTracks);
+    last_id = newLastId;
+    frame = newFrame;
+    // Trajectories are only kept where they are recorded
+    if (!trajectories_enabled)
+        newTrajectories.clear();
+    std::swap(trajectories, newTrajectories);
+
+    // The label image and the events of the tracks before the restart are gone
+    label_overlap.clear();
+    previous_labels.release();
+    if (event_engine)
+        event_engine->clear();
+
+    return true;
+}
+
+void TrackList::set_EventEngine(const SharedEventEngine &engine) {
+    event_engine = engine;
+}
+
+TrajectoryStore &TrackList::get_Trajectories() {
+    return trajectories;
+}
+
+const TrajectoryStore &TrackList::get_Trajectories() const {
+    return trajectories;
+}
+
+void TrackList::set_MotionPrediction(bool enabled, double processNoise, double measurementNoise) {
+    motion_prediction = enabled;
+    process_noise = processNoise;
+    measurement_noise = measurementNoise;
 }
 
 void TrackList::UpdateTracks(const BlobList &blobs, const double thDistance, const unsigned int thInactive, const unsigned int thActive) {
-    auto blob_map = blobs.get_BlobsMap();
-    size_t nBlobs = blob_map.size();
-    size_t nTracks = tracks.size();
-
-    // Proximity matrix:
-    // Last row/column is for ID/label.
-    // Last-1 "/" is for accumulation.
-    std::vector<TrackID> close((nBlobs + 2) * (nTracks + 2));
-
-    try {
-        // Initialization
-        unsigned int i=0;
-        for (auto & a_blob : blob_map) {
-            AB(i) = 0;
-            IB(i) = a_blob.second->label;
-            i++;
-        }
+    TraceSpan span("UpdateTracks", "tracking");
+    std::list<SharedBlob> blob_list = blobs.get_BlobsList();
+    std::vector<SharedBlob> bb(blob_list.begin(), blob_list.end());
+    std::vector<SharedTrack> tt;
+    tt.reserve(tracks.size());
+    for (auto &a_track : tracks)
+        tt.push_back(a_track.second);
+
+    size_t nBlobs = bb.size();
+    size_t nTracks = tt.size();
+
+    if (motion_prediction) {
+        for (auto &a_track : tt)
+            a_track->Predict(process_noise);
+    }
 
-        TrackID maxTrackID = 0;
+    // Close pairs (blob, track)
+    std::vector<std::pair<size_t, size_t> > close;
+    std::vector<double> gates(nTracks, thDistance);
+    gatePairs(bb, tt, gates, close);
 
-        unsigned int j = 0;
-        for (auto &a_track : tracks) {
-            AT(j) = 0;
-            IT(j) = a_track.second->get_ID();
-            if (a_track.second->get_ID() > maxTrackID)
-                maxTrackID = a_track.second->get_ID();
-            j++;
+    if (motion_prediction) {
+        // Tracks without any close blob get a second chance against the blobs without any close track, with their
+        // gating distance widened by the uncertainty of their predicted position. Widening all the gates would
+        // merge the clusters of nearby tracks.
+        std::vector<bool> blobClose(nBlobs, false);
+        std::vector<bool> trackClose(nTracks, false);
+        for (auto &a_pair : close) {
+            blobClose[a_pair.first] = true;
+            trackClose[a_pair.second] = true;
         }
 
-        // Proximity matrix calculation and "used blob" std::list inicialization:
-        for (i = 0; i < nBlobs; i++)
-            for (j = 0; j < nTracks; j++)
-                if (C(i, j) = T(j)->DistanceFromBlob(*B(i))) {
-                    AB(i)++;
-                    AT(j)++;
-                }
+        std::vector<SharedBlob> freeBlobs;
+        std::vector<size_t> freeBlobIndexes;
+        for (size_t i = 0; i < nBlobs; i++) {
+            if (!blobClose[i]) {
+                freeBlobs.push_back(bb[i]);
+                freeBlobIndexes.push_back(i);
+            }
+        }
+        std::vector<SharedTrack> freeTracks;
+        std::vector<size_t> freeTrackIndexes;
+        std::vector<double> freeGates;
+        for (size_t j = 0; j < nTracks; j++) {
+            if (!trackClose[j]) {
+                freeTracks.push_back(tt[j]);
+                freeTrackIndexes.push_back(j);
+                freeGates.push_back(thDistance + kGateSigmas * tt[j]->get_PredictionDeviation());
+            }
+        }
 
-        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        // Detect inactive tracks
-        for (j=0; j<nTracks; j++) {
-            unsigned int c = AT(j);
+        std::vector<std::pair<size_t, size_t> > widened;
+        gatePairs(freeBlobs, freeTracks, freeGates, widened);
+        if (!widened.empty()) {
+            for (auto &a_pair : widened)
+                close.push_back(std::make_pair(freeBlobIndexes[a_pair.first], freeTrackIndexes[a_pair.second]));
+            std::sort(close.begin(), close.end());
+        }
+    }
 
-            if (c==0) {
-                //std::cout << "Inactive track: " << j << std::endl;
+    if (label_overlap_enabled) {
+        cv::Mat labels = blobs.get_ImageLabel();
+        if (!previous_labels.empty() && previous_labels.size() == labels.size()) {
+            label_overlap.Compute(previous_labels, labels);
 
-                // Inactive track.
-                SharedTrack track = T(j);
-                track->inactive++;
-                track->label = 0;
+            // Blobs and tracks sharing pixels are close too
+            const size_t unset = std::numeric_limits<size_t>::max();
+            const size_t nLabels = (size_t)std::numeric_limits<Label>::max() + 1;
+            std::vector<size_t> blobByLabel(nLabels, unset);
+            std::vector<size_t> trackByLabel(nLabels, unset);
+            for (size_t i = 0; i < nBlobs; i++)
+                blobByLabel[bb[i]->label] = i;
+            for (size_t j = 0; j < nTracks; j++) {
+                if (tt[j]->get_Label())
+                    trackByLabel[tt[j]->get_Label()] = j;
             }
-        }
 
-        // Detect new tracks
-        for (i=0; i<nBlobs; i++) {
-            unsigned int c = AB(i);
-
-            if (c==0) {
-                //std::cout << "Blob (new track): " << maxTrackID+1 << std::endl;
-                //std::cout << *B(i) << std::endl;
-
-                // New track.
-                maxTrackID++;
-                SharedBlob blob = B(i);
-                SharedTrack track(new Track(blob));
-                track->get_ID() = maxTrackID;
-                track->label = blob->label;
-                track->minx = blob->minx;
-                track->miny = blob->miny;
-                track->maxx = blob->maxx;
-                track->maxy = blob->maxy;
-                track->centroid = blob->centroid;
-                track->lifetime = 0;
-                track->active = 0;
-                track->inactive = 0;
-                tracks.insert(IDTrackPair(maxTrackID, track));
+            size_t nClose = close.size();
+            for (auto &a_pair : label_overlap.get_Pairs()) {
+                size_t j = trackByLabel[a_pair.first];
+                size_t i = blobByLabel[a_pair.second];
+                if (i != unset && j != unset)
+                    close.push_back(std::make_pair(i, j));
             }
+            if (close.size() > nClose) {
+                std::sort(close.begin(), close.end());
+                close.erase(std::unique(close.begin(), close.end()), close.end());
+            }
+        } else {
+            label_overlap.clear();
         }
+        previous_labels = labels;
+    }
 
-        // Clustering
-        for (j = 0; j < nTracks; j++) {
-            unsigned int c = AT(j);
-
-            if (c) {
-                std::list<SharedTrack> tt; tt.push_back(T(j));
-                std::list<SharedBlob> bb;
-
-                getClusterForTrack(j, close, (unsigned int) nBlobs, (unsigned int) nTracks, blob_map, tracks, bb, tt);
-
-                // Select track
-                SharedTrack track;
-                unsigned int area = 0;
-                for (auto &a_track : tt) {
-                    // Get area
-                    unsigned int a = (a_track->maxx - a_track->minx) * (a_track->maxy - a_track->miny);
-                    if (a > area) {
-                        area = a;
-                        track = a_track;
-                    }
-                }
+    // Clusters: blobs are nodes [0, nBlobs), tracks [nBlobs, nBlobs + nTracks)
+    DisjointSets clusters(nBlobs + nTracks);
+    std::vector<unsigned int> blobCount(nBlobs, 0);
+    std::vector<unsigned int> trackCount(nTracks, 0);
+    for (auto &a_pair : close) {
+        clusters.Union(a_pair.first, nBlobs + a_pair.second);
+        blobCount[a_pair.first]++;
+        trackCount[a_pair.second]++;
+    }
+
+    // Detect inactive tracks
+    for (size_t j = 0; j < nTracks; j++) {
+        if (!trackCount[j])
+            tt[j]->IncreaseInactive();
+    }
 
-                // Select blob
-                SharedBlob blob;
-                area = 0;
-                //std::cout << "Matching blobs: ";
-                for (auto &a_blob : bb) {
-                    //std::cout << a_blob->label << " ";
+    if (association_mode == AssociationMode_optimal) {
+        // Minimum cost assignment in each cluster
+        std::vector<std::vector<size_t> > clusterPairs(nBlobs + nTracks);
+        for (size_t k = 0; k < close.size(); k++)
+            clusterPairs[clusters.Find(close[k].first)].push_back(k);
 
-                    if (a_blob->get_Area() > area) {
-                        area = a_blob->get_Area();
-                        blob = a_blob;
-                    }
+        std::vector<bool> blobMatched(nBlobs, false);
+        const size_t unset = std::numeric_limits<size_t>::max();
+        std::vector<size_t> localTrack(nTracks, unset);
+        std::vector<size_t> localBlob(nBlobs, unset);
+        std::vector<size_t> clusterTracks;
+        std::vector<size_t> clusterBlobs;
+        std::vector<AssignmentEdge> edges;
+        std::vector<int> match;
+
+        for (auto &a_cluster : clusterPairs) {
+            if (a_cluster.empty())
+                continue;
+
+            clusterTracks.clear();
+            clusterBlobs.clear();
+            edges.clear();
+            for (auto k : a_cluster) {
+                size_t i = close[k].first;
+                size_t j = close[k].second;
+                if (localBlob[i] == unset) {
+                    localBlob[i] = clusterBlobs.size();
+                    clusterBlobs.push_back(i);
                 }
-                //std::cout << std::endl;
-
-                // Update track
-                //std::cout << "Matching: track=" << track->get_ID() << ", blob=" << blob->label << std::endl;
-                track->update_Blob(blob);
-                // Move this
-                track->label = blob->label;
-                track->centroid = blob->centroid;
-                track->minx = blob->minx;
-                track->miny = blob->miny;
-                track->maxx = blob->maxx;
-                track->maxy = blob->maxy;
-                if (track->inactive)
-                    track->active = 0;
-                track->inactive = 0;
-
-                // Others to inactive
-                for (auto &a_track : tt) {
-                    if (a_track != track) {
-                        //std::cout << "Inactive: track=" << t->get_ID() << std::endl;
-                        a_track->IncreaseInactive();
-                        // Move this
-                        a_track->inactive++;
-                        a_track->label = 0;
-                    }
+                if (localTrack[j] == unset) {
+                    localTrack[j] = clusterTracks.size();
+                    clusterTracks.push_back(j);
+                }
+                AssignmentEdge edge = { localTrack[j], localBlob[i], association_cost(*tt[j], *bb[i]) };
+                edges.push_back(edge);
+            }
+
+            SolveAssignment(clusterTracks.size(), clusterBlobs.size(), edges, match);
+
+            for (size_t t = 0; t < clusterTracks.size(); t++) {
+                if (match[t] < 0) {
+                    tt[clusterTracks[t]]->IncreaseInactive();
+                } else {
+                    size_t i = clusterBlobs[match[t]];
+                    tt[clusterTracks[t]]->update_Blob(*bb[i], measurement_noise);
+                    blobMatched[i] = true;
                 }
             }
         }
-        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-        for (auto &jt = tracks.begin(); jt != tracks.end();)
-            if (jt->second->IsTooOld(thInactive, thActive)) {
-            //if ((jt->second->inactive >= thInactive) || ((jt->second->inactive) && (thActive) && (jt->second->active < thActive))) {
-                tracks.erase(jt++);
-            } else {
-                jt->second->IncreaseLifetime();
-                // move this
-                jt->second->lifetime++;
-                if (!jt->second->inactive)
-                    jt->second->active++;
-                ++jt;
+        // New tracks
+        for (size_t i = 0; i < nBlobs; i++) {
+            if (!blobMatched[i]) {
+                last_id++;
+                tracks.insert(IDTrackPair(last_id, SharedTrack(new Track(last_id, *bb[i], measurement_noise))));
             }
-    } catch (...) {
-        throw; // TODO: OpenCV style.
+        }
+    } else {
+        // Detect new tracks
+        for (size_t i = 0; i < nBlobs; i++) {
+            if (!blobCount[i]) {
+                last_id++;
+                tracks.insert(IDTrackPair(last_id, SharedTrack(new Track(last_id, *bb[i], measurement_noise))));
+            }
+        }
+
+        // Clustering: in each cluster, the biggest track follows the biggest blob, the other tracks become inactive
+        std::vector<size_t> selectedTrack(nBlobs + nTracks, nTracks);
+        std::vector<size_t> selectedBlob(nBlobs + nTracks, nBlobs);
+
+        for (size_t j = 0; j < nTracks; j++) {
+            if (!trackCount[j])
+                continue;
+            size_t root = clusters.Find(nBlobs + j);
+            size_t &selected = selectedTrack[root];
+            if (selected == nTracks || tt[j]->get_BoundingBox().area() > tt[selected]->get_BoundingBox().area())
+                selected = j;
+        }
+
+        for (size_t i = 0; i < nBlobs; i++) {
+            if (!blobCount[i])
+                continue;
+            size_t root = clusters.Find(i);
+            size_t &selected = selectedBlob[root];
+            if (selected == nBlobs || bb[i]->get_Area() > bb[selected]->get_Area())
+                selected = i;
+        }
+
+        for (size_t j = 0; j < nTracks; j++) {
+            if (!trackCount[j])
+                continue;
+            size_t root = clusters.Find(nBlobs + j);
+            if (selectedTrack[root] == j)
+                tt[j]->update_Blob(*bb[selectedBlob[root]], measurement_noise);
+            else
+                tt[j]->IncreaseInactive();
+        }
+    }
+
+    if (event_engine)
+        event_engine->BeginUpdate(frame);
+
+    for (auto jt = tracks.begin(); jt != tracks.end();) {
+        Track &track = *jt->second;
+        if (track.IsTooOld(thInactive, thActive)) {
+            if (trajectories_enabled)
+                trajectories.Finish(track.get_ID());
+            if (event_engine)
+                event_engine->remove_Track(track.get_ID());
+            tracks.erase(jt++);
+        } else {
+            if (!track.get_Inactive()) {
+                if (trajectories_enabled)
+                    trajectories.add_Point(track.get_ID(), frame, track.get_Centroid());
+                if (event_engine)
+                    event_engine->update_Track(track.get_ID(), track.get_Centroid());
+            }
+            track.IncreaseLifetime();
+            ++jt;
+        }
     }
+
+    if (event_engine)
+        event_engine->EndUpdate();
+
+    frame++;
 }
 
-void TrackList::RenderTracks(cv::Mat &imgSource, cv::Mat &imgDest, unsigned short mode, int font) const {
+void cvb::RenderTrack(const Track &track, cv::Mat &imgDest, unsigned short mode, int font) {
+    CV_Assert(imgDest.type() == CV_8UC3);
+
+    cv::Rect box = track.get_BoundingBox();
+    cv::Point2d centroid = track.get_Centroid();
+
+    if (mode & CV_TRACK_RENDER_ID) {
+        if (!track.get_Inactive()) {
+            std::stringstream buffer;
+            buffer << track.get_ID();
+            cv::putText(imgDest, buffer.str(), cv::Point((int) centroid.x, (int) centroid.y), font, 1, cv::Scalar(0., 255., 0.));
+        }
+    }
+
+    if (mode & CV_TRACK_RENDER_BOUNDING_BOX) {
+        if (track.get_Inactive())
+            cv::rectangle(imgDest, box.tl(), box.br() - cv::Point(1, 1), cv::Scalar(0., 0., 50.));
+        else
+            cv::rectangle(imgDest, box.tl(), box.br() - cv::Point(1, 1), cv::Scalar(0., 0., 255.));
+    }
+
+    if (mode & CV_TRACK_RENDER_TO_LOG) {
+        std::clog << "Track " << track.get_ID() << std::endl;
+        if (track.get_Inactive())
+            std::clog << " - Inactive for " << track.get_Inactive() << " frames" << std::endl;
+        else
+            std::clog << " - Associated with blob " << (int) track.get_Label() << std::endl;
+        std::clog << " - Lifetime " << track.get_Lifetime() << std::endl;
+        std::clog << " - Active " << track.get_Active() << std::endl;
+        std::clog << " - Bounding box: (" << box.x << ", " << box.y << ") - (" << box.x + box.width - 1 << ", " << box.y + box.height - 1 << ")" << std::endl;
+        std::clog << " - Centroid: (" << centroid.x << ", " << centroid.y << ")" << std::endl;
+        std::clog << std::endl;
+    }
+
+    if (mode & CV_TRACK_RENDER_TO_STD) {
+        std::cout << "Track " << track.get_ID() << std::endl;
+        if (track.get_Inactive())
+            std::cout << " - Inactive for " << track.get_Inactive() << " frames" << std::endl;
+        else
+            std::cout << " - Associated with blobs " << (int) track.get_Label() << std::endl;
+        std::cout << " - Lifetime " << track.get_Lifetime() << std::endl;
+        std::cout << " - Active " << track.get_Active() << std::endl;
+        std::cout << " - Bounding box: (" << box.x << ", " << box.y << ") - (" << box.x + box.width - 1 << ", " << box.y + box.height - 1 << ")" << std::endl;
+        std::cout << " - Centroid: (" << centroid.x << ", " << centroid.y << ")" << std::endl;
+        std::cout << std::endl;
+    }
+}
+
+void TrackList::RenderTracks(cv::Mat & /*imgSource*/, cv::Mat &imgDest, unsigned short mode, int font) const {
+    TraceSpan span("RenderTracks", "rendering");
     CV_Assert(imgDest.type() == CV_8UC3);
 
     if (mode) {
-        for (auto &a_track : tracks) {
-            if (mode & CV_TRACK_RENDER_ID) {
-                if (!a_track.second->inactive) {
-                    std::stringstream buffer;
-                    buffer << a_track.first;
-                    cv::putText(imgDest, buffer.str(), cv::Point((int) a_track.second->centroid.x, (int) a_track.second->centroid.y), font, 1, cv::Scalar(0., 255., 0.));
-                }
-            }
+        for (auto &a_track : tracks)
+            RenderTrack(*a_track.second, imgDest, mode, font);
+    }
+}
 
-            if (mode & CV_TRACK_RENDER_BOUNDING_BOX) {
-                if (a_track.second->inactive)
-                    cv::rectangle(imgDest, cv::Point(a_track.second->minx, a_track.second->miny), cv::Point(a_track.second->maxx - 1, a_track.second->maxy - 1), cv::Scalar(0., 0., 50.));
-                else
-                    cv::rectangle(imgDest, cv::Point(a_track.second->minx, a_track.second->miny), cv::Point(a_track.second->maxx - 1, a_track.second->maxy - 1), cv::Scalar(0., 0., 255.));
-            }
+KeyframeScheduler::KeyframeScheduler(unsigned int maxInterval, double errorBudget, double frameBudget) :
+    max_interval(std::max(1u, maxInterval)), error_budget(errorBudget), frame_budget(frameBudget), interval(1),
+    elapsed(1), last_gap(1), acceleration(0.), keyframe_seconds(0.) {}
 
-            if (mode & CV_TRACK_RENDER_TO_LOG) {
-                std::clog << "Track " << a_track.second->get_ID() << std::endl;
-                if (a_track.second->inactive)
-                    std::clog << " - Inactive for " << a_track.second->inactive << " frames" << std::endl;
-                else
-                    std::clog << " - Associated with blob " << a_track.second->label << std::endl;
-                std::clog << " - Lifetime " << a_track.second->lifetime << std::endl;
-                std::clog << " - Active " << a_track.second->active << std::endl;
-                std::clog << " - Bounding box: (" << a_track.second->minx << ", " << a_track.second->miny << ") - (" << a_track.second->maxx << ", " << a_track.second->maxy << ")" << std::endl;
-                std::clog << " - Centroid: (" << a_track.second->centroid.x << ", " << a_track.second->centroid.y << ")" << std::endl;
-                std::clog << std::endl;
-            }
+bool KeyframeScheduler::NextFrame() {
+    if (elapsed >= interval) {
+        last_gap = elapsed;
+        elapsed = 1;
+        return true;
+    }
 
-            if (mode & CV_TRACK_RENDER_TO_STD) {
-                std::cout << "Track " << a_track.second->get_ID() << std::endl;
-                if (a_track.second->inactive)
-                    std::cout << " - Inactive for " << a_track.second->inactive << " frames" << std::endl;
-                else
-                    std::cout << " - Associated with blobs " << a_track.second->label << std::endl;
-                std::cout << " - Lifetime " << a_track.second->lifetime << std::endl;
-                std::cout << " - Active " << a_track.second->active << std::endl;
-                std::cout << " - Bounding box: (" << a_track.second->minx << ", " << a_track.second->miny << ") - (" << a_track.second->maxx << ", " << a_track.second->maxy << ")" << std::endl;
-                std::cout << " - Centroid: (" << a_track.second->centroid.x << ", " << a_track.second->centroid.y << ")" << std::endl;
-                std::cout << std::endl;
-            }
+    elapsed++;
+    return false;
+}
+
+void KeyframeScheduler::add_Keyframe(const TrackList &tracks, double seconds) {
+    // With constant velocity prediction, the error after k frames is about a k^2 / 2
+    double gap = last_gap;
+    double newAcceleration = 0.;
+    for (auto &a_track : tracks.get_Tracks()) {
+        const Track &track = *a_track.second;
+        // Tracks measured at least twice before: their velocity was known
+        if (!track.get_Measured() || track.get_Active() < 2 * last_gap)
+            continue;
+        // Up to a pixel, the error is taken as quantization of the centroids
+        cv::Point2d e = track.get_Innovation();
+        double error = std::max(0., std::sqrt(e.x * e.x + e.y * e.y) - 1.);
+        newAcceleration = std::max(newAcceleration, 2. * error / (gap * gap));
+    }
+    // Quick to react to faster motion, slow to forget it
+    acceleration = std::max(newAcceleration, .75 * acceleration);
+    keyframe_seconds = keyframe_seconds > 0. ? .8 * keyframe_seconds + .2 * seconds : seconds;
+
+    double motionInterval = acceleration > 0. ? std::floor(std::sqrt(2. * error_budget / acceleration)) : max_interval;
+    double loadInterval = frame_budget > 0. ? std::ceil(keyframe_seconds / frame_budget) : 1.;
+    double newInterval = std::max(loadInterval, std::min(motionInterval, (double)max_interval));
+
+    interval = (unsigned int)std::max(1., std::min(newInterval, (double)max_interval));
+}
+
+unsigned int KeyframeScheduler::get_Interval() const {
+    return interval;
+}
+
+FocusScheduler::FocusScheduler(unsigned int fullScanInterval, unsigned int margin, unsigned int sampleStride, unsigned int arrivalBudget) :
+    full_scan_interval(std::max(1u, fullScanInterval)), margin(margin), sample_stride(std::max(1u, sampleStride)),
+    arrival_budget(arrivalBudget), since_full_scan(full_scan_interval), sample_phase(0) {}
+
+bool FocusScheduler::LabelFrame(const cv::Mat &img, const TrackList &tracks, BlobList &blobs, Label max_label) {
+    CV_Assert(img.type() == CV_8UC1);
+
+    if (since_full_scan + 1 < full_scan_interval) {
+        get_Regions(tracks, img.size(), regions);
+        GrowRegions(img, regions);
+
+        // Outside of the grown regions, foreground can only come from new blobs or from lost tracks: sampled
+        // before labelling, so that a frame needing a full scan is labelled once
+        unsigned int arrivals = countOutside(img, regions, sample_phase, sample_stride);
+        sample_phase = (sample_phase + 1) % sample_stride;
+        if (arrivals <= arrival_budget) {
+            blobs.LabelRegions(img, regions, max_label);
+            since_full_scan++;
+            return false;
         }
     }
+
+    regions.clear();
+    blobs.LabelImage(img, max_label);
+    since_full_scan = 0;
+    return true;
 }
 
+void FocusScheduler::get_Regions(const TrackList &tracks, const cv::Size &size, std::vector<cv::Rect> &regions) const {
+    regions.clear();
+    cv::Rect frame(cv::Point(0, 0), size);
+    for (auto &a_track : tracks.get_Tracks()) {
+        const Track &track = *a_track.second;
+        cv::Rect box = track.get_PredictedBoundingBox();
+        cv::Point2d v = track.get_Velocity();
+        box |= box + cv::Point((int)std::floor(v.x + .5), (int)std::floor(v.y + .5));
+
+        int border = margin + (int)std::ceil(3. * track.get_PredictionDeviation());
+        box = cv::Rect(box.x - border, box.y - border, box.width + 2 * border, box.height + 2 * border) & frame;
+        if (box.area() > 0)
+            regions.push_back(box);
+    }
+}
+
+const std::vector<cv::Rect> &FocusScheduler::get_LabelledRegions() const {
+    return regions;
+}
+
+void FocusScheduler::RequestFullScan() {
+    since_full_scan = full_scan_interval;
+}
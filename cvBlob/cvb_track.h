@@ -34,9 +34,18 @@
 #define _CVBLOB_TRACK_H_
 
 #include <cstdint>
+#include <functional>
+#include <map>
 #include <memory>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
 
 #include "cvb_blob_list.h"
+#include "cvb_defines.h"
+#include "cvb_events.h"
+#include "cvb_overlap.h"
+#include "cvb_trajectory.h"
 
 namespace cvb {
 #define CV_TRACK_RENDER_ID            0x0001 ///< Print the ID of each track in the image. \see cvRenderTracks
@@ -44,18 +53,120 @@ namespace cvb {
 #define CV_TRACK_RENDER_TO_LOG        0x0010 ///< Print track info to log out. \see cvRenderTracks
 #define CV_TRACK_RENDER_TO_STD        0x0020 ///< Print track info to log out. \see cvRenderTracks
 
-    /// \brief Type of identification numbers.
-    typedef uint32_t TrackID;
-
     /// \brief Struct that contain information about one track.
-    class Track {
+    class CVBLOB_EXPORT Track {
     public:
-        Track(SharedBlob blob);
+        /// \brief Constructor, starting the track on a blob.
+        /// \param id Track identification number.
+        /// \param blob The blob.
+        /// \param measurementNoise Variance of the blob centroid measurements.
+        Track(TrackID id, const Blob &blob, double measurementNoise = 1.);
+
+        /// \brief Gets the track identification number.
+        /// \return The identification number.
+        TrackID get_ID() const;
+
+        /// \brief Gets the label of the blob related to this track.
+        /// \return The label, 0 if the track is inactive.
+        Label get_Label() const;
+
+        /// \brief Gets the bounding box of the last blob related to this track.
+        /// \return The bounding box.
+        cv::Rect get_BoundingBox() const;
+
+        /// \brief Gets the centroid of the last blob related to this track.
+        /// \return The centroid.
+        cv::Point2d get_Centroid() const;
+
+        /// \brief Gets the estimated velocity.
+        /// \return The velocity, in pixels per frame.
+        cv::Point2d get_Velocity() const;
+
+        /// \brief Gets the standard deviation of the estimated position, along each axis.
+        /// \return The standard deviation, in pixels.
+        double get_PredictionDeviation() const;
+
+        /// \brief Gets the predicted centroid: the last centroid until Predict is called.
+        /// \return The predicted centroid.
+        cv::Point2d get_PredictedCentroid() const;
+
+        /// \brief Gets the bounding box moved to the predicted centroid.
+        /// \return The predicted bounding box.
+        cv::Rect get_PredictedBoundingBox() const;
 
-        TrackID get_ID();
+        /// \brief Whether the position of the track was measured on the last frame, rather than predicted.
+        /// \return True if the track was related to a blob on the last frame.
+        bool get_Measured() const;
+
+        /// \brief Gets the difference between the measured and the predicted centroids, at the last blob.
+        /// \return The innovation, in pixels.
+        cv::Point2d get_Innovation() const;
+
+        /// \brief Gets the number of frames the track has been in scene.
+        /// \return The lifetime.
+        unsigned int get_Lifetime() const;
+
+        /// \brief Gets the number of frames the track has been active since its last inactive period.
+        /// \return The number of active frames.
+        unsigned int get_Active() const;
+
+        /// \brief Gets the number of frames the track has been missing.
+        /// \return The number of inactive frames.
+        unsigned int get_Inactive() const;
+
+        /// \brief Distance from a blob: the shortest of the distances from the blob centroid to the predicted track
+        /// box, and from the predicted track centroid to the blob box (chessboard distance).
+        /// \param b The blob.
+        /// \return The distance.
         double DistanceFromBlob(const Blob &b) const;
 
+        /// \brief Predicts the position of the track in the next frame (constant velocity Kalman filter).
+        /// \param processNoise Variance of the acceleration, in pixels per frame squared.
+        void Predict(double processNoise = 1.);
+
+        /// \brief Relates the track to a blob, making it active, and corrects its motion state.
+        /// \param blob The blob.
+        /// \param measurementNoise Variance of the blob centroid measurements.
+        void update_Blob(const Blob &blob, double measurementNoise = 1.);
+
+        /// \brief Advances the track one frame without blobs.
+        /// \param predict Whether to predict the position, otherwise it is kept.
+        /// \param processNoise Variance of the acceleration, in pixels per frame squared.
+        void Coast(bool predict, double processNoise = 1.);
+
+        /// \brief Marks the track as missing for this frame.
+        void IncreaseInactive();
+
+        /// \brief Counts one more frame in scene.
+        void IncreaseLifetime();
+
+        /// \brief Tells whether the track should be removed.
+        /// \param thInactive Max number of frames a track can be inactive.
+        /// \param thActive If a track becomes inactive but it has been active less than thActive frames, the track will be deleted.
+        /// \return True if the track is too old.
+        bool IsTooOld(const unsigned int thInactive, const unsigned int thActive) const;
+
+        /// \brief Prints the data to the out stream.
+        /// \param out The output stream.
+        void Print(std::ostream &out) const;
+
+        /// \brief Appends the whole state of the track, motion included, to a snapshot.
+        /// \param data Snapshot buffer.
+        void Write(std::vector<unsigned char> &data) const;
+
+        /// \brief Reads a track written by Write.
+        /// \param data Read position, moved past the track.
+        /// \param end End of the snapshot.
+        /// \return The track, or an empty pointer if the snapshot is too short.
+        static std::shared_ptr<Track> Read(const unsigned char *&data, const unsigned char *end);
+
     protected:
+        Track();
+
+        /// \brief Takes the label, box and centroid of a blob, and clears the prediction.
+        /// \param blob The blob.
+        void set_Observation(const Blob &blob);
+
         TrackID id; ///< Track identification number.
         Label label; ///< Label assigned to the blob related to this track.
 
@@ -64,7 +175,16 @@ namespace cvb {
         unsigned int miny; ///< Y min.
         unsigned int maxy; ///< y max.
 
-        cv::Point centroid; ///< Centroid.
+        cv::Point2d centroid; ///< Centroid.
+
+        cv::Point2d position;  ///< Estimated centroid (Kalman state).
+        cv::Point2d velocity;  ///< Estimated velocity (Kalman state).
+        double var_position;   ///< Variance of the position, same for both axes.
+        double cov_position_velocity; ///< Covariance of the position and the velocity.
+        double var_velocity;   ///< Variance of the velocity.
+        cv::Point2d predicted_offset; ///< Predicted centroid, relative to the last centroid.
+        cv::Point2d innovation;       ///< Measured minus predicted centroid, at the last blob.
+        unsigned int coasted;         ///< Frames since the last blob without a blob search.
 
         unsigned int lifetime; ///< Indicates how much frames the object has been in scene.
         unsigned int active; ///< Indicates number of frames that has been active from last inactive period.
@@ -85,9 +205,60 @@ namespace cvb {
     /// \see Track
     typedef std::pair<TrackID, SharedTrack> IDTrackPair;
 
+    /// \brief How tracks and close blobs are associated.
+    /// \see TrackList::set_AssociationMode
+    CVBLOB_EXPORT enum AssociationMode {
+        AssociationMode_greedy  = 0, ///< In each cluster of close tracks and blobs, the biggest track follows the biggest blob (default).
+        AssociationMode_optimal = 1, ///< Minimum cost assignment of the close pairs; unmatched blobs start new tracks.
+    };
+
+    /// \brief Cost of associating a track with a blob: non-negative, lower is better.
+    /// \see TrackList::set_AssociationCost
+    typedef std::function<double(const Track &, const Blob &)> AssociationCost;
+
+    /// \brief Association cost: Euclidean distance between the predicted track centroid and the blob centroid.
+    CVBLOB_EXPORT double CentroidDistanceCost(const Track &track, const Blob &blob);
+
+    /// \brief Association cost: 1 - intersection over union of the predicted track box and the blob box.
+    CVBLOB_EXPORT double OverlapCost(const Track &track, const Blob &blob);
+
+    /// \brief Association cost: 1 - intersection over union of the pixels of the track blob in the previous label image
+    /// and of the blob in the current one.
+    /// \param overlap Overlap of the label images, which must outlive the returned cost.
+    /// \return The cost function.
+    /// \see TrackList::set_LabelOverlap
+    CVBLOB_EXPORT AssociationCost LabelOverlapCost(const LabelOverlap &overlap);
+
+    /// \brief Allowed pair of a sparse assignment problem.
+    struct CVBLOB_EXPORT AssignmentEdge {
+        size_t row;  ///< Row (track).
+        size_t col;  ///< Column (blob).
+        double cost; ///< Non-negative cost.
+    };
+
+    /// \brief Solves a sparse assignment problem: matches as many rows as possible and, among those matchings,
+    /// finds one of minimum cost. Only the given pairs can be matched.
+    /// Successive shortest augmenting paths (Dijkstra with potentials, from all the free rows at once), so the cost
+    /// depends on the number of edges rather than on nRows * nCols.
+    /// \param nRows Number of rows.
+    /// \param nCols Number of columns.
+    /// \param edges Allowed pairs.
+    /// \param rowMatch Output column of each row, -1 if unmatched.
+    CVBLOB_EXPORT void SolveAssignment(size_t nRows, size_t nCols, const std::vector<AssignmentEdge> &edges, std::vector<int> &rowMatch);
+
+    /// \brief Prints the information of a track.
+    /// \param track The track.
+    /// \param imgDest Output image (type = CV_8UC3).
+    /// \param mode Render mode. By default is CV_TRACK_RENDER_ID|CV_TRACK_RENDER_BOUNDING_BOX.
+    /// \param font OpenCV font for print on the image.
+    /// \see TrackList::RenderTracks
+    CVBLOB_EXPORT void RenderTrack(const Track &track, cv::Mat &imgDest, unsigned short mode = 0x000f, int font = cv::FONT_HERSHEY_DUPLEX);
+
     // TODO MOve me to cvb_track_list
-    class TrackList {
+    class CVBLOB_EXPORT TrackList {
     public:
+        TrackList();
+
         /// \fn UpdateTracks(const BlobList &b, const double thDistance, const unsigned int thInactive, const unsigned int thActive = 0)
         /// \brief Updates list of tracks based on current blobs.
         /// Tracking based on:
@@ -95,6 +266,14 @@ namespace cvb {
         /// Occlusion Handling. Second International workshop on Performance Evaluation of Tracking and
         /// Surveillance systems & CVPR'01. December, 2001.
         /// (https://researcher.watson.ibm.com/researcher/files/us-smiyaza/PETS2001.pdf)
+        /// Candidate track/blob pairs come from a uniform grid with cells of at least thDistance, and tracks and
+        /// blobs are clustered with a union-find, so the cost grows with the number of close pairs.
+        /// Each cluster is then resolved according to the association mode.
+        /// With motion prediction, tracks are compared at their predicted position, and the tracks left without any
+        /// close blob are gated again against the blobs left alone, with their gating distance widened by three
+        /// standard deviations of that prediction.
+        /// \see set_AssociationMode
+        /// \see set_MotionPrediction
         /// \param b List of blobs.
         /// \param thDistance Max distance to determine when a track and a blob match.
         /// \param thInactive Max number of frames a track can be inactive.
@@ -103,6 +282,76 @@ namespace cvb {
         /// \see Tracks
         void UpdateTracks(const BlobList &b, const double thDistance, const unsigned int thInactive, const unsigned int thActive = 0);
 
+        /// \brief Gets the tracks.
+        /// \return The tracks, by identification number.
+        const TracksMap &get_Tracks() const;
+
+        /// \brief Sets how tracks and close blobs are associated.
+        /// \param mode Association mode (AssociationMode_greedy by default).
+        void set_AssociationMode(AssociationMode mode);
+
+        /// \brief Sets the cost minimized by AssociationMode_optimal.
+        /// \param cost Cost function (CentroidDistanceCost by default).
+        void set_AssociationCost(const AssociationCost &cost);
+
+        /// \brief Enables the motion prediction: tracks are gated and matched at their predicted position.
+        /// \param enabled Whether to predict the track positions (true by default).
+        /// \param processNoise Variance of the acceleration, in pixels per frame squared.
+        /// \param measurementNoise Variance of the blob centroid measurements.
+        void set_MotionPrediction(bool enabled, double processNoise = 1., double measurementNoise = 1.);
+
+        /// \brief Enables the label overlap: the label image of each frame is compared with the one of the previous
+        /// frame, and a track and a blob sharing pixels are always close, whatever their distance.
+        /// The overlap can also be used as the association cost, with LabelOverlapCost(get_LabelOverlap()).
+        /// \param enabled Whether to compute the label overlap (false by default).
+        void set_LabelOverlap(bool enabled);
+
+        /// \brief Enables the recording of the trajectories of the tracks.
+        /// The centroid of each active track is added to its trajectory on every update, and the trajectories of
+        /// deleted tracks are encoded as finished ones.
+        /// \param enabled Whether to record the trajectories (false by default).
+        /// \param capacity Maximum number of points kept for each track, at most 65536.
+        void set_Trajectories(bool enabled, size_t capacity = 64);
+
+        /// \brief Gets the trajectories, recorded since set_Trajectories.
+        /// \return The trajectory store.
+        TrajectoryStore &get_Trajectories();
+
+        /// \brief Gets the trajectories, recorded since set_Trajectories.
+        /// \return The trajectory store.
+        const TrajectoryStore &get_Trajectories() const;
+
+        /// \brief Sets the event engine fed by the updates.
+        /// The engine gets the new position of every active track, and forgets the deleted tracks.
+        /// \param engine The event engine, or an empty pointer for none.
+        void set_EventEngine(const SharedEventEngine &engine);
+
+        /// \brief Advances the tracks one frame without labelling: their positions are predicted (or kept without
+        /// motion prediction), and they are neither matched nor aged as missing.
+        /// Meant for the frames between keyframes.
+        /// \see KeyframeScheduler
+        /// \see Track::get_Measured
+        void PredictTracks();
+
+        /// \brief Writes a snapshot of the tracker state: tracks with their motion, id counter, frame counter and
+        /// trajectories. The settings and the previous label image are not part of it.
+        /// Time and memory are linear in the number of tracks and trajectory points; the buffer is reused.
+        /// \param data Output snapshot, cleared on entry.
+        void Snapshot(std::vector<unsigned char> &data) const;
+
+        /// \brief Restores the state written by Snapshot, keeping the current settings.
+        /// The trajectories of the snapshot, with the capacity they were recorded with, replace the current ones
+        /// when they are enabled; otherwise the trajectory store is cleared. The event engine, if any, forgets all
+        /// the tracks: restored ones get their zones on their next update, without events.
+        /// \param data Snapshot.
+        /// \param size Size of the snapshot.
+        /// \return False if the snapshot is malformed, the tracker being then left unchanged.
+        bool Restore(const unsigned char *data, size_t size);
+
+        /// \brief Gets the overlap between the last two label images.
+        /// \return The label overlap, empty if disabled.
+        const LabelOverlap &get_LabelOverlap() const;
+
         /// \fn void RenderTracks(cv::Mat &imgSource, cv::Mat &imgDest, unsigned short mode=0x00ff, int font = cv::FONT_HERSHEY_DUPLEX) const
         /// \brief Prints tracks information.
         /// \param imgSource Input image (depth=IPL_DEPTH_8U and num. channels=3).
@@ -117,15 +366,118 @@ namespace cvb {
 
     protected:
         TracksMap tracks;
+        TrackID last_id; ///< Last identification number given to a track.
+
+        AssociationMode association_mode; ///< Association mode.
+        AssociationCost association_cost; ///< Cost for AssociationMode_optimal.
+
+        bool motion_prediction;   ///< Whether the track positions are predicted.
+        double process_noise;     ///< Kalman process noise.
+        double measurement_noise; ///< Kalman measurement noise.
+
+        bool label_overlap_enabled; ///< Whether the label overlap is computed.
+        LabelOverlap label_overlap; ///< Overlap between the previous and the current label images.
+        cv::Mat previous_labels;    ///< Label image of the previous frame.
+
+        uint32_t frame;                ///< Number of updates.
+        bool trajectories_enabled;     ///< Whether the trajectories are recorded.
+        TrajectoryStore trajectories;  ///< Trajectories of the tracks.
+
+        SharedEventEngine event_engine; ///< Zone and tripwire events.
 
     };
 
 
 
+    /// \brief Chooses the frames to label, the others being only predicted with TrackList::PredictTracks.
+    /// The interval between keyframes is the longest one keeping the prediction error within a budget, from the
+    /// accelerations seen at the last keyframes, and the shortest one keeping the labelling time within a frame
+    /// budget. Load comes first: the interval is at least the one the frame budget needs, up to maxInterval.
+    class CVBLOB_EXPORT KeyframeScheduler {
+    public:
+        /// \brief Constructor.
+        /// \param maxInterval Maximum number of frames between keyframes.
+        /// \param errorBudget Maximum prediction error, in pixels.
+        /// \param frameBudget Time available per frame, in seconds (0 for no load constraint).
+        KeyframeScheduler(unsigned int maxInterval = 3, double errorBudget = 2., double frameBudget = 0.);
+
+        /// \brief Starts a frame.
+        /// \return True if the frame must be labelled (TrackList::UpdateTracks), false if it can be predicted
+        /// (TrackList::PredictTracks).
+        bool NextFrame();
+
+        /// \brief Reports a keyframe, after TrackList::UpdateTracks.
+        /// \param tracks The tracker.
+        /// \param seconds Time spent labelling and updating the tracks.
+        void add_Keyframe(const TrackList &tracks, double seconds);
+
+        /// \brief Gets the current interval between keyframes.
+        /// \return The interval, in frames.
+        unsigned int get_Interval() const;
+
+    protected:
+        unsigned int max_interval; ///< Maximum interval.
+        double error_budget;       ///< Maximum prediction error.
+        double frame_budget;       ///< Time per frame.
+
+        unsigned int interval;     ///< Current interval.
+        unsigned int elapsed;      ///< Frames since the last keyframe.
+        unsigned int last_gap;     ///< Frames between the last two keyframes.
+        double acceleration;       ///< Acceleration estimate, in pixels per frame squared.
+        double keyframe_seconds;   ///< Mean keyframe time.
+    };
+
+    /// \brief Chooses where to label each frame: only around the tracks, or the whole frame.
+    /// Regions are the boxes predicted by the tracks for the next frame, with a margin. The whole frame is labelled
+    /// every fullScanInterval frames, and as soon as foreground shows up outside of the regions: every sampleStride-th
+    /// row is checked there, starting at a different row on each frame.
+    class CVBLOB_EXPORT FocusScheduler {
+    public:
+        /// \brief Constructor.
+        /// \param fullScanInterval Maximum number of frames between full scans.
+        /// \param margin Margin around the predicted boxes, in pixels, added to three standard deviations of the prediction.
+        /// \param sampleStride Rows between the rows checked outside of the regions.
+        /// \param arrivalBudget Foreground pixels tolerated on the checked rows before a full scan.
+        FocusScheduler(unsigned int fullScanInterval = 10, unsigned int margin = 8, unsigned int sampleStride = 8, unsigned int arrivalBudget = 0);
+
+        /// \brief Labels a frame, before TrackList::UpdateTracks.
+        /// Arrivals are checked once the regions are grown and before any labelling, so each frame is labelled once.
+        /// \param img Input binary image (type = CV_8UC1).
+        /// \param tracks The tracker.
+        /// \param blobs Output blobs, in image coordinates.
+        /// \param max_label Maximum number of labels.
+        /// \return True if the whole frame was labelled.
+        /// \see BlobList::LabelRegions
+        bool LabelFrame(const cv::Mat &img, const TrackList &tracks, BlobList &blobs, Label max_label);
+
+        /// \brief Gets the regions predicted by the tracks for the next frame.
+        /// \param tracks The tracker.
+        /// \param size Image size.
+        /// \param regions Output regions, clipped to the image, possibly overlapping.
+        void get_Regions(const TrackList &tracks, const cv::Size &size, std::vector<cv::Rect> &regions) const;
+
+        /// \brief Gets the regions labelled in the last frame.
+        /// \return The regions, empty after a full scan.
+        const std::vector<cv::Rect> &get_LabelledRegions() const;
+
+        /// \brief Forces a full scan on the next frame, e.g. after a scene change.
+        void RequestFullScan();
+
+    protected:
+        unsigned int full_scan_interval; ///< Maximum interval between full scans.
+        unsigned int margin;             ///< Margin around the predicted boxes.
+        unsigned int sample_stride;      ///< Rows between checked rows.
+        unsigned int arrival_budget;     ///< Foreground pixels tolerated outside of the regions.
+
+        unsigned int since_full_scan;    ///< Frames since the last full scan.
+        unsigned int sample_phase;       ///< First checked row.
+        std::vector<cv::Rect> regions;   ///< Regions labelled in the last frame.
+    };
+
     /// \fn std::ostream &operator<< (std::ostream &output, const cvb::Track &t)
     /// \brief Overload operator "<<" for printing track structure.
     /// \return Stream.
-    std::ostream &operator<< (std::ostream &output, const Track &t);
+    CVBLOB_EXPORT std::ostream &operator<< (std::ostream &output, const Track &t);
 
 
 } // Namespace
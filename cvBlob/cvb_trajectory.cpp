@@ -0,0 +1,364 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "cvb_aux.h"
+#include "cvb_trajectory.h"
+
+using namespace cvb;
+
+namespace {
+    /// \brief Empty hash table entry.
+    const uint32_t kEmpty = std::numeric_limits<uint32_t>::max();
+
+    /// \brief Initial number of hash table entries (power of 2).
+    const size_t kInitialEntries = 16;
+
+    /// \brief Maximum number of points per trajectory, which bounds the ring buffers a snapshot can allocate.
+    const size_t kMaxCapacity = 1 << 16;
+
+    /// \brief Hash table entry of a track id (Fibonacci hashing).
+    inline size_t hashEntry(TrackID id, size_t mask) {
+        return (size_t)(((uint64_t)id * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+    }
+
+    inline void putVarint(std::vector<unsigned char> &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back((unsigned char)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((unsigned char)value);
+    }
+
+    inline void putSigned(std::vector<unsigned char> &out, int64_t value) {
+        putVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+
+    /// \brief Reads a varint, returning false at the end of the data.
+    inline bool getVarint(const unsigned char *&data, const unsigned char *end, uint64_t &value) {
+        value = 0;
+        for (unsigned int shift = 0; data < end && shift < 64; shift += 7) {
+            unsigned char byte = *data++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    inline bool getSigned(const unsigned char *&data, const unsigned char *end, int64_t &value) {
+        uint64_t raw;
+        if (!getVarint(data, end, raw))
+            return false;
+        value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+        return true;
+    }
+
+    inline int32_t toFixed(double value) {
+        return (int32_t)std::floor(value * CVB_TRAJECTORY_SCALE + .5);
+    }
+}  // namespace
+
+cv::Point2d TrajectoryPoint::get_Centroid() const {
+    return cv::Point2d((double)x / CVB_TRAJECTORY_SCALE, (double)y / CVB_TRAJECTORY_SCALE);
+}
+
+TrajectoryStore::TrajectoryStore(size_t capacity) : capacity(capacity), used(0) {
+    CV_Assert(capacity > 0 && capacity <= kMaxCapacity);
+    clear();
+}
+
+void TrajectoryStore::clear() {
+    arena.clear();
+    slot_ids.clear();
+    slot_heads.clear();
+    slot_counts.clear();
+    free_slots.clear();
+    keys.assign(kInitialEntries, 0);
+    values.assign(kInitialEntries, kEmpty);
+    used = 0;
+    finished.clear();
+}
+
+size_t TrajectoryStore::get_Capacity() const {
+    return capacity;
+}
+
+size_t TrajectoryStore::get_Size() const {
+    return used;
+}
+
+bool TrajectoryStore::Contains(TrackID id) const {
+    return FindSlot(id) >= 0;
+}
+
+int TrajectoryStore::FindSlot(TrackID id) const {
+    size_t mask = keys.size() - 1;
+    for (size_t e = hashEntry(id, mask); values[e] != kEmpty; e = (e + 1) & mask) {
+        if (keys[e] == id)
+            return (int)values[e];
+    }
+    return -1;
+}
+
+void TrajectoryStore::InsertSlot(TrackID id, uint32_t slot) {
+    // Load factor kept under 1/2
+    if (2 * (used + 1) > keys.size()) {
+        std::vector<TrackID> oldKeys(keys.size() * 2, 0);
+        std::vector<uint32_t> oldValues(values.size() * 2, kEmpty);
+        oldKeys.swap(keys);
+        oldValues.swap(values);
+        size_t mask = keys.size() - 1;
+        for (size_t k = 0; k < oldKeys.size(); k++) {
+            if (oldValues[k] == kEmpty)
+                continue;
+            size_t e = hashEntry(oldKeys[k], mask);
+            while (values[e] != kEmpty)
+                e = (e + 1) & mask;
+            keys[e] = oldKeys[k];
+            values[e] = oldValues[k];
+        }
+    }
+
+    size_t mask = keys.size() - 1;
+    size_t e = hashEntry(id, mask);
+    while (values[e] != kEmpty)
+        e = (e + 1) & mask;
+    keys[e] = id;
+    values[e] = slot;
+    used++;
+}
+
+void TrajectoryStore::EraseSlot(TrackID id) {
+    size_t mask = keys.size() - 1;
+    size_t e = hashEntry(id, mask);
+    while (keys[e] != id || values[e] == kEmpty) {
+        if (values[e] == kEmpty)
+            return;
+        e = (e + 1) & mask;
+    }
+
+    // Backward shift deletion: no tombstones
+    size_t hole = e;
+    for (size_t next = (hole + 1) & mask; values[next] != kEmpty; next = (next + 1) & mask) {
+        size_t home = hashEntry(keys[next], mask);
+        // Move the entry if its home is not in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            keys[hole] = keys[next];
+            values[hole] = values[next];
+            hole = next;
+        }
+    }
+    values[hole] = kEmpty;
+    used--;
+}
+
+void TrajectoryStore::add_Point(TrackID id, uint32_t frame, const cv::Point2d &centroid) {
+    int found = FindSlot(id);
+    uint32_t slot;
+    if (found >= 0) {
+        slot = (uint32_t)found;
+    } else {
+        if (free_slots.empty()) {
+            slot = (uint32_t)slot_ids.size();
+            slot_ids.push_back(id);
+            slot_heads.push_back(0);
+            slot_counts.push_back(0);
+            arena.resize(arena.size() + capacity);
+        } else {
+            slot = free_slots.back();
+            free_slots.pop_back();
+            slot_ids[slot] = id;
+            slot_heads[slot] = 0;
+            slot_counts[slot] = 0;
+        }
+        InsertSlot(id, slot);
+    }
+
+    TrajectoryPoint point;
+    point.frame = frame;
+    point.x = toFixed(centroid.x);
+    point.y = toFixed(centroid.y);
+
+    TrajectoryPoint *ring = &arena[slot * capacity];
+    if (slot_counts[slot] < capacity) {
+        ring[(slot_heads[slot] + slot_counts[slot]) % capacity] = point;
+        slot_counts[slot]++;
+    } else {
+        // Full: the oldest point is overwritten
+        ring[slot_heads[slot]] = point;
+        slot_heads[slot] = (uint32_t)((slot_heads[slot] + 1) % capacity);
+    }
+}
+
+void TrajectoryStore::get_Points(TrackID id, std::vector<TrajectoryPoint> &points) const {
+    points.clear();
+    int slot = FindSlot(id);
+    if (slot < 0)
+        return;
+
+    const TrajectoryPoint *ring = &arena[slot * capacity];
+    for (uint32_t k = 0; k < slot_counts[slot]; k++)
+        points.push_back(ring[(slot_heads[slot] + k) % capacity]);
+}
+
+void TrajectoryStore::Finish(TrackID id) {
+    int found = FindSlot(id);
+    if (found < 0)
+        return;
+    uint32_t slot = (uint32_t)found;
+
+    const TrajectoryPoint *ring = &arena[slot * capacity];
+    uint32_t count = slot_counts[slot];
+    putVarint(finished, id);
+    putVarint(finished, count);
+
+    const TrajectoryPoint *previous = 0;
+    for (uint32_t k = 0; k < count; k++) {
+        const TrajectoryPoint &point = ring[(slot_heads[slot] + k) % capacity];
+        if (previous) {
+            putVarint(finished, point.frame - previous->frame);
+            putSigned(finished, (int64_t)point.x - previous->x);
+            putSigned(finished, (int64_t)point.y - previous->y);
+        } else {
+            putVarint(finished, point.frame);
+            putSigned(finished, point.x);
+            putSigned(finished, point.y);
+        }
+        previous = &point;
+    }
+
+    EraseSlot(id);
+    free_slots.push_back(slot);
+}
+
+const std::vector<unsigned char> &TrajectoryStore::get_Finished() const {
+    return finished;
+}
+
+void TrajectoryStore::ExportFinished(std::ostream &out) {
+    if (!finished.empty())
+        out.write((const char *)finished.data(), (std::streamsize)finished.size());
+    finished.clear();
+}
+
+void TrajectoryStore::Write(std::vector<unsigned char> &data) const {
+    AppendBytes(data, (uint64_t)capacity);
+    AppendBytes(data, (uint64_t)used);
+
+    // Live trajectories only, in chronological order
+    for (size_t e = 0; e < keys.size(); e++) {
+        if (values[e] == kEmpty)
+            continue;
+        uint32_t slot = values[e];
+        const TrajectoryPoint *ring = &arena[slot * capacity];
+        AppendBytes(data, keys[e]);
+        AppendBytes(data, slot_counts[slot]);
+        for (uint32_t k = 0; k < slot_counts[slot]; k++)
+            AppendBytes(data, ring[(slot_heads[slot] + k) % capacity]);
+    }
+
+    AppendBytes(data, (uint64_t)finished.size());
+    data.insert(data.end(), finished.begin(), finished.end());
+}
+
+bool TrajectoryStore::Read(const unsigned char *&data, const unsigned char *end) {
+    uint64_t newCapacity, count;
+    if (!ReadBytes(data, end, newCapacity) || !ReadBytes(data, end, count) || !newCapacity ||
+        newCapacity > kMaxCapacity || count > (uint64_t)(end - data) / (sizeof(TrackID) + sizeof(uint32_t))) {
+        clear();
+        return false;
+    }
+
+    capacity = (size_t)newCapacity;
+    clear();
+
+    for (uint64_t t = 0; t < count; t++) {
+        TrackID id;
+        uint32_t points;
+        // Checked against the bytes left before the ring buffer of the track is allocated
+        if (!ReadBytes(data, end, id) || !ReadBytes(data, end, points) || points > capacity ||
+            (uint64_t)points * sizeof(TrajectoryPoint) > (uint64_t)(end - data) || Contains(id)) {
+            clear();
+            return false;
+        }
+        for (uint32_t k = 0; k < points; k++) {
+            TrajectoryPoint point;
+            if (!ReadBytes(data, end, point)) {
+                clear();
+                return false;
+            }
+            add_Point(id, point.frame, point.get_Centroid());
+        }
+    }
+
+    uint64_t finishedSize;
+    if (!ReadBytes(data, end, finishedSize) || finishedSize > (uint64_t)(end - data)) {
+        clear();
+        return false;
+    }
+    finished.assign(data, data + finishedSize);
+    data += finishedSize;
+
+    return true;
+}
+
+size_t cvb::DecodeTrajectories(const unsigned char *data, size_t size, std::vector<Trajectory> &trajectories) {
+    const unsigned char *begin = data;
+    const unsigned char *end = data + size;
+    const unsigned char *decoded = data;
+
+    Trajectory trajectory;
+    while (data < end) {
+        uint64_t id, count;
+        if (!getVarint(data, end, id) || !getVarint(data, end, count))
+            break;
+
+        trajectory.id = (TrackID)id;
+        trajectory.points.clear();
+        bool complete = true;
+        TrajectoryPoint point = TrajectoryPoint();
+        for (uint64_t k = 0; k < count && complete; k++) {
+            uint64_t frame;
+            int64_t x, y;
+            complete = getVarint(data, end, frame) && getSigned(data, end, x) && getSigned(data, end, y);
+            if (!complete)
+                break;
+
+            point.frame = (uint32_t)(k ? point.frame + frame : frame);
+            point.x = (int32_t)(k ? point.x + x : x);
+            point.y = (int32_t)(k ? point.y + y : y);
+            trajectory.points.push_back(point);
+        }
+        if (!complete)
+            break;
+
+        trajectories.push_back(trajectory);
+        decoded = data;
+    }
+
+    return (size_t)(decoded - begin);
+}
@@ -0,0 +1,167 @@
+// Copyright (C) 2007 by Cristóbal Carnero Liñán
+// grendel.ccl@gmail.com
+//
+// Copyright (C) 2013 by Fabrice de Gans for ProViSys Engineering
+// fabrice.degans@gmail.com
+//
+// This file is part of cvBlob.
+//
+// cvBlob is free software: you can redistribute it and/or modify
+// it under the terms of the Lesser GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cvBlob is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// Lesser GNU General Public License for more details.
+//
+// You should have received a copy of the Lesser GNU General Public License
+// along with cvBlob.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+/// \file cvb_trajectory.h
+/// \brief cvBlob trajectory store header file.
+
+#ifdef SWIG
+%module cvblob
+    %{
+#include "cvb_trajectory.h"
+        %}
+#endif
+
+#ifndef _CVBLOB_TRAJECTORY_H_
+#define _CVBLOB_TRAJECTORY_H_
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "cvb_defines.h"
+
+namespace cvb {
+
+    /// \brief Type of identification numbers.
+    typedef uint32_t TrackID;
+
+    /// \brief Fixed point scale of the trajectory positions (1/16 pixel).
+#define CVB_TRAJECTORY_SCALE 16
+
+    /// \brief Position of a track at a frame.
+    struct CVBLOB_EXPORT TrajectoryPoint {
+        uint32_t frame; ///< Frame number.
+        int32_t x;      ///< X-coordinate of the centroid, in 1/CVB_TRAJECTORY_SCALE pixels.
+        int32_t y;      ///< Y-coordinate of the centroid, in 1/CVB_TRAJECTORY_SCALE pixels.
+
+        /// \brief Gets the centroid.
+        /// \return The centroid, in pixels.
+        cv::Point2d get_Centroid() const;
+    };
+
+    /// \brief Trajectory of a track.
+    struct CVBLOB_EXPORT Trajectory {
+        TrackID id;                          ///< Track identification number.
+        std::vector<TrajectoryPoint> points; ///< Points, in chronological order.
+    };
+
+    /// \brief Bounded store of the recent trajectories of the live tracks.
+    /// Each track has a ring buffer of a fixed number of points, all of them in one contiguous arena, and is found
+    /// from its id with an open addressing hash table. Finished trajectories are encoded, frame and position deltas
+    /// as variable length integers, in a buffer to be drained with ExportFinished.
+    class CVBLOB_EXPORT TrajectoryStore {
+    public:
+        /// \brief Constructor.
+        /// \param capacity Maximum number of points kept for each track (the oldest are overwritten), at most 65536.
+        TrajectoryStore(size_t capacity = 64);
+
+        /// \brief Removes all the trajectories, finished ones included.
+        void clear();
+
+        /// \brief Gets the maximum number of points of each trajectory.
+        /// \return The capacity.
+        size_t get_Capacity() const;
+
+        /// \brief Gets the number of live trajectories.
+        /// \return The number of trajectories.
+        size_t get_Size() const;
+
+        /// \brief Whether a track has a live trajectory.
+        /// \param id Track identification number.
+        /// \return True if the track has a trajectory.
+        bool Contains(TrackID id) const;
+
+        /// \brief Adds a point to the trajectory of a track, creating it if needed.
+        /// \param id Track identification number.
+        /// \param frame Frame number, not lower than the one of the previous point.
+        /// \param centroid Centroid of the track.
+        void add_Point(TrackID id, uint32_t frame, const cv::Point2d &centroid);
+
+        /// \brief Gets the trajectory of a track.
+        /// \param id Track identification number.
+        /// \param points Output points, in chronological order, empty if the track has no trajectory.
+        void get_Points(TrackID id, std::vector<TrajectoryPoint> &points) const;
+
+        /// \brief Encodes the trajectory of a track and removes it from the store.
+        /// \param id Track identification number.
+        void Finish(TrackID id);
+
+        /// \brief Gets the encoded finished trajectories, not yet exported.
+        /// \return The encoded trajectories.
+        /// \see DecodeTrajectories
+        const std::vector<unsigned char> &get_Finished() const;
+
+        /// \brief Writes the encoded finished trajectories to a stream, and releases them.
+        /// \param out The output stream.
+        void ExportFinished(std::ostream &out);
+
+        /// \brief Appends the whole store, finished trajectories included, to a snapshot.
+        /// \param data Snapshot buffer.
+        void Write(std::vector<unsigned char> &data) const;
+
+        /// \brief Replaces the store by one written by Write.
+        /// \param data Read position, moved past the store.
+        /// \param end End of the snapshot.
+        /// \return False if the snapshot is malformed, the store being then cleared. Capacities over 65536 points,
+        /// and counts of tracks or points that the snapshot is too short to hold, are rejected before any allocation.
+        bool Read(const unsigned char *&data, const unsigned char *end);
+
+    protected:
+        /// \brief Slot index of a track, or -1.
+        int FindSlot(TrackID id) const;
+
+        /// \brief Inserts a track in the hash table, growing it as needed.
+        void InsertSlot(TrackID id, uint32_t slot);
+
+        /// \brief Removes a track from the hash table.
+        void EraseSlot(TrackID id);
+
+        size_t capacity; ///< Points per trajectory.
+
+        std::vector<TrajectoryPoint> arena; ///< Ring buffers, capacity points per slot.
+        std::vector<TrackID> slot_ids;      ///< Track of each slot.
+        std::vector<uint32_t> slot_heads;   ///< Position of the oldest point of each slot.
+        std::vector<uint32_t> slot_counts;  ///< Number of points of each slot.
+        std::vector<uint32_t> free_slots;   ///< Unused slots.
+
+        std::vector<TrackID> keys;     ///< Hash table keys.
+        std::vector<uint32_t> values;  ///< Hash table slots, empty entries being 0xffffffff.
+        size_t used;                   ///< Number of used hash table entries.
+
+        std::vector<unsigned char> finished; ///< Encoded finished trajectories.
+    };
+
+    /// \brief Decodes trajectories encoded by a TrajectoryStore.
+    /// Each trajectory is: id, number of points, first frame, first x and y, then for each other point the frame
+    /// delta and the x and y deltas. All are LEB128 variable length integers, zigzag encoded when signed.
+    /// \param data Encoded data.
+    /// \param size Size of the data.
+    /// \param trajectories Output trajectories, appended.
+    /// \return The number of bytes decoded: the last incomplete trajectory, if any, is left out.
+    CVBLOB_EXPORT size_t DecodeTrajectories(const unsigned char *data, size_t size, std::vector<Trajectory> &trajectories);
+
+} // Namespace
+
+#endif // _CVBLOB_TRAJECTORY_H_